@@ -0,0 +1,194 @@
+#include <limits.h>
+
+#include "test/bench.h"
+#include "src/components/buffer.c"
+#include "src/components/history.c"
+#include "src/components/search.c"
+#include "src/utils/lz.c"
+#include "src/utils/utils.c"
+
+#define BENCH_CORPUS_LINES 256
+
+static char froms[BENCH_CORPUS_LINES][16];
+static char texts[BENCH_CORPUS_LINES][TEXT_LENGTH_MAX + 1];
+static size_t texts_len[BENCH_CORPUS_LINES];
+
+static struct buffer b;
+static struct buffer big;
+static unsigned int big_rows;
+
+static void
+bench_buffer_newline(size_t n)
+{
+	/* Lines added to a full buffer, as in a busy channel */
+
+	for (size_t i = 0; i < n; i++) {
+
+		size_t j = i % BENCH_CORPUS_LINES;
+
+		buffer_newline(&b, BUFFER_LINE_CHAT, froms[j], texts[j], strlen(froms[j]), texts_len[j], 0);
+	}
+}
+
+static void
+bench_buffer_line_rows(size_t n)
+{
+	/* Rows of each line at a new width, as when the terminal is resized */
+
+	unsigned rows = 0;
+
+	for (size_t i = 0; i < n; i++)
+		rows += buffer_line_rows(buffer_line(&b, b.tail + (unsigned) (i % BUFFER_LINES)), 40 + (i / BUFFER_LINES) % 2);
+
+	if (rows == 0)
+		bench_abort("buffer_line_rows");
+}
+
+static void
+bench_buffer_line_rows_cached(size_t n)
+{
+	/* Rows of each line at an unchanged width, as when drawing */
+
+	unsigned rows = 0;
+
+	for (size_t i = 0; i < n; i++)
+		rows += buffer_line_rows(buffer_line(&b, b.tail + (unsigned) (i % BUFFER_LINES)), 80);
+
+	if (rows == 0)
+		bench_abort("buffer_line_rows");
+}
+
+static void
+bench_buffer_line_wrap(size_t n)
+{
+	/* Rows of each line sliced at an unchanged width, as when drawing */
+
+	size_t len = 0;
+
+	for (size_t i = 0; i < n; i++) {
+
+		struct buffer_line *line = buffer_line(&b, b.tail + (unsigned) (i % BUFFER_LINES));
+		unsigned rows = buffer_line_rows(line, 80);
+
+		for (unsigned row = 0; row < rows; row++) {
+
+			char *end;
+			char *start = buffer_line_wrap(line, 80, row, &end);
+
+			len += (size_t) (end - start);
+		}
+	}
+
+	if (len == 0)
+		bench_abort("buffer_line_wrap");
+}
+
+static void
+bench_buffer_rows_page(size_t n)
+{
+	/* Top line of a page from lines of a large buffer, as when drawing or paging */
+
+	unsigned count = 0;
+
+	for (size_t i = 0; i < n; i++)
+		buffer_rows_back(&big, 80, big.tail + (unsigned) (i * 7919) % (big.head - big.tail), 40, &count);
+
+	if (count == 0)
+		bench_abort("buffer_rows_back");
+}
+
+static void
+bench_buffer_rows_jump(size_t n)
+{
+	/* Line at a percentage of rows of a large buffer, as when jumping through scrollback */
+
+	unsigned count = 0;
+
+	for (size_t i = 0; i < n; i++)
+		buffer_rows_back(&big, 80, big.head - 1, 1 + big_rows / 100 * (unsigned) (i % 100), &count);
+
+	if (count == 0)
+		bench_abort("buffer_rows_back");
+}
+
+static void
+bench_buffer_rows_resize(size_t n)
+{
+	/* Page of a large buffer at changing columns, as when first drawn after a resize */
+
+	unsigned count = 0;
+
+	for (size_t i = 0; i < n; i++)
+		buffer_rows_back(&big, 60 + (unsigned) (i % 40), big.head - 1, 40, &count);
+
+	if (count == 0)
+		bench_abort("buffer_rows_back");
+}
+
+static void
+bench_buffer_rows_reflow(size_t n)
+{
+	/* Lines of a large buffer reflowed to alternating columns, as when idle after a resize */
+
+	static unsigned cols = 80;
+
+	for (size_t i = 0; i < n; i++) {
+		if (!buffer_rows_reflow(&big, cols, 1))
+			cols = (cols == 80 ? 81 : 80);
+	}
+}
+
+int
+main(void)
+{
+	struct benchmark benchmarks[] = {
+		BENCHMARK(bench_buffer_newline),
+		BENCHMARK(bench_buffer_line_rows),
+		BENCHMARK(bench_buffer_line_rows_cached),
+		BENCHMARK(bench_buffer_line_wrap),
+		BENCHMARK(bench_buffer_rows_page),
+		BENCHMARK(bench_buffer_rows_jump),
+		BENCHMARK(bench_buffer_rows_resize),
+		BENCHMARK(bench_buffer_rows_reflow),
+	};
+
+	static const char *words[] = {
+		"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dogs",
+		"an", "irc", "client", "message", "channel", "network", "hello,", "https://example.com/a/longer/link",
+	};
+
+	srand(1);
+
+	buffer(&b);
+
+	for (size_t i = 0; i < BENCH_CORPUS_LINES; i++) {
+
+		size_t n_words = 1 + (size_t) rand() % ((i % 8) ? 16 : 64);
+
+		snprintf(froms[i], sizeof(froms[i]), "nick%zu", i % 64);
+
+		for (size_t j = 0; j < n_words && texts_len[i] < sizeof(texts[i]) - 1; j++) {
+			texts_len[i] += (size_t) snprintf(texts[i] + texts_len[i], sizeof(texts[i]) - texts_len[i],
+				"%s%s", (j ? " " : ""), words[(size_t) rand() % ELEMS(words)]);
+		}
+
+		texts_len[i] = MIN(texts_len[i], sizeof(texts[i]) - 1);
+	}
+
+	for (size_t i = 0; i < BUFFER_LINES; i++) {
+		size_t j = i % BENCH_CORPUS_LINES;
+		buffer_newline(&b, BUFFER_LINE_CHAT, froms[j], texts[j], strlen(froms[j]), texts_len[j], 0);
+	}
+
+	buffer(&big);
+	buffer_lines_set(&big, 100000);
+
+	for (size_t i = 0; i < 100000; i++) {
+		size_t j = i % BENCH_CORPUS_LINES;
+		buffer_newline(&big, BUFFER_LINE_CHAT, froms[j], texts[j], strlen(froms[j]), texts_len[j], 0);
+	}
+
+	buffer_rows_back(&big, 80, big.head - 1, UINT_MAX, &big_rows);
+
+	return run_benchmarks(benchmarks);
+}
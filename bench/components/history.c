@@ -0,0 +1,115 @@
+#include "test/bench.h"
+#include "src/components/history.c"
+#include "src/utils/lz.c"
+#include "src/utils/utils.c"
+
+#define BENCH_CORPUS_LINES 256
+#define BENCH_HISTORY_LINES 200000
+#define BENCH_PAGE_LINES 40
+
+static char froms[BENCH_CORPUS_LINES][16];
+static char texts[BENCH_CORPUS_LINES][TEXT_LENGTH_MAX + 1];
+static struct buffer_line lines[BENCH_CORPUS_LINES];
+
+static struct history h;
+
+static void
+_bench_page(unsigned int first)
+{
+	/* Lines of a page, newest first, as when drawing */
+
+	size_t len = 0;
+
+	for (unsigned int i = BENCH_PAGE_LINES; i > 0; i--)
+		len += history_line(&h, first + i - 1)->text_len;
+
+	if (len == 0)
+		bench_abort("history_line");
+}
+
+static void
+bench_history_add(size_t n)
+{
+	/* Lines evicted to a full history, as in a busy channel */
+
+	for (size_t i = 0; i < n; i++) {
+		if (history_add(&h, &lines[i % BENCH_CORPUS_LINES]) < 0)
+			bench_abort("history_add");
+	}
+}
+
+static void
+bench_history_scroll(size_t n)
+{
+	/* Pages scrolled back through history, decompressing blocks in turn */
+
+	static unsigned int page;
+
+	for (size_t i = 0; i < n; i++) {
+
+		unsigned int pages = h.lines / BENCH_PAGE_LINES;
+
+		page = (page + 1) % pages;
+
+		_bench_page(h.lines - (page + 1) * BENCH_PAGE_LINES);
+	}
+}
+
+static void
+bench_history_scroll_random(size_t n)
+{
+	/* Pages at random through history, decompressing blocks on most pages */
+
+	for (size_t i = 0; i < n; i++)
+		_bench_page((unsigned int) rand() % (h.lines - BENCH_PAGE_LINES));
+}
+
+int
+main(void)
+{
+	struct benchmark benchmarks[] = {
+		BENCHMARK(bench_history_add),
+		BENCHMARK(bench_history_scroll),
+		BENCHMARK(bench_history_scroll_random),
+	};
+
+	static const char *words[] = {
+		"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dogs",
+		"an", "irc", "client", "message", "channel", "network", "hello,", "https://example.com/a/longer/link",
+	};
+
+	srand(1);
+
+	history_init(&h, (size_t) 64 << 20);
+
+	for (size_t i = 0; i < BENCH_CORPUS_LINES; i++) {
+
+		size_t n_words = 1 + (size_t) rand() % ((i % 8) ? 16 : 64);
+		size_t len = 0;
+
+		snprintf(froms[i], sizeof(froms[i]), "nick%zu", i % 64);
+
+		for (size_t j = 0; j < n_words && len < sizeof(texts[i]) - 1; j++) {
+			len += (size_t) snprintf(texts[i] + len, sizeof(texts[i]) - len,
+				"%s%s", (j ? " " : ""), words[(size_t) rand() % ELEMS(words)]);
+		}
+
+		lines[i].from = froms[i];
+		lines[i].text = texts[i];
+		lines[i].from_len = (unsigned short) strlen(froms[i]);
+		lines[i].text_len = (unsigned short) MIN(len, sizeof(texts[i]) - 1);
+		lines[i].time = (time_t) i;
+		lines[i].type = BUFFER_LINE_CHAT;
+	}
+
+	for (size_t i = 0; i < BENCH_HISTORY_LINES; i++) {
+		lines[i % BENCH_CORPUS_LINES].time = (time_t) i;
+		if (history_add(&h, &lines[i % BENCH_CORPUS_LINES]) < 0)
+			bench_abort("history_add");
+	}
+
+	fprintf(stderr, "history: %u lines, %zu KiB compressed, ratio %.2f\n",
+		h.lines, h.size / 1024, (double) h.raw / (double) h.size);
+
+	return run_benchmarks(benchmarks);
+}
@@ -0,0 +1,100 @@
+#include "test/bench.h"
+#include "src/components/search.c"
+#include "src/utils/utils.c"
+
+#define BENCH_CORPUS_LINES 256
+#define BENCH_INDEX_LINES 1000000
+
+static char froms[BENCH_CORPUS_LINES][16];
+static char texts[BENCH_CORPUS_LINES][512];
+
+static struct search s;
+static unsigned int lines;
+
+static void
+_bench_find(const char *query)
+{
+	/* Find each line with a query, newest first */
+
+	unsigned int found = 0;
+	unsigned int n = lines;
+
+	while (search_find(&s, query, &n))
+		found++;
+
+	if (found == 0)
+		bench_abort("search_find");
+}
+
+static void
+bench_search_add(size_t n)
+{
+	/* Lines indexed, as in a busy channel */
+
+	for (size_t i = 0; i < n; i++) {
+
+		size_t j = i % BENCH_CORPUS_LINES;
+
+		search_add(&s, lines, froms[j], (lines % 10000) ? texts[j] : "a rare line");
+		search_drop(&s, ++lines - BENCH_INDEX_LINES);
+	}
+}
+
+static void
+bench_search_find_rare(size_t n)
+{
+	/* Queries of a word in few lines */
+
+	for (size_t i = 0; i < n; i++)
+		_bench_find("rare");
+}
+
+static void
+bench_search_find_words(size_t n)
+{
+	/* Queries of words each in many lines, in fewer lines together */
+
+	for (size_t i = 0; i < n; i++)
+		_bench_find("quick link nick7");
+}
+
+int
+main(void)
+{
+	struct benchmark benchmarks[] = {
+		BENCHMARK(bench_search_add),
+		BENCHMARK(bench_search_find_rare),
+		BENCHMARK(bench_search_find_words),
+	};
+
+	static const char *words[] = {
+		"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dogs",
+		"an", "irc", "client", "message", "channel", "network", "hello,", "https://example.com/a/longer/link",
+	};
+
+	srand(1);
+
+	for (size_t i = 0; i < BENCH_CORPUS_LINES; i++) {
+
+		size_t n_words = 1 + (size_t) rand() % ((i % 8) ? 16 : 64);
+		size_t len = 0;
+
+		snprintf(froms[i], sizeof(froms[i]), "nick%zu", i % 64);
+
+		for (size_t j = 0; j < n_words && len < sizeof(texts[i]) - 1; j++) {
+			len += (size_t) snprintf(texts[i] + len, sizeof(texts[i]) - len,
+				"%s%s", (j ? " " : ""), words[(size_t) rand() % ELEMS(words)]);
+		}
+	}
+
+	search_init(&s);
+
+	for (lines = 0; lines < BENCH_INDEX_LINES; lines++) {
+		size_t j = lines % BENCH_CORPUS_LINES;
+		search_add(&s, lines, froms[j], (lines % 10000) ? texts[j] : "a rare line");
+	}
+
+	fprintf(stderr, "search: %u lines indexed, %u words\n", lines, s.used);
+
+	return run_benchmarks(benchmarks);
+}
@@ -0,0 +1,74 @@
+#include "test/bench.h"
+#include "src/components/user.c"
+#include "src/utils/utils.c"
+
+/* Users in a busy channel */
+#define BENCH_USERS 4096
+
+static char nicks[BENCH_USERS][16];
+static char nicks_upper[BENCH_USERS][16];
+
+static struct user_list ulist;
+
+static void
+bench_user_list_add_del(size_t n)
+{
+	/* Users joining and parting the channel */
+
+	for (size_t i = 0; i < n; i++) {
+
+		const char *nick = nicks[(i * 7919) % BENCH_USERS];
+
+		if (user_list_del(&ulist, CASEMAPPING_RFC1459, nick) != USER_ERR_NONE)
+			bench_abort("user_list_del");
+
+		if (user_list_add(&ulist, CASEMAPPING_RFC1459, nick, MODE_EMPTY) != USER_ERR_NONE)
+			bench_abort("user_list_add");
+	}
+}
+
+static void
+bench_user_list_get(size_t n)
+{
+	/* Users found by nick, differing by case */
+
+	for (size_t i = 0; i < n; i++) {
+		if (!user_list_get(&ulist, CASEMAPPING_RFC1459, nicks_upper[(i * 7919) % BENCH_USERS], 0))
+			bench_abort("user_list_get");
+	}
+}
+
+static void
+bench_user_list_get_prefix(size_t n)
+{
+	/* Users found by prefix, as by tab completion */
+
+	for (size_t i = 0; i < n; i++) {
+		if (!user_list_get(&ulist, CASEMAPPING_RFC1459, nicks[(i * 7919) % BENCH_USERS], 4))
+			bench_abort("user_list_get");
+	}
+}
+
+int
+main(void)
+{
+	struct benchmark benchmarks[] = {
+		BENCHMARK(bench_user_list_add_del),
+		BENCHMARK(bench_user_list_get),
+		BENCHMARK(bench_user_list_get_prefix),
+	};
+
+	for (size_t i = 0; i < BENCH_USERS; i++) {
+
+		snprintf(nicks[i], sizeof(nicks[i]), "%c%c%c_nick%zu",
+			'a' + (int) (i % 26), '[' + (int) (i % 4), 'a' + (int) (i / 26 % 26), i);
+
+		for (size_t j = 0; nicks[i][j]; j++)
+			nicks_upper[i][j] = (char) irc_toupper(CASEMAPPING_RFC1459, nicks[i][j]);
+
+		if (user_list_add(&ulist, CASEMAPPING_RFC1459, nicks[i], MODE_EMPTY) != USER_ERR_NONE)
+			bench_abort("user_list_add");
+	}
+
+	return run_benchmarks(benchmarks);
+}
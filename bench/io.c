@@ -0,0 +1,140 @@
+#include "test/bench.h"
+
+#include <ctype.h>
+
+#include "src/io.c"
+#include "src/utils/timer.c"
+
+#define BENCH_CORPUS_SIZE (1 << 16)
+
+static char corpus[BENCH_CORPUS_SIZE];
+static size_t corpus_len;
+static size_t lines;
+
+/* Stubbed state callbacks */
+void io_cb(enum io_cb_t t, const void *obj, ...) { UNUSED(t); UNUSED(obj); }
+void io_cb_read_inp(char *buf, size_t n) { UNUSED(buf); UNUSED(n); }
+int io_cb_idle(void) { return 0; }
+void io_cb_read_soc(char *buf, size_t n, const void *obj) { UNUSED(buf); UNUSED(n); UNUSED(obj); lines++; }
+void io_cb_read_soc_end(const void *obj) { UNUSED(obj); }
+
+static char tmp[IO_RECV_SIZE];
+
+static void
+io_recv_reference(struct connection *c, const char *buf, size_t n)
+{
+	/* Bytewise filter copying to a line buffer, as before io_scan */
+
+	memcpy(tmp, buf, n);
+	buf = tmp;
+
+	size_t ci = c->read.i;
+
+	for (size_t i = 0; i < n; i++) {
+
+		char cc = buf[i];
+
+		if (ci && cc == '\n' && ((i && buf[i - 1] == '\r') || (!i && c->read.cl == '\r'))) {
+			c->read.buf[ci] = 0;
+			io_cb_read_soc(c->read.buf, ci, c->obj);
+			ci = 0;
+		} else if (ci < IO_MESG_LEN && (isprint(cc) || cc == 0x01)) {
+			c->read.buf[ci++] = cc;
+		}
+	}
+
+	c->read.cl = buf[n - 1];
+	c->read.i = ci;
+}
+
+static void
+io_recv_inplace(struct connection *c, const char *buf, size_t n)
+{
+	memcpy(io_recv_buf(c) + c->read.i, buf, n);
+	io_recv(c, n);
+}
+
+static void
+bench_io_recv(size_t n, void (*recv)(struct connection*, const char*, size_t))
+{
+	/* Each chunk is copied to a receive buffer first, as by recv() */
+
+	struct connection c;
+
+	memset(&c, 0, sizeof(c));
+	c.st_c = IO_ST_CXED;
+
+	bench_bytes(corpus_len);
+
+	while (n--) {
+		for (size_t i = 0; i < corpus_len; i += IO_RECV_SIZE)
+			(*recv)(&c, corpus + i, MIN(IO_RECV_SIZE, corpus_len - i));
+	}
+}
+
+static void
+bench_io_recv_reference(size_t n)
+{
+	bench_io_recv(n, io_recv_reference);
+}
+
+static void
+bench_io_recv_scalar(size_t n)
+{
+	io_scan = io_scan_scalar;
+	bench_io_recv(n, io_recv_inplace);
+}
+
+#ifdef IO_SCAN_X86
+static void
+bench_io_recv_sse2(size_t n)
+{
+	io_scan = io_scan_sse2;
+	bench_io_recv(n, io_recv_inplace);
+}
+
+static void
+bench_io_recv_avx2(size_t n)
+{
+	if (!__builtin_cpu_supports("avx2"))
+		return;
+
+	io_scan = io_scan_avx2;
+	bench_io_recv(n, io_recv_inplace);
+}
+#endif
+
+int
+main(void)
+{
+	struct benchmark benchmarks[] = {
+		BENCHMARK(bench_io_recv_reference),
+		BENCHMARK(bench_io_recv_scalar),
+#ifdef IO_SCAN_X86
+		BENCHMARK(bench_io_recv_sse2),
+		BENCHMARK(bench_io_recv_avx2),
+#endif
+	};
+
+	/* Channel traffic with typical message lengths and CTCP actions */
+	for (size_t i = 0; corpus_len + 512 < sizeof(corpus); i++) {
+
+		int ret = snprintf(corpus + corpus_len, sizeof(corpus) - corpus_len,
+			(i % 8 == 0)
+				? ":nick%zu!user@host.example.com PRIVMSG #channel :\001ACTION %.*s\001\r\n"
+				: ":nick%zu!user@host.example.com PRIVMSG #channel :%.*s\r\n",
+			i % 64,
+			(int) (16 + (i * 37) % 300),
+			"Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor "
+			"incididunt ut labore et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud "
+			"exercitation ullamco laboris nisi ut aliquip ex ea commodo consequat. Duis aute irure "
+			"dolor in reprehenderit in voluptate velit esse cillum dolore eu fugiat nulla pariatur.");
+
+		if (ret < 0)
+			bench_abort("snprintf");
+
+		corpus_len += (size_t) ret;
+	}
+
+	return run_benchmarks(benchmarks);
+}
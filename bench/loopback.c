@@ -0,0 +1,398 @@
+#include "test/bench.h"
+
+/* End to end throughput from a loopback IRC server
+ *
+ * A server thread on 127.0.0.1 registers the client, then writes a mix of
+ * channel traffic as fast as the client reads it. The client runs the io
+ * event loop, with messages handled by irc_recv, added to buffers and
+ * drawn once per socket read, exactly as in rirc
+ *
+ * Usage: loopback [-n messages] [-r rate] [mix ...]
+ *
+ *   -n    messages per mix, default LOOPBACK_MESGS
+ *   -r    messages per second written, otherwise as fast as possible
+ *   mix   mixes to run by name, otherwise all
+ *
+ * Reports messages per second, and percentiles of the latency from each
+ * message being written to the socket to its read being drawn. Unpaced,
+ * latency includes time queued in the socket behind a saturated client
+ */
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+
+/* Hooks around the state data callbacks, for timing messages drawn */
+#define io_cb_read_soc     loopback_read_soc
+#define io_cb_read_soc_end loopback_read_soc_end
+static void loopback_read_soc(char*, size_t, const void*);
+static void loopback_read_soc_end(const void*);
+
+#include "src/components/buffer.c"
+#include "src/components/history.c"
+#include "src/components/search.c"
+#include "src/utils/lz.c"
+#include "src/components/channel.c"
+#include "src/components/input.c"
+#include "src/components/mode.c"
+#include "src/components/server.c"
+#include "src/components/user.c"
+#include "src/draw.c"
+#include "src/handlers/irc_ctcp.c"
+#include "src/handlers/irc_recv.c"
+#include "src/handlers/irc_send.c"
+#include "src/io.c"
+
+#undef io_cb_read_soc
+#undef io_cb_read_soc_end
+void io_cb_read_soc(char*, size_t, const void*);
+void io_cb_read_soc_end(const void*);
+
+#undef CTRL /* <sys/ttydefaults.h> */
+#include "src/state.c"
+#include "src/utils/timer.c"
+#include "src/utils/utils.c"
+
+#include "test/rirc.c.mock"
+
+const char *default_nick_set = "bench";
+const char *runtime_name = "rirc.bench";
+
+#define LOOPBACK_MESGS 100000
+
+/* Nicks in the channel, or joining it */
+#define LOOPBACK_NICKS 256
+
+/* Bytes of traffic per server write */
+#define LOOPBACK_WRITE 16384
+
+struct loopback_mix
+{
+	/* Relative weights of each message type */
+	const char *name;
+	unsigned privmsg;
+	unsigned join;
+	unsigned part;
+	unsigned quit;
+	unsigned names;
+	unsigned mode;
+};
+
+static const struct loopback_mix mixes[] = {
+	{ "privmsg", 100,  0,  0,  0,  0,  0 },
+	{ "churn",    10, 30, 30, 30,  0,  0 },
+	{ "names",    10,  0,  0,  0, 90,  0 },
+	{ "mode",     10,  0,  0,  0,  0, 90 },
+	{ "mixed",    70,  8,  5,  5,  2, 10 },
+};
+
+static struct {
+	const struct loopback_mix *mix;
+	size_t n;      /* messages written, after registering */
+	size_t rate;   /* messages written per second, or 0 */
+	size_t total;  /* messages written, including registering */
+	size_t recv;   /* messages read by the client */
+	size_t drawn;  /* messages drawn by the client */
+	uint64_t *sent; /* time each message was written */
+	uint64_t *lat;  /* latency of each message drawn */
+	int soc;
+} lb;
+
+static void
+loopback_read_soc(char *buf, size_t len, const void *obj)
+{
+	lb.recv++;
+
+	io_cb_read_soc(buf, len, obj);
+}
+
+static void
+loopback_read_soc_end(const void *obj)
+{
+	uint64_t t;
+
+	io_cb_read_soc_end(obj);
+
+	t = _bench_time_();
+
+	for (; lb.drawn < lb.recv; lb.drawn++)
+		lb.lat[lb.drawn] = t - lb.sent[lb.drawn];
+
+	if (lb.drawn == lb.total)
+		io_term();
+}
+
+static unsigned
+loopback_rand(uint64_t *x)
+{
+	*x ^= *x >> 12;
+	*x ^= *x << 25;
+	*x ^= *x >> 27;
+
+	return (unsigned) ((*x * 2685821657736338717ULL) >> 32);
+}
+
+static void
+loopback_write(int soc, const char *buf, size_t len, size_t seq, size_t n)
+{
+	/* Write lines seq to seq + n, timestamped as written */
+
+	static uint64_t t0;
+	uint64_t t = _bench_time_();
+
+	if (seq == 0)
+		t0 = t;
+
+	if (lb.rate) {
+
+		uint64_t deadline = t0 + (uint64_t) (seq * 1e9 / lb.rate);
+
+		if (deadline > t) {
+			struct timespec ts = {
+				.tv_sec = (time_t) ((deadline - t) / 1000000000),
+				.tv_nsec = (long) ((deadline - t) % 1000000000)
+			};
+			nanosleep(&ts, NULL);
+			t = _bench_time_();
+		}
+	}
+
+	while (n--)
+		lb.sent[seq++] = t;
+
+	while (len) {
+
+		ssize_t ret;
+
+		if ((ret = write(soc, buf, len)) < 0)
+			bench_abort("write");
+
+		buf += ret;
+		len -= (size_t) ret;
+	}
+}
+
+static void*
+loopback_server(void *arg)
+{
+	char buf[LOOPBACK_WRITE + 1024];
+	char in[1024];
+	int soc;
+	size_t len = 0, seq = 0, seq_w = 0, in_n = 0;
+	ssize_t ret;
+	uint64_t x = 88172645463325252ULL;
+	unsigned joined[LOOPBACK_NICKS] = {0};
+	const struct loopback_mix *m = lb.mix;
+	unsigned w = m->privmsg + m->join + m->part + m->quit + m->names + m->mode;
+
+	UNUSED(arg);
+
+	if ((soc = accept(lb.soc, NULL, NULL)) < 0)
+		bench_abort("accept");
+
+	/* Register once the client sends USER */
+	while (!memchr(in, '\n', in_n) || !strstr(in, "USER ")) {
+		if (in_n == sizeof(in) - 1 || (ret = read(soc, in + in_n, sizeof(in) - 1 - in_n)) <= 0)
+			bench_abort("read");
+		in_n += (size_t) ret;
+		in[in_n] = 0;
+	}
+
+	len += (size_t) sprintf(buf + len, ":srv 001 bench :Welcome\r\n");
+	len += (size_t) sprintf(buf + len, ":bench!user@host JOIN #bench\r\n");
+
+	seq += 2;
+
+	loopback_write(soc, buf, len, seq_w, seq - seq_w);
+
+	seq_w = seq;
+	len = 0;
+
+	for (size_t i = 0; i < lb.n; i++) {
+
+		unsigned r = loopback_rand(&x) % w;
+		unsigned n = loopback_rand(&x) % LOOPBACK_NICKS;
+
+		if (r < m->privmsg) {
+			len += (size_t) sprintf(buf + len,
+				":nick%u!user@host PRIVMSG #bench :message %zu from a busy channel\r\n", n, i);
+		} else if ((r -= m->privmsg) < m->join) {
+			len += (size_t) sprintf(buf + len, ":nick%u!user@host JOIN #bench\r\n", n);
+			joined[n] = 1;
+		} else if ((r -= m->join) < m->part) {
+			len += (size_t) sprintf(buf + len, ":nick%u!user@host PART #bench :bye\r\n", n);
+			joined[n] = 0;
+		} else if ((r -= m->part) < m->quit) {
+			len += (size_t) sprintf(buf + len, ":nick%u!user@host QUIT :bye\r\n", n);
+			joined[n] = 0;
+		} else if ((r -= m->quit) < m->names) {
+			len += (size_t) sprintf(buf + len, ":srv 353 bench = #bench :");
+			for (unsigned j = 0; j < 16; j++, n = (n + 1) % LOOPBACK_NICKS) {
+				len += (size_t) sprintf(buf + len, "%s%snick%u", (j ? " " : ""), (j % 4 ? "" : "@"), n);
+				joined[n] = 1;
+			}
+			len += (size_t) sprintf(buf + len, "\r\n");
+		} else {
+			len += (size_t) sprintf(buf + len, ":op!user@host MODE #bench %co nick%u\r\n",
+				(joined[n] ? '-' : '+'), n);
+		}
+
+		seq++;
+
+		if (len >= LOOPBACK_WRITE || i + 1 == lb.n || lb.rate) {
+			loopback_write(soc, buf, len, seq_w, seq - seq_w);
+			seq_w = seq;
+			len = 0;
+		}
+	}
+
+	/* Wait for the client to disconnect */
+	while ((ret = read(soc, in, sizeof(in))) > 0)
+		;
+
+	close(soc);
+
+	return NULL;
+}
+
+static int
+loopback_cmp(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+static void
+loopback_run(const struct loopback_mix *mix, size_t n)
+{
+	char port[8];
+	pthread_t tid;
+	socklen_t len;
+	struct server *s;
+	struct sockaddr_in sa = {0};
+	uint64_t t;
+
+	lb.mix = mix;
+	lb.n = n;
+	lb.total = n + 2;
+	lb.recv = 0;
+	lb.drawn = 0;
+
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	len = sizeof(sa);
+
+	if ((lb.soc = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+		bench_abort("socket");
+
+	if (bind(lb.soc, (struct sockaddr *)&sa, len) < 0 || listen(lb.soc, 1) < 0)
+		bench_abort("bind");
+
+	if (getsockname(lb.soc, (struct sockaddr *)&sa, &len) < 0)
+		bench_abort("getsockname");
+
+	snprintf(port, sizeof(port), "%u", (unsigned) ntohs(sa.sin_port));
+
+	s = server("127.0.0.1", port, NULL, "user", "real");
+
+	if (server_set_nicks(s, "bench"))
+		bench_abort("server_set_nicks");
+
+	if (server_list_add(state_server_list(), s))
+		bench_abort("server_list_add");
+
+	s->connection = connection(s, "127.0.0.1", port);
+
+	if (pthread_create(&tid, NULL, loopback_server, NULL))
+		bench_abort("pthread_create");
+
+	t = _bench_time_();
+
+	if (io_cx(s->connection))
+		bench_abort("io_cx");
+
+	io_running = 1;
+	io_loop();
+
+	t = _bench_time_() - t;
+
+	io_dx(s->connection);
+
+	if (pthread_join(tid, NULL))
+		bench_abort("pthread_join");
+
+	close(lb.soc);
+
+	qsort(lb.lat, lb.total, sizeof(*lb.lat), loopback_cmp);
+
+	fprintf(stderr, "  %-40s %10zu %14.0f msgs/s  latency p50 %8.1f p90 %8.1f p99 %8.1f max %8.1f us\n",
+		mix->name,
+		n,
+		(lb.total * 1e9) / t,
+		lb.lat[lb.total * 50 / 100] / 1e3,
+		lb.lat[lb.total * 90 / 100] / 1e3,
+		lb.lat[lb.total * 99 / 100] / 1e3,
+		lb.lat[lb.total - 1] / 1e3);
+}
+
+int
+main(int argc, char **argv)
+{
+	int fds[2], opt;
+	size_t n = LOOPBACK_MESGS;
+
+	while ((opt = getopt(argc, argv, "n:r:")) != -1) {
+		switch (opt) {
+			case 'n':
+				if ((n = strtoul(optarg, NULL, 10)) == 0)
+					bench_abort("invalid -n");
+				break;
+			case 'r':
+				if ((lb.rate = strtoul(optarg, NULL, 10)) == 0)
+					bench_abort("invalid -r");
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n messages] [-r rate] [mix ...]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	fprintf(stderr, "%s...\n", __FILE__);
+
+	io_cols = 120;
+	io_rows = 40;
+	flag_tty_resized = 1;
+
+	if (freopen("/dev/null", "w", stdout) == NULL)
+		bench_abort("freopen");
+
+	/* No user input, stdin may not be a tty */
+	if (pipe(fds) < 0 || dup2(fds[0], STDIN_FILENO) < 0)
+		bench_abort("pipe");
+
+	if ((lb.sent = malloc((n + 2) * sizeof(*lb.sent))) == NULL
+	 || (lb.lat = malloc((n + 2) * sizeof(*lb.lat))) == NULL)
+		bench_abort("malloc");
+
+	state_init();
+	io_ev_init();
+
+	for (size_t i = 0; i < ELEMS(mixes); i++) {
+
+		int run = (optind == argc);
+
+		for (int j = optind; j < argc; j++)
+			run |= !strcmp(argv[j], mixes[i].name);
+
+		if (run)
+			loopback_run(&mixes[i], n);
+	}
+
+	free(lb.sent);
+	free(lb.lat);
+
+	return EXIT_SUCCESS;
+}
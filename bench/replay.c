@@ -0,0 +1,301 @@
+#include "test/bench.h"
+
+/* Replay a capture written by rirc --capture, feeding each record through
+ * io_recv to the state callbacks and redrawing once per record, as from
+ * the event loop, with no network involved
+ *
+ * Usage: replay [-r] [file]
+ *
+ *   -r    replay at the original speed, by the capture timestamps,
+ *         otherwise as fast as possible
+ *   file  capture to replay, otherwise a generated capture of channel
+ *         traffic is benchmarked, as run by `make bench`
+ *
+ * Reports messages per second, time per message and peak memory
+ */
+
+#include <fcntl.h>
+#include <sys/resource.h>
+
+#include "src/components/buffer.c"
+#include "src/components/history.c"
+#include "src/components/search.c"
+#include "src/utils/lz.c"
+#include "src/components/channel.c"
+#include "src/components/input.c"
+#include "src/components/mode.c"
+#include "src/components/server.c"
+#include "src/components/user.c"
+#include "src/draw.c"
+#include "src/handlers/irc_ctcp.c"
+#include "src/handlers/irc_recv.c"
+#include "src/handlers/irc_send.c"
+#include "src/io.c"
+#undef CTRL /* <sys/ttydefaults.h> */
+#include "src/state.c"
+#include "src/utils/timer.c"
+#include "src/utils/utils.c"
+
+#include "test/rirc.c.mock"
+
+const char *default_nick_set = "replay";
+const char *runtime_name = "rirc.replay";
+
+/* Connections replayed, by capture stream id */
+#define REPLAY_CONNECTIONS 64
+
+/* Generated capture lines per connection */
+#define REPLAY_LINES 65536
+
+static struct connection *replay_c[REPLAY_CONNECTIONS];
+static char replay_buf[IO_RECV_SIZE];
+
+static struct connection*
+replay_connection(uint32_t id)
+{
+	/* Connect a server to /dev/null for each stream in the capture,
+	 * with its channel current so that each redraw draws its buffer */
+
+	char port[16];
+	int soc;
+	struct server *s;
+
+	if (id >= REPLAY_CONNECTIONS)
+		bench_abort("too many connections");
+
+	if (replay_c[id])
+		return replay_c[id];
+
+	if ((soc = open("/dev/null", O_WRONLY)) < 0)
+		bench_abort("open");
+
+	snprintf(port, sizeof(port), "%u", (unsigned) id);
+
+	s = server("replay", port, NULL, "user", "real");
+
+	if (server_set_nicks(s, "replay"))
+		bench_abort("server_set_nicks");
+
+	if (server_list_add(state_server_list(), s))
+		bench_abort("server_list_add");
+
+	replay_c[id] = s->connection = connection(s, "replay", port);
+	replay_c[id]->soc = soc;
+	replay_c[id]->st_c = IO_ST_CXNG;
+
+	io_state_cxed(replay_c[id]);
+
+	channel_set_current(s->channel);
+
+	return replay_c[id];
+}
+
+static void
+replay_generate(const char *path)
+{
+	/* Channel traffic on two connections, mostly messages with some
+	 * membership churn, in reads of IO_RECV_SIZE */
+
+	char buf[REPLAY_LINES / 16 * 96];
+	struct connection c[2];
+
+	memset(c, 0, sizeof(c));
+
+	if (io_capture(path))
+		bench_abort("io_capture");
+
+	for (size_t i = 0; i < REPLAY_LINES; i += (REPLAY_LINES / 16)) {
+
+		size_t len = 0;
+
+		for (size_t j = i; j < i + (REPLAY_LINES / 16); j++) {
+
+			int ret;
+			unsigned n = (unsigned) (j % 64);
+
+			switch (j % 16) {
+				case 0:
+					ret = snprintf(buf + len, sizeof(buf) - len, ":nick%u!user@host JOIN #replay\r\n", n);
+					break;
+				case 8:
+					ret = snprintf(buf + len, sizeof(buf) - len, ":nick%u!user@host PART #replay :bye\r\n", n);
+					break;
+				default:
+					ret = snprintf(buf + len, sizeof(buf) - len,
+						":nick%u!user@host PRIVMSG #replay :message %zu from a busy channel\r\n", n, j);
+			}
+
+			if (ret < 0 || (size_t) ret >= sizeof(buf) - len)
+				bench_abort("buffer too small");
+
+			len += (size_t) ret;
+		}
+
+		for (size_t j = 0; j < len; j += IO_RECV_SIZE) {
+			for (uint32_t id = 0; id < ELEMS(c); id++) {
+				c[id].id = id;
+				io_capture_write(&c[id], buf + j, MIN(IO_RECV_SIZE, len - j));
+			}
+		}
+	}
+
+	if (fclose(io_capture_fp))
+		bench_abort("fclose");
+
+	io_capture_fp = NULL;
+}
+
+struct replay_stats
+{
+	size_t bytes;
+	size_t mesgs;
+	size_t recs;
+};
+
+static void
+replay(const char *path, int realtime, struct replay_stats *st)
+{
+	char magic[sizeof(IO_CAPTURE_MAGIC) - 1];
+	struct io_capture_rec rec;
+	uint64_t t;
+	FILE *f;
+
+	memset(st, 0, sizeof(*st));
+
+	if ((f = fopen(path, "rb")) == NULL)
+		bench_abort("fopen");
+
+	if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) || memcmp(magic, IO_CAPTURE_MAGIC, sizeof(magic)))
+		bench_abort("not a capture file");
+
+	t = _bench_time_();
+
+	while (fread(&rec, sizeof(rec), 1, f) == 1) {
+
+		struct connection *c = replay_connection(rec.id);
+		const char *p = replay_buf;
+
+		if (rec.len == 0 || rec.len > IO_RECV_SIZE || fread(replay_buf, 1, rec.len, f) != rec.len)
+			bench_abort("truncated or invalid record");
+
+		if (realtime) {
+
+			uint64_t delay = t + rec.time * 1000000;
+			uint64_t now = _bench_time_();
+
+			if (delay > now) {
+				struct timespec ts = {
+					.tv_sec = (time_t) ((delay - now) / 1000000000),
+					.tv_nsec = (long) ((delay - now) % 1000000000)
+				};
+				nanosleep(&ts, NULL);
+			}
+		}
+
+		/* Lines split across records are counted where they end */
+		while ((p = memchr(p, '\n', rec.len - (size_t) (p - replay_buf)))) {
+			st->mesgs++;
+			p++;
+		}
+
+		memcpy(io_recv_buf(c) + c->read.i, replay_buf, rec.len);
+		io_recv(c, rec.len);
+		io_cb_read_soc_end(c->obj);
+
+		timer_run(&io_timers, io_time());
+
+		st->bytes += rec.len;
+		st->recs++;
+	}
+
+	if (ferror(f))
+		bench_abort("fread");
+
+	fclose(f);
+}
+
+static void
+replay_report(void)
+{
+	struct rusage ru;
+
+	if (getrusage(RUSAGE_SELF, &ru) < 0)
+		bench_abort("getrusage");
+
+	fprintf(stderr, "  %-40s %10ld KiB\n", "peak memory", (long) ru.ru_maxrss);
+}
+
+static char replay_path[64];
+
+static void
+bench_replay(size_t n)
+{
+	struct replay_stats st;
+
+	while (n--)
+		replay(replay_path, 0, &st);
+
+	bench_items(st.mesgs);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct benchmark benchmarks[] = {
+		BENCHMARK(bench_replay),
+	};
+
+	int opt, realtime = 0;
+
+	while ((opt = getopt(argc, argv, "r")) != -1) {
+		switch (opt) {
+			case 'r':
+				realtime = 1;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-r] [file]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	io_cols = 120;
+	io_rows = 40;
+	flag_tty_resized = 1;
+
+	if (freopen("/dev/null", "w", stdout) == NULL)
+		bench_abort("freopen");
+
+	state_init();
+
+	if (optind < argc) {
+
+		struct replay_stats st;
+		uint64_t t;
+
+		fprintf(stderr, "%s...\n", argv[optind]);
+
+		t = _bench_time_();
+		replay(argv[optind], realtime, &st);
+		t = _bench_time_() - t;
+
+		fprintf(stderr, "  %-40s %10zu\n", "records", st.recs);
+		fprintf(stderr, "  %-40s %10zu\n", "bytes", st.bytes);
+		fprintf(stderr, "  %-40s %10zu\n", "messages", st.mesgs);
+		fprintf(stderr, "  %-40s %10.0f\n", "messages/s", (t ? st.mesgs * 1e9 / t : 0));
+		fprintf(stderr, "  %-40s %10.1f ns\n", "time/message", (st.mesgs ? (double) t / st.mesgs : 0));
+		replay_report();
+
+		return EXIT_SUCCESS;
+	}
+
+	snprintf(replay_path, sizeof(replay_path), "/tmp/rirc.replay.%ld.capture", (long) getpid());
+
+	replay_generate(replay_path);
+
+	if (run_benchmarks(benchmarks) == EXIT_SUCCESS)
+		replay_report();
+
+	unlink(replay_path);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,155 @@
+#include "test/bench.h"
+
+#include <fcntl.h>
+
+#include "src/components/buffer.c"
+#include "src/components/history.c"
+#include "src/components/search.c"
+#include "src/utils/lz.c"
+#include "src/components/channel.c"
+#include "src/components/input.c"
+#include "src/components/mode.c"
+#include "src/components/server.c"
+#include "src/components/user.c"
+#include "src/draw.c"
+#include "src/handlers/irc_ctcp.c"
+#include "src/handlers/irc_recv.c"
+#include "src/handlers/irc_send.c"
+#include "src/io.c"
+#undef CTRL /* <sys/ttydefaults.h> */
+#include "src/state.c"
+#include "src/utils/timer.c"
+#include "src/utils/utils.c"
+
+#include "test/rirc.c.mock"
+
+const char *default_nick_set = "bench";
+const char *runtime_name = "rirc.bench";
+
+#define BENCH_CORPUS_LINES 4096
+
+static char corpus[BENCH_CORPUS_LINES * 96];
+static size_t corpus_len;
+static size_t corpus_offs[BENCH_CORPUS_LINES + 1];
+
+static struct connection *c;
+
+static void
+bench_recv(const char *buf, size_t n)
+{
+	/* Copy to the receive buffer, as by recv() */
+
+	memcpy(io_recv_buf(c) + c->read.i, buf, n);
+	io_recv(c, n);
+}
+
+static void
+bench_init(void)
+{
+	/* Connect a server to /dev/null and join a channel, with the
+	 * channel current so that each redraw draws its buffer */
+
+	struct server *s;
+	int soc;
+
+	io_cols = 120;
+	io_rows = 40;
+	flag_tty_resized = 1;
+
+	if (freopen("/dev/null", "w", stdout) == NULL)
+		bench_abort("freopen");
+
+	if ((soc = open("/dev/null", O_WRONLY)) < 0)
+		bench_abort("open");
+
+	state_init();
+
+	s = server("localhost", "6667", NULL, "user", "real");
+
+	if (server_set_nicks(s, "bench"))
+		bench_abort("server_set_nicks");
+
+	if (server_list_add(state_server_list(), s))
+		bench_abort("server_list_add");
+
+	c = s->connection = connection(s, "localhost", "6667");
+	c->soc = soc;
+	c->st_c = IO_ST_CXNG;
+
+	io_state_cxed(c);
+
+	bench_recv(":srv 001 bench :Welcome\r\n", 25);
+	bench_recv(":bench!u@h JOIN #bench\r\n", 24);
+
+	/* Channel traffic, mostly messages with some membership churn */
+	for (size_t i = 0; i < BENCH_CORPUS_LINES; i++) {
+
+		int ret;
+		size_t max = sizeof(corpus) - corpus_len;
+		unsigned n = (unsigned) (i % 64);
+
+		corpus_offs[i] = corpus_len;
+
+		switch (i % 16) {
+			case 0:
+				ret = snprintf(corpus + corpus_len, max, ":nick%u!user@host JOIN #bench\r\n", n);
+				break;
+			case 8:
+				ret = snprintf(corpus + corpus_len, max, ":nick%u!user@host PART #bench :bye\r\n", n);
+				break;
+			default:
+				ret = snprintf(corpus + corpus_len, max,
+					":nick%u!user@host PRIVMSG #bench :message %zu from a busy channel\r\n", n, i);
+		}
+
+		if (ret < 0 || (size_t) ret >= max)
+			bench_abort("corpus too small");
+
+		corpus_len += (size_t) ret;
+	}
+
+	corpus_offs[BENCH_CORPUS_LINES] = corpus_len;
+}
+
+static void
+bench_state_recv_line(size_t n)
+{
+	/* Dispatch and redraw for each line, as before batching */
+
+	bench_items(BENCH_CORPUS_LINES);
+
+	while (n--) {
+		for (size_t i = 0; i < BENCH_CORPUS_LINES; i++) {
+			bench_recv(corpus + corpus_offs[i], corpus_offs[i + 1] - corpus_offs[i]);
+			io_cb_read_soc_end(c->obj);
+		}
+	}
+}
+
+static void
+bench_state_recv_chunk(size_t n)
+{
+	/* Dispatch all lines of a socket read, then redraw once */
+
+	bench_items(BENCH_CORPUS_LINES);
+
+	while (n--) {
+		for (size_t i = 0; i < corpus_len; i += IO_RECV_SIZE) {
+			bench_recv(corpus + i, MIN(IO_RECV_SIZE, corpus_len - i));
+			io_cb_read_soc_end(c->obj);
+		}
+	}
+}
+
+int
+main(void)
+{
+	struct benchmark benchmarks[] = {
+		BENCHMARK(bench_state_recv_line),
+		BENCHMARK(bench_state_recv_chunk),
+	};
+
+	bench_init();
+
+	return run_benchmarks(benchmarks);
+}
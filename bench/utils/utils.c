@@ -0,0 +1,189 @@
+#include "test/bench.h"
+
+#include <limits.h>
+
+#include "src/utils/utils.c"
+
+#define BENCH_CORPUS_LINES 256
+
+/* Received messages, as typical of a busy network */
+static char corpus[BENCH_CORPUS_LINES][512];
+static size_t corpus_len[BENCH_CORPUS_LINES];
+
+/* Params and text of each message */
+static char params[BENCH_CORPUS_LINES][512];
+static char texts[BENCH_CORPUS_LINES][256];
+
+/* Nick pairs, differing by case, and RFC 1459 case of {}|^ */
+static const char *nicks[][2] = {
+	{ "nick",          "NICK"          },
+	{ "rirc_user",     "rirc_user"     },
+	{ "Nick[away]",    "nick{AWAY}"    },
+	{ "some|one",      "SOME\\ONE"     },
+	{ "user^2",        "USER~2"        },
+	{ "longer_nick_1", "longer_nick_2" },
+	{ "abc",           "abd"           },
+	{ "ChanServ",      "chanserv"      },
+};
+
+static const char *words[] = {
+	"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dogs",
+	"an", "irc", "client", "message", "channel", "network", "hello,", "rirc_users",
+};
+
+static void
+bench_irc_message_parse(size_t n)
+{
+	/* Each line is copied first, as parsing is in place */
+
+	char buf[512];
+	struct irc_message m;
+
+	for (size_t i = 0; i < n; i++) {
+
+		size_t j = i % BENCH_CORPUS_LINES;
+
+		memcpy(buf, corpus[j], corpus_len[j] + 1);
+
+		if (!irc_message_parse(&m, buf, corpus_len[j]))
+			bench_abort("irc_message_parse");
+	}
+}
+
+static void
+bench_irc_message_param(size_t n)
+{
+	/* All params of a message, copied first, as parsing is in place */
+
+	char buf[512];
+	char *param;
+	struct irc_message m;
+
+	for (size_t i = 0; i < n; i++) {
+
+		memset(&m, 0, sizeof(m));
+		m.params = strcpy(buf, params[i % BENCH_CORPUS_LINES]);
+
+		while (irc_message_param(&m, &param))
+			;
+	}
+}
+
+static void
+bench_irc_strcmp(size_t n)
+{
+	int ret = 0;
+
+	for (size_t i = 0; i < n; i++)
+		ret += irc_strcmp(CASEMAPPING_RFC1459, nicks[i % ELEMS(nicks)][0], nicks[i % ELEMS(nicks)][1]);
+
+	if (ret == INT_MIN)
+		bench_abort("irc_strcmp");
+}
+
+static void
+bench_irc_strncmp(size_t n)
+{
+	int ret = 0;
+
+	for (size_t i = 0; i < n; i++)
+		ret += irc_strncmp(CASEMAPPING_RFC1459, nicks[i % ELEMS(nicks)][0], nicks[i % ELEMS(nicks)][1], 8);
+
+	if (ret == INT_MIN)
+		bench_abort("irc_strncmp");
+}
+
+static void
+bench_irc_pinged(size_t n)
+{
+	/* Message text, a quarter mentioning the nick */
+
+	int ret = 0;
+
+	for (size_t i = 0; i < n; i++)
+		ret += irc_pinged(CASEMAPPING_RFC1459, texts[i % BENCH_CORPUS_LINES], "rirc_user");
+
+	if (ret == INT_MIN)
+		bench_abort("irc_pinged");
+}
+
+static void
+bench_word_wrap(size_t n)
+{
+	/* Message text wrapped to 64 columns, 80 less a typical nick column */
+
+	for (size_t i = 0; i < n; i++) {
+
+		char *text = texts[i % BENCH_CORPUS_LINES];
+		char *end = text + strlen(text);
+
+		while (text < end)
+			word_wrap(64, &text, end);
+	}
+}
+
+int
+main(void)
+{
+	struct benchmark benchmarks[] = {
+		BENCHMARK(bench_irc_message_parse),
+		BENCHMARK(bench_irc_message_param),
+		BENCHMARK(bench_irc_strcmp),
+		BENCHMARK(bench_irc_strncmp),
+		BENCHMARK(bench_irc_pinged),
+		BENCHMARK(bench_word_wrap),
+	};
+
+	srand(1);
+
+	for (size_t i = 0; i < BENCH_CORPUS_LINES; i++) {
+
+		char *text = texts[i];
+		char *p;
+		int ret;
+		size_t len = 0;
+		size_t n_words = 2 + (size_t) rand() % 24;
+		struct irc_message m;
+
+		for (size_t j = 0; j < n_words; j++) {
+			const char *w = (i % 4 == 0 && j == 0) ? "rirc_user:" : words[(size_t) rand() % ELEMS(words)];
+			len += (size_t) snprintf(text + len, sizeof(texts[i]) - len, "%s%s", (j ? " " : ""), w);
+		}
+
+		switch (i % 8) {
+			case 0:
+				ret = snprintf(corpus[i], sizeof(corpus[i]),
+					"@time=2021-01-01T00:00:00.000Z;account=nick%zu :nick%zu!~user@host.example.com PRIVMSG #channel :%s",
+					i, i, text);
+				break;
+			case 1:
+				ret = snprintf(corpus[i], sizeof(corpus[i]),
+					":irc.example.com 353 rirc_user = #channel :@nick%zu +nick%zu nick%zu nick%zu nick%zu :%s",
+					i, i + 1, i + 2, i + 3, i + 4, text);
+				break;
+			case 2:
+				ret = snprintf(corpus[i], sizeof(corpus[i]),
+					":nick%zu!~user@host.example.com MODE #channel +ov nick%zu nick%zu :%s", i, i + 1, i + 2, text);
+				break;
+			default:
+				ret = snprintf(corpus[i], sizeof(corpus[i]),
+					":nick%zu!~user@host.example.com PRIVMSG #channel :%s", i, text);
+				break;
+		}
+
+		if (ret < 0 || (size_t) ret >= sizeof(corpus[i]))
+			bench_abort("corpus line too long");
+
+		corpus_len[i] = (size_t) ret;
+
+		strcpy(params[i], corpus[i]);
+
+		if (!irc_message_parse(&m, params[i], corpus_len[i]))
+			bench_abort("irc_message_parse");
+
+		p = m.params;
+		memmove(params[i], p, strlen(p) + 1);
+	}
+
+	return run_benchmarks(benchmarks);
+}
@@ -35,8 +35,42 @@
 #define BUFFER_LINE_TEXT_FG_NEUTRAL 250
 #define BUFFER_LINE_TEXT_FG_GREEN   113
 
-/* Number of buffer lines to keep in history, must be power of 2 */
-#define BUFFER_LINES_MAX (1 << 10)
+/* Lines of scrollback kept per buffer, by default and by channel type.
+ * Set at runtime for the current channel with :set scrollback
+ *   Integer, [1, 1024, 16777216] */
+#define BUFFER_LINES         1024
+#define BUFFER_LINES_CHANNEL BUFFER_LINES
+#define BUFFER_LINES_PRIVATE BUFFER_LINES
+#define BUFFER_LINES_SERVER  BUFFER_LINES
+
+/* Megabytes of history kept per channel, of lines evicted from scrollback,
+ * in an unlinked temporary file in $TMPDIR, mapped to memory on scrolling.
+ * Files are created once a channel first evicts lines
+ *   Integer, [0, 8, 65536]
+ *   (0: no history) */
+#define HISTORY_MAX 8
+
+/* Histories open at once, each holding a file descriptor and up to
+ * HISTORY_MAX megabytes of $TMPDIR. Lines evicted by further channels,
+ * or once $TMPDIR is full, are dropped
+ *   Integer, [1, 32, 1024] */
+#define HISTORY_FILES 32
+
+/* Newest lines indexed per channel for `:search`, older lines of scrollback
+ * and history are searched line by line, stopping every so many lines to
+ * be continued by repeating the search. Costs roughly 100 to 200 bytes
+ * per line indexed
+ *   Integer, [0, 8192, 16777216]
+ *   (0: no index) */
+#define SEARCH_LINES 8192
+
+/* Seconds without new lines before a channel's scrollback is released,
+ * other than the current channel, moving its lines to history. Channels
+ * without history, or without an open history once HISTORY_FILES are
+ * open, aren't released
+ *   Integer, [0, 0, 2592000]
+ *   (0: never released) */
+#define BUFFER_IDLE_RELEASE 0
 
 /* Colours used for nicks */
 #define NICK_COLOURS {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14};
@@ -111,3 +145,32 @@
 /* Reconnect backoff maximum
  *   Integer, [1, 86400, 86400] */
 #define IO_RECONNECT_BACKOFF_MAX 86400
+
+/* Percent of reconnect backoff delay randomized, spreading reconnects
+ *   Integer, [0, 50, 100] */
+#define IO_RECONNECT_JITTER 50
+
+/* Connections resolving or connecting at once, others are queued
+ *   Integer, [0, 4, 1024]
+ *   (0: no limit) */
+#define IO_RECONNECT_MAX 4
+
+/* Seconds resolved addresses are reused for reconnecting, 0 disables
+ *   Integer, [0, 300, 86400] */
+#define IO_DNS_CACHE_TTL 300
+
+/* Bytes queued for sending before displaying the send queue
+ *   Integer, [512, 8192, 1048576] */
+#define IO_SENDQ_HIGH 8192
+
+/* Bytes queued for sending before sends fail
+ *   Integer, [IO_SENDQ_HIGH, 65536, 16777216] */
+#define IO_SENDQ_MAX 65536
+
+/* Lines sent in a burst before flood control delays sending, 0 disables
+ *   Integer, [0, 5, 1024] */
+#define IO_FLOOD_BURST 5
+
+/* Milliseconds per line sent once the flood control burst is spent
+ *   Integer, [1, 2000, 60000] */
+#define IO_FLOOD_RATE 2000
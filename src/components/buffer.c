@@ -1,23 +1,68 @@
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "src/components/buffer.h"
 
-#define BUFFER_MASK(X) ((X) & (BUFFER_LINES_MAX - 1))
+#define BUFFER_MASK(B, X) ((X) & (B)->mask)
 
-#if BUFFER_MASK(BUFFER_LINES_MAX)
+/* Arena chunk size, holding at least one line of maximum length */
+#define BUFFER_CHUNK_SIZE 8192
+
+/* Lines older than the index matched per search, bounding its latency
+ * to tens of milliseconds when decompressed from history */
+#define BUFFER_SEARCH_SCAN 65536
+
+#if (BUFFER_BLOCK_LINES & (BUFFER_BLOCK_LINES - 1))
 /* Required for proper masking when indexing */
-#error BUFFER_LINES_MAX must be a power of 2
+#error BUFFER_BLOCK_LINES must be a power of 2
 #endif
 
+#define BUFFER_LINE(B, I) \
+	(&(B)->blocks[BUFFER_MASK(B, I) / BUFFER_BLOCK_LINES][(I) % BUFFER_BLOCK_LINES])
+
 static inline unsigned int buffer_full(struct buffer*);
 static inline unsigned int buffer_size(struct buffer*);
 
+static unsigned int buffer_rows_find(struct buffer*, unsigned int);
+static unsigned int buffer_rows_index(struct buffer*, unsigned int);
+static unsigned int buffer_rows_line(struct buffer*, unsigned int, unsigned int);
+static unsigned int buffer_rows_pending(struct buffer*, unsigned int);
+static unsigned int buffer_rows_seek(struct buffer*, unsigned int);
+static unsigned int buffer_rows_sum(struct buffer*, unsigned int);
+static void buffer_rows_add(struct buffer*, unsigned int, unsigned int);
+static void buffer_rows_sync(struct buffer*, unsigned int);
+
+static char* buffer_alloc(struct buffer*, size_t);
 static struct buffer_line* buffer_push(struct buffer*);
+static void buffer_evict(struct buffer*);
+static void buffer_release(struct buffer*);
+static void buffer_resize(struct buffer*, unsigned int);
+
+struct buffer_chunk
+{
+	struct buffer_chunk *next;
+	size_t size;    /* bytes allocated */
+	unsigned lines; /* lines allocated, not yet released */
+	char buf[];
+};
+
+#define BUFFER_CHUNK_BUF (BUFFER_CHUNK_SIZE - sizeof(struct buffer_chunk))
+
+/* Row following the last row wrapped beyond a line's cached offsets, for
+ * wrapping rows drawn in turn from the last rather than the cached offsets.
+ * Cleared when the line's rows are computed, as when its slot is reused */
+static struct {
+	struct buffer_line *line;
+	char *p;
+	unsigned int row;
+	unsigned int w;
+} buffer_line_next;
 
 static inline unsigned int
 buffer_full(struct buffer *b)
 {
-	return buffer_size(b) == BUFFER_LINES_MAX;
+	return buffer_size(b) == b->lines_max;
 }
 
 static inline unsigned int
@@ -26,26 +71,305 @@ buffer_size(struct buffer *b)
 	return b->head - b->tail;
 }
 
+static char*
+buffer_alloc(struct buffer *b, size_t len)
+{
+	/* Allocate a line's text from the newest arena chunk */
+
+	char *ret;
+	struct buffer_chunk *chunk = b->chunk_tail;
+
+	if (chunk == NULL || chunk->size + len > BUFFER_CHUNK_BUF) {
+
+		if ((chunk = b->chunk_spare))
+			b->chunk_spare = NULL;
+		else if ((chunk = malloc(BUFFER_CHUNK_SIZE)) == NULL)
+			fatal("malloc: %s", strerror(errno));
+
+		chunk->next = NULL;
+		chunk->size = 0;
+		chunk->lines = 0;
+
+		if (b->chunk_tail)
+			b->chunk_tail->next = chunk;
+		else
+			b->chunk_head = chunk;
+
+		b->chunk_tail = chunk;
+	}
+
+	ret = chunk->buf + chunk->size;
+
+	chunk->size += len;
+	chunk->lines++;
+
+	return ret;
+}
+
+static void
+buffer_release(struct buffer *b)
+{
+	/* Release the tail line's text. Lines are released in the order
+	 * allocated, so the tail line is always in the oldest chunk */
+
+	struct buffer_chunk *chunk = b->chunk_head;
+
+	if (--chunk->lines)
+		return;
+
+	if (chunk == b->chunk_tail) {
+		chunk->size = 0;
+		return;
+	}
+
+	b->chunk_head = chunk->next;
+
+	if (b->chunk_spare)
+		free(chunk);
+	else
+		b->chunk_spare = chunk;
+}
+
+static void
+buffer_evict(struct buffer *b)
+{
+	/* Evict the tail line to the buffer's history, otherwise discarding it */
+
+	unsigned int first = b->tail - b->history.lines;
+	int dropped = history_add(&b->history, BUFFER_LINE(b, b->tail));
+
+	if (dropped < 0) {
+		/* scrollback locked to tail, or to the new tail if the history
+		 * was lost on error */
+		if (b->scrollback - first <= b->tail - first)
+			b->scrollback = b->tail + 1;
+	} else if (b->scrollback - first < (unsigned int) dropped) {
+		/* scrollback locked to the history's oldest line */
+		b->scrollback = first + (unsigned int) dropped;
+	}
+
+	if (b->rows.tree) {
+		if (b->rows.head == b->tail) {
+			b->rows.head++;
+		} else {
+			unsigned int slot = BUFFER_MASK(b, b->tail);
+			buffer_rows_add(b, slot, buffer_rows_sum(b, slot) - buffer_rows_sum(b, slot + 1));
+		}
+	}
+
+	buffer_release(b);
+
+	b->tail++;
+
+	search_drop(&b->search, b->tail - b->history.lines);
+}
+
+static void
+buffer_resize(struct buffer *b, unsigned int size)
+{
+	/* Resize the ring of lines to a power of 2 size, at least as large as
+	 * the buffer. Lines are indexed by (i & mask), so each block of the
+	 * ring maps whole to a block of the resized ring, and is remapped
+	 * rather than copied, except when the head and tail blocks share a
+	 * block in either ring, where the head block's lines are copied */
+
+	struct buffer_line **blocks;
+	unsigned int mask = size - 1;
+	unsigned int start = b->tail & ~(BUFFER_BLOCK_LINES - 1u);
+	unsigned int n = (b->head - start + BUFFER_BLOCK_LINES - 1) / BUFFER_BLOCK_LINES;
+
+	if (b->blocks == NULL) {
+		b->mask = mask;
+		return;
+	}
+
+	if ((blocks = calloc(size / BUFFER_BLOCK_LINES, sizeof(*blocks))) == NULL)
+		fatal("calloc: %s", strerror(errno));
+
+	for (unsigned int i = 0, j = start; buffer_size(b) && i < n; i++, j += BUFFER_BLOCK_LINES) {
+
+		struct buffer_line **from = &b->blocks[BUFFER_MASK(b, j) / BUFFER_BLOCK_LINES];
+		struct buffer_line **to = &blocks[(j & mask) / BUFFER_BLOCK_LINES];
+
+		if (*to == NULL && *from) {
+			*to = *from;
+			*from = NULL;
+		} else if (*to == NULL) {
+			/* Head block shared the tail block, remapped above */
+			if ((*to = malloc(sizeof(**to) * BUFFER_BLOCK_LINES)) == NULL)
+				fatal("malloc: %s", strerror(errno));
+			memcpy(*to, blocks[(start & mask) / BUFFER_BLOCK_LINES], sizeof(**to) * (b->head - j));
+		} else {
+			/* Head block shares the tail block once resized */
+			memcpy(*to, *from, sizeof(**to) * (b->head - j));
+		}
+	}
+
+	for (unsigned int i = 0; i < (b->mask + 1) / BUFFER_BLOCK_LINES; i++)
+		free(b->blocks[i]);
+
+	free(b->blocks);
+	free(b->rows.tree);
+
+	b->blocks = blocks;
+	b->mask = mask;
+	b->rows.tree = NULL;
+}
+
+static void
+buffer_rows_add(struct buffer *b, unsigned int slot, unsigned int rows)
+{
+	/* Add rows to a slot of the ring, modulo UINT_MAX + 1 for subtracting */
+
+	for (unsigned int k = slot + 1; k <= b->mask + 1; k += k & (~k + 1))
+		b->rows.tree[k - 1] += rows;
+}
+
+static unsigned int
+buffer_rows_sum(struct buffer *b, unsigned int slot)
+{
+	/* Return the rows of slots [0, slot) of the ring */
+
+	unsigned int rows = 0;
+
+	for (unsigned int k = slot; k; k &= k - 1)
+		rows += b->rows.tree[k - 1];
+
+	return rows;
+}
+
+static unsigned int
+buffer_rows_find(struct buffer *b, unsigned int rows)
+{
+	/* Return the greatest slot of the ring with rows of slots before it at most rows */
+
+	unsigned int slot = 0;
+
+	for (unsigned int k = b->mask + 1; k; k >>= 1) {
+		if (slot + k <= b->mask + 1 && b->rows.tree[slot + k - 1] <= rows) {
+			slot += k;
+			rows -= b->rows.tree[slot - 1];
+		}
+	}
+
+	return slot;
+}
+
+static unsigned int
+buffer_rows_index(struct buffer *b, unsigned int i)
+{
+	/* Return the rows of lines [tail, i) */
+
+	unsigned int n = i - b->tail;
+	unsigned int slot = BUFFER_MASK(b, b->tail);
+
+	if (slot + n <= b->mask + 1)
+		return buffer_rows_sum(b, slot + n) - buffer_rows_sum(b, slot);
+
+	return buffer_rows_sum(b, b->mask + 1) - buffer_rows_sum(b, slot) + buffer_rows_sum(b, slot + n - b->mask - 1);
+}
+
+static unsigned int
+buffer_rows_seek(struct buffer *b, unsigned int rows)
+{
+	/* Return the line at a number of rows from the tail, where rows are
+	 * summed in ring order from the tail's slot, wrapping to slot 0 */
+
+	unsigned int slot = BUFFER_MASK(b, b->tail);
+	unsigned int wrap = buffer_rows_sum(b, b->mask + 1) - buffer_rows_sum(b, slot);
+
+	if (rows < wrap)
+		return b->tail + buffer_rows_find(b, buffer_rows_sum(b, slot) + rows) - slot;
+
+	return b->tail + (b->mask + 1 - slot) + buffer_rows_find(b, rows - wrap);
+}
+
+static unsigned int
+buffer_rows_line(struct buffer *b, unsigned int i, unsigned int cols)
+{
+	/* Return the rows of a line drawn in cols */
+
+	unsigned int text_w;
+	struct buffer_line *line = buffer_line(b, i);
+
+	buffer_line_split(line, NULL, &text_w, cols, b->pad);
+
+	return buffer_line_rows(line, text_w);
+}
+
+static unsigned int
+buffer_rows_pending(struct buffer *b, unsigned int cols)
+{
+	/* Return the lines not yet indexed for cols */
+
+	if (b->rows.tree && b->rows.cols == cols && b->rows.pad == b->pad)
+		return b->head - b->rows.head;
+
+	return buffer_size(b);
+}
+
+static void
+buffer_rows_sync(struct buffer *b, unsigned int cols)
+{
+	/* Index the rows of lines added since last synced, rebuilding the tree
+	 * in linear time when the columns or padding have changed */
+
+	if (b->rows.tree && b->rows.cols == cols && b->rows.pad == b->pad) {
+
+		for (; b->rows.head != b->head; b->rows.head++)
+			buffer_rows_add(b, BUFFER_MASK(b, b->rows.head), buffer_rows_line(b, b->rows.head, cols));
+
+		return;
+	}
+
+	if (b->rows.tree == NULL && (b->rows.tree = malloc(sizeof(*b->rows.tree) * (b->mask + 1))) == NULL)
+		fatal("malloc: %s", strerror(errno));
+
+	memset(b->rows.tree, 0, sizeof(*b->rows.tree) * (b->mask + 1));
+
+	for (unsigned int i = b->tail; i != b->head; i++)
+		b->rows.tree[BUFFER_MASK(b, i)] = buffer_rows_line(b, i, cols);
+
+	for (unsigned int k = 1; k <= b->mask + 1; k++) {
+		if (k + (k & (~k + 1)) <= b->mask + 1)
+			b->rows.tree[k + (k & (~k + 1)) - 1] += b->rows.tree[k - 1];
+	}
+
+	b->rows.cols = cols;
+	b->rows.head = b->head;
+	b->rows.pad = b->pad;
+}
+
 static struct buffer_line*
 buffer_push(struct buffer *b)
 {
 	/* Return a new buffer_line pushed to a buffer, ensure that:
 	 *  - scrollback stays between [tail, head)
-	 *  - tail increments when the buffer is full */
+	 *  - tail increments when the buffer is full
+	 *  - the ring grows when full, up to the buffer's line limit */
+
+	struct buffer_line **block;
 
 	if (buffer_line(b, b->scrollback) == buffer_head(b))
 		b->scrollback = b->head;
 
 	if (buffer_full(b)) {
+		buffer_evict(b);
+	} else if (buffer_size(b) == b->mask + 1) {
+		buffer_resize(b, (b->mask + 1) * 2);
+	}
 
-		/* scrollback locked to tail */
-		if (b->scrollback == b->tail)
-			b->scrollback++;
+	if (b->blocks == NULL && (b->blocks = calloc((b->mask + 1) / BUFFER_BLOCK_LINES, sizeof(*b->blocks))) == NULL)
+		fatal("calloc: %s", strerror(errno));
 
-		b->tail++;
-	}
+	block = &b->blocks[BUFFER_MASK(b, b->head) / BUFFER_BLOCK_LINES];
+
+	if (*block == NULL && (*block = malloc(sizeof(**block) * BUFFER_BLOCK_LINES)) == NULL)
+		fatal("malloc: %s", strerror(errno));
+
+	b->head++;
 
-	return &b->buffer_lines[BUFFER_MASK(b->head++)];
+	return BUFFER_LINE(b, b->head - 1);
 }
 
 struct buffer_line*
@@ -53,7 +377,7 @@ buffer_head(struct buffer *b)
 {
 	/* Return the first printable line in a buffer */
 
-	return buffer_size(b) == 0 ? NULL : &b->buffer_lines[BUFFER_MASK(b->head - 1)];
+	return buffer_size(b) == 0 ? NULL : BUFFER_LINE(b, b->head - 1);
 }
 
 struct buffer_line*
@@ -61,7 +385,10 @@ buffer_tail(struct buffer *b)
 {
 	/* Return the last printable line in a buffer */
 
-	return buffer_size(b) == 0 ? NULL : &b->buffer_lines[BUFFER_MASK(b->tail)];
+	if (b->history.lines)
+		return history_line(&b->history, 0);
+
+	return buffer_size(b) == 0 ? NULL : BUFFER_LINE(b, b->tail);
 }
 
 struct buffer_line*
@@ -90,10 +417,16 @@ buffer_line(struct buffer *b, unsigned int i)
 	 *  */
 
 	if (((b->head > b->tail) && (i < b->tail || i >= b->head)) ||
-	    ((b->tail > b->head) && (i < b->tail && i >= b->head)))
+	    ((b->tail > b->head) && (i < b->tail && i >= b->head))) {
+
+		/* Lines evicted to history are indexed [tail - history.lines, tail) */
+		if (b->tail - i <= b->history.lines)
+			return history_line(&b->history, b->history.lines - (b->tail - i));
+
 		fatal("invalid index: %d", i);
+	}
 
-	return &b->buffer_lines[BUFFER_MASK(i)];
+	return BUFFER_LINE(b, i);
 }
 
 unsigned int
@@ -113,13 +446,220 @@ buffer_line_rows(struct buffer_line *line, unsigned int w)
 	if (line->cached.w != w) {
 		line->cached.w = w;
 
-		for (p = line->text, line->cached.rows = 0; *p; line->cached.rows++)
-			word_wrap(w, &p, line->text + line->text_len);
+		if (buffer_line_next.line == line)
+			buffer_line_next.line = NULL;
+
+		for (p = line->text, line->cached.rows = 0; *p; line->cached.rows++) {
+
+			char *end = word_wrap(w, &p, line->text + line->text_len);
+
+			if (line->cached.rows < BUFFER_LINE_WRAPS)
+				line->cached.wraps[line->cached.rows] = (unsigned short) (end - line->text);
+		}
 	}
 
 	return line->cached.rows;
 }
 
+char*
+buffer_line_wrap(struct buffer_line *line, unsigned int w, unsigned int row, char **end)
+{
+	/* Return a row of a line as wrapped by word_wrap, sliced from its
+	 * cached offsets, or wrapped from the last row cached or wrapped */
+
+	char *p = line->text;
+	char *start;
+	char *text_end = line->text + line->text_len;
+	unsigned int r;
+
+	if (line->cached.w != w)
+		buffer_line_rows(line, w);
+
+	if (row >= line->cached.rows)
+		fatal("invalid row: %u of %u", row, line->cached.rows);
+
+	if (!*line->text)
+		return (*end = p);
+
+	if (row < BUFFER_LINE_WRAPS) {
+
+		/* Rows start after the spaces wrapped at by the previous row */
+		if (row) {
+			p += line->cached.wraps[row - 1];
+
+			while (*p == ' ')
+				p++;
+		}
+
+		*end = line->text + line->cached.wraps[row];
+
+		return p;
+	}
+
+	if (buffer_line_next.line == line && buffer_line_next.w == w && buffer_line_next.row <= row) {
+		p = buffer_line_next.p;
+		r = buffer_line_next.row;
+	} else {
+		p += line->cached.wraps[BUFFER_LINE_WRAPS - 1];
+		r = BUFFER_LINE_WRAPS;
+
+		while (*p == ' ')
+			p++;
+	}
+
+	for (; r < row; r++)
+		word_wrap(w, &p, text_end);
+
+	start = p;
+	*end = word_wrap(w, &p, text_end);
+
+	buffer_line_next.line = line;
+	buffer_line_next.p = p;
+	buffer_line_next.row = row + 1;
+	buffer_line_next.w = w;
+
+	return start;
+}
+
+unsigned int
+buffer_rows_back(struct buffer *b, unsigned int cols, unsigned int i, unsigned int rows, unsigned int *count)
+{
+	/* Lines in the buffer are found from the tree of rows, and lines of
+	 * history are walked from the tail. Lines are walked rather than
+	 * indexed when more lines are pending indexing than rows needed, as
+	 * after a resize, leaving the tree to buffer_rows_reflow */
+
+	unsigned int n = 0;
+
+	rows = MAX(rows, 1);
+
+	if (i - b->tail < buffer_size(b) && buffer_rows_pending(b, cols) <= rows) {
+
+		buffer_rows_sync(b, cols);
+
+		if ((n = buffer_rows_index(b, i + 1)) >= rows) {
+			unsigned int top = buffer_rows_seek(b, n - rows);
+			*count = n - buffer_rows_index(b, top);
+			return top;
+		}
+
+		if (b->history.lines == 0) {
+			*count = n;
+			return b->tail;
+		}
+
+		i = b->tail - 1;
+	}
+
+	while ((n += buffer_rows_line(b, i, cols)) < rows && i != b->tail - b->history.lines)
+		i--;
+
+	*count = n;
+
+	return i;
+}
+
+unsigned int
+buffer_rows_forw(struct buffer *b, unsigned int cols, unsigned int i, unsigned int rows, unsigned int *count)
+{
+	/* Lines of history are walked to the tail, and lines in the buffer
+	 * are found from the tree of rows, or walked as in buffer_rows_back */
+
+	unsigned int n = 0;
+	unsigned int end, start;
+
+	rows = MAX(rows, 1);
+
+	for (; i - b->tail >= buffer_size(b); i++) {
+		if ((n += buffer_rows_line(b, i, cols)) >= rows) {
+			*count = n;
+			return i;
+		}
+	}
+
+	if (buffer_rows_pending(b, cols) > rows) {
+
+		while ((n += buffer_rows_line(b, i, cols)) < rows && i != b->head - 1)
+			i++;
+
+		*count = n;
+
+		return i;
+	}
+
+	buffer_rows_sync(b, cols);
+
+	start = buffer_rows_index(b, i);
+	end = buffer_rows_index(b, b->head);
+
+	if (end - start <= rows - n - 1) {
+		*count = n + end - start;
+		return b->head - 1;
+	}
+
+	i = buffer_rows_seek(b, start + rows - n - 1);
+
+	*count = n + buffer_rows_index(b, i + 1) - start;
+
+	return i;
+}
+
+int
+buffer_rows_reflow(struct buffer *b, unsigned int cols, unsigned int n)
+{
+	/* Index the rows of up to n lines, restarting the tree when the
+	 * columns or padding have changed or the ring was resized, returning
+	 * 1 if lines remain. Buffers never indexed aren't indexed */
+
+	if (b->rows.cols == 0 || cols == 0)
+		return 0;
+
+	if (b->rows.tree == NULL || b->rows.cols != cols || b->rows.pad != b->pad) {
+
+		if (b->rows.tree == NULL && (b->rows.tree = malloc(sizeof(*b->rows.tree) * (b->mask + 1))) == NULL)
+			fatal("malloc: %s", strerror(errno));
+
+		memset(b->rows.tree, 0, sizeof(*b->rows.tree) * (b->mask + 1));
+		b->rows.cols = cols;
+		b->rows.head = b->tail;
+		b->rows.pad = b->pad;
+	}
+
+	for (; n && b->rows.head != b->head; n--, b->rows.head++)
+		buffer_rows_add(b, BUFFER_MASK(b, b->rows.head), buffer_rows_line(b, b->rows.head, cols));
+
+	return b->rows.head != b->head;
+}
+
+void
+buffer_line_split(
+	struct buffer_line *line,
+	unsigned int *head_w,
+	unsigned int *text_w,
+	unsigned int cols,
+	unsigned int pad)
+{
+	/* Split the columns of a line drawn between its header and text */
+
+	unsigned int _head_w = sizeof(" HH:MM   "VERTICAL_SEPARATOR" ");
+
+	if (BUFFER_PADDING)
+		_head_w += pad;
+	else
+		_head_w += line->from_len;
+
+	/* If header won't fit, split in half */
+	if (_head_w >= cols)
+		_head_w = cols / 2;
+
+	_head_w -= 1;
+
+	if (head_w)
+		*head_w = _head_w;
+	if (text_w)
+		*text_w = cols - _head_w + 1;
+}
+
 void
 buffer_newline(
 		struct buffer *b,
@@ -143,10 +683,13 @@ buffer_newline(
 	line->from_len = MIN(from_len + (!!prefix), FROM_LENGTH_MAX);
 	line->text_len = MIN(text_len,              TEXT_LENGTH_MAX);
 
+	line->from = buffer_alloc(b, line->from_len + line->text_len + 2);
+	line->text = line->from + line->from_len + 1;
+
 	if (prefix)
 		*line->from = prefix;
 
-	memcpy(line->from + (!!prefix), from_str, line->from_len);
+	memcpy(line->from + (!!prefix), from_str, line->from_len - (!!prefix));
 	memcpy(line->text,              text_str, line->text_len);
 
 	*(line->from + line->from_len) = '\0';
@@ -155,6 +698,12 @@ buffer_newline(
 	line->time = time(NULL);
 	line->type = type;
 
+	if (SEARCH_LINES && type != BUFFER_LINE_CLIENT)
+		search_add(&b->search, b->head - 1, line->from, line->text);
+
+	if (b->head - (b->tail - b->history.lines) > SEARCH_LINES)
+		search_drop(&b->search, b->head - SEARCH_LINES);
+
 	if (line->from_len > b->pad)
 		b->pad = line->from_len;
 
@@ -169,6 +718,55 @@ buffer_newline(
 	}
 }
 
+int
+buffer_search(struct buffer *b, const char *query, unsigned int *i)
+{
+	/* Find the newest line before line *i containing each word of a
+	 * query, in the buffer or its history, setting *i and returning 1,
+	 * or returning 0 if not found. Lines indexed are found from the
+	 * index, and older lines are matched in turn, up to
+	 * BUFFER_SEARCH_SCAN lines, setting *i to the last line matched and
+	 * returning -1 if not found by then, to be continued from *i */
+
+	struct buffer_line *line;
+	unsigned int first = b->tail - b->history.lines;
+	unsigned int n = *i;
+	unsigned int scan = BUFFER_SEARCH_SCAN;
+
+	while (search_find(&b->search, query, &n)) {
+
+		line = buffer_line(b, n);
+
+		if (search_match(query, line->from, line->text)) {
+			*i = n;
+			return 1;
+		}
+	}
+
+	/* Lines before the oldest indexed */
+	if (b->search.first - first < *i - first)
+		n = b->search.first;
+	else
+		n = *i;
+
+	while (n != first) {
+
+		if (scan-- == 0) {
+			*i = n;
+			return -1;
+		}
+
+		line = buffer_line(b, --n);
+
+		if (line->type != BUFFER_LINE_CLIENT && search_match(query, line->from, line->text)) {
+			*i = n;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 float
 buffer_scrollback_status(struct buffer *b)
 {
@@ -177,7 +775,7 @@ buffer_scrollback_status(struct buffer *b)
 	if (buffer_line(b, b->scrollback) == buffer_head(b))
 		return 0;
 
-	return (float)(b->head - b->scrollback) / (float)(buffer_size(b));
+	return (float)(b->head - b->scrollback) / (float)(buffer_size(b) + b->history.lines);
 }
 
 void
@@ -186,4 +784,87 @@ buffer(struct buffer *b)
 	/* Initialize a buffer */
 
 	memset(b, 0, sizeof(*b));
+
+	b->lines_max = BUFFER_LINES;
+	b->mask = BUFFER_BLOCK_LINES - 1;
+}
+
+int
+buffer_trim(struct buffer *b)
+{
+	/* Move all but the newest line of a buffer to its history, shrinking
+	 * the ring and releasing the arena chunks of lines moved. Lines
+	 * remain indexed and searchable from the history. Buffers without a
+	 * history accepting lines, disabled or unable to open while others
+	 * are open, are left as is, rather than losing lines */
+
+	unsigned int lines_max = b->lines_max;
+
+	if (!history_ready(&b->history))
+		return -1;
+
+	buffer_lines_set(b, 1);
+
+	b->lines_max = lines_max;
+
+	free(b->chunk_spare);
+	b->chunk_spare = NULL;
+
+	return 0;
+}
+
+void
+buffer_free(struct buffer *b)
+{
+	/* Free a buffer's lines, leaving it empty */
+
+	struct buffer_chunk *chunk;
+	struct history history;
+	unsigned int lines_max = b->lines_max;
+
+	while ((chunk = b->chunk_head)) {
+		b->chunk_head = chunk->next;
+		free(chunk);
+	}
+
+	free(b->chunk_spare);
+
+	for (unsigned int i = 0; b->blocks && i < (b->mask + 1) / BUFFER_BLOCK_LINES; i++)
+		free(b->blocks[i]);
+
+	free(b->blocks);
+	free(b->rows.tree);
+
+	history_free(&b->history);
+	search_free(&b->search);
+
+	history = b->history;
+
+	buffer(b);
+
+	b->history = history;
+	b->lines_max = lines_max;
+}
+
+void
+buffer_lines_set(struct buffer *b, unsigned int lines)
+{
+	/* Set the lines kept by a buffer, evicting lines from the tail and
+	 * shrinking the ring to fit. The ring grows as lines are added */
+
+	unsigned int size = BUFFER_BLOCK_LINES;
+
+	if (lines == 0 || lines > BUFFER_LINES_MAX)
+		fatal("invalid lines: %u", lines);
+
+	b->lines_max = lines;
+
+	while (buffer_size(b) > lines)
+		buffer_evict(b);
+
+	while (size < lines)
+		size *= 2;
+
+	if (size < b->mask + 1)
+		buffer_resize(b, size);
 }
@@ -3,14 +3,42 @@
 
 #include <time.h>
 
+#include "src/components/history.h"
+#include "src/components/search.h"
 #include "src/utils/utils.h"
 #include "config.h"
 
 #define TEXT_LENGTH_MAX 510 /* FIXME: remove max lengths in favour of growable buffer */
 #define FROM_LENGTH_MAX 100
 
-#ifndef BUFFER_LINES_MAX
-#define BUFFER_LINES_MAX (1 << 10)
+/* Maximum lines kept per buffer */
+#define BUFFER_LINES_MAX (1 << 24)
+
+/* Default lines kept per buffer */
+#ifndef BUFFER_LINES
+#define BUFFER_LINES 1024
+#elif (BUFFER_LINES < 1 || BUFFER_LINES > BUFFER_LINES_MAX)
+#error "BUFFER_LINES: [1, BUFFER_LINES_MAX]"
+#endif
+
+/* Newest lines indexed per buffer for searching */
+#ifndef SEARCH_LINES
+#define SEARCH_LINES 8192
+#elif (SEARCH_LINES < 0 || SEARCH_LINES > 16777216)
+#error "SEARCH_LINES: [0, 16777216]"
+#endif
+
+/* Lines per block of buffer line headers, must be power of 2 */
+#define BUFFER_BLOCK_LINES 64
+
+/* Rows of a line wrapped whose offsets are cached, further rows are
+ * wrapped from the last row cached when drawn */
+#define BUFFER_LINE_WRAPS 4
+
+#ifndef BUFFER_PADDING
+#define BUFFER_PADDING 1
+#elif BUFFER_PADDING != 0 && BUFFER_PADDING != 1
+#error "BUFFER_PADDING options are 0 (no pad), 1 (padded)"
 #endif
 
 /* Buffer line types, in order of precedence */
@@ -25,22 +53,54 @@ enum buffer_line_t
 	BUFFER_LINE_QUIT,         /* Irc QUIT message */
 	BUFFER_LINE_CHAT,         /* Line of text from another IRC user */
 	BUFFER_LINE_PINGED,       /* Line of text from another IRC user containing current nick */
+	BUFFER_LINE_CLIENT,       /* Client feedback, not searched */
 	BUFFER_LINE_T_SIZE
 };
 
+/* Line text is stored in a per-buffer arena of fixed size chunks, appended
+ * to as lines are added and released as lines are evicted from the tail,
+ * so a buffer's memory is in proportion to the text it holds
+ *
+ * Line headers are stored in a power of 2 ring of blocks of
+ * BUFFER_BLOCK_LINES, allocated as lines are first added, and indexed by
+ * a table of blocks. The ring grows as lines are added, up to the buffer's
+ * line limit, by remapping blocks to the larger table rather than copying
+ * lines, and likewise shrinks when the limit is lowered
+ *
+ * Lines evicted from the tail are kept in the buffer's history, if any,
+ * and indexed below the tail
+ *
+ * The newest SEARCH_LINES lines are indexed by word for searching as
+ * they're added, and pruned from the index once older, or dropped from
+ * the buffer and its history. Older lines are searched line by line.
+ * Client feedback lines are neither indexed nor searched
+ *
+ * Rows occupied by lines when drawn are summed in a Fenwick tree over the
+ * ring, for finding the lines a number of rows from a line in logarithmic
+ * time. The tree is keyed by columns and padding, rebuilt when either
+ * changes or the ring is resized, and otherwise brought up to date with
+ * lines added when used. Once more lines are to be indexed than rows are
+ * needed, as after a resize, lines are walked instead, and the tree is
+ * rebuilt incrementally in the background by buffer_rows_reflow
+ *
+ * The offsets at which a line's text wraps are cached with its rows, so
+ * drawing a line slices its text rather than wrapping it on every draw.
+ * Both are computed when first needed for a width, so only lines drawn
+ * are wrapped again once the width changes */
+
 struct buffer_line
 {
-	enum buffer_line_t type;
-	char prefix; /* TODO as part of `from` */
-	char from[FROM_LENGTH_MAX + 1]; /* TODO: from/text as struct string */
-	char text[TEXT_LENGTH_MAX + 1];
-	size_t from_len;
-	size_t text_len;
+	char *from; /* stored in the buffer's arena */
+	char *text; /* stored in the buffer's arena */
 	time_t time;
+	unsigned short from_len;
+	unsigned short text_len;
+	enum buffer_line_t type;
 	struct {
-		unsigned int colour; /* Cached colour of `from` text */
-		unsigned int rows;   /* Cached number of rows occupied when wrapping on w columns */
-		unsigned int w;      /* Cached width for rows */
+		unsigned short rows; /* Cached number of rows occupied when wrapping on w columns */
+		unsigned short w;    /* Cached width for rows */
+		unsigned short wraps[BUFFER_LINE_WRAPS]; /* Cached offsets of rows after the first */
+		unsigned char colour; /* Cached colour of `from` text */
 		unsigned int initialized : 1;
 	} cached;
 };
@@ -51,17 +111,56 @@ struct buffer
 	unsigned int tail;
 	unsigned int scrollback; /* Index of the current line between [tail, head) for scrollback */
 	size_t pad;              /* Pad 'from' when printing to be at least this wide */
-	struct buffer_line buffer_lines[BUFFER_LINES_MAX];
+	struct buffer_chunk *chunk_head;  /* Oldest arena chunk, holding the tail line */
+	struct buffer_chunk *chunk_tail;  /* Newest arena chunk, appended to */
+	struct buffer_chunk *chunk_spare; /* Released arena chunk, reused before allocating */
+	struct history history;           /* Lines evicted, indexed [tail - history.lines, tail) */
+	struct search search;             /* Word index of the newest lines, up to SEARCH_LINES */
+	struct buffer_line **blocks; /* (mask + 1) / BUFFER_BLOCK_LINES blocks */
+	unsigned int mask;           /* Size of the ring of lines, less 1 */
+	unsigned int lines_max;      /* Lines kept, evicting from the tail */
+	struct {
+		unsigned int *tree; /* Fenwick tree of rows per line, mask + 1 entries */
+		unsigned int cols;  /* Columns rows are indexed for */
+		unsigned int head;  /* Lines indexed, [tail, head) */
+		size_t pad;         /* Pad rows are indexed for */
+	} rows;
 };
 
 float buffer_scrollback_status(struct buffer*);
 
+int buffer_search(struct buffer*, const char*, unsigned int*);
+
 int buffer_page_back(struct buffer*, unsigned int, unsigned int);
 int buffer_page_forw(struct buffer*, unsigned int, unsigned int);
 
 unsigned int buffer_line_rows(struct buffer_line*, unsigned int);
 
+/* Return the start of a row of a line wrapped within w columns, setting
+ * end to the end of its text drawn */
+char* buffer_line_wrap(struct buffer_line*, unsigned int, unsigned int, char**);
+
+/* Return the top line of a number of rows drawn in cols ending with line i,
+ * or the oldest line, setting count to the rows from it to line i */
+unsigned int buffer_rows_back(struct buffer*, unsigned int, unsigned int, unsigned int, unsigned int*);
+
+/* Return the bottom line of a number of rows drawn in cols starting with
+ * line i, or the newest line, setting count to the rows from line i to it */
+unsigned int buffer_rows_forw(struct buffer*, unsigned int, unsigned int, unsigned int, unsigned int*);
+
+/* Index the rows of up to n lines drawn in cols, of a buffer indexed
+ * before, returning 1 if lines remain */
+int buffer_rows_reflow(struct buffer*, unsigned int, unsigned int);
+
+void buffer_line_split(struct buffer_line*, unsigned int*, unsigned int*, unsigned int, unsigned int);
+
 void buffer(struct buffer*);
+void buffer_free(struct buffer*);
+
+/* Move all but the newest line to the buffer's history, releasing their
+ * memory, returning -1 if the buffer's history can't accept lines */
+int buffer_trim(struct buffer*);
+void buffer_lines_set(struct buffer*, unsigned int);
 
 struct buffer_line* buffer_head(struct buffer*);
 struct buffer_line* buffer_tail(struct buffer*);
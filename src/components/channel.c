@@ -5,6 +5,30 @@
 #include "src/components/channel.h"
 #include "src/utils/utils.h"
 
+#ifndef BUFFER_LINES_CHANNEL
+#define BUFFER_LINES_CHANNEL BUFFER_LINES
+#elif (BUFFER_LINES_CHANNEL < 1 || BUFFER_LINES_CHANNEL > BUFFER_LINES_MAX)
+#error "BUFFER_LINES_CHANNEL: [1, BUFFER_LINES_MAX]"
+#endif
+
+#ifndef BUFFER_LINES_PRIVATE
+#define BUFFER_LINES_PRIVATE BUFFER_LINES
+#elif (BUFFER_LINES_PRIVATE < 1 || BUFFER_LINES_PRIVATE > BUFFER_LINES_MAX)
+#error "BUFFER_LINES_PRIVATE: [1, BUFFER_LINES_MAX]"
+#endif
+
+#ifndef BUFFER_LINES_SERVER
+#define BUFFER_LINES_SERVER BUFFER_LINES
+#elif (BUFFER_LINES_SERVER < 1 || BUFFER_LINES_SERVER > BUFFER_LINES_MAX)
+#error "BUFFER_LINES_SERVER: [1, BUFFER_LINES_MAX]"
+#endif
+
+#ifndef HISTORY_MAX
+#define HISTORY_MAX 8
+#elif (HISTORY_MAX < 0 || HISTORY_MAX > 65536)
+#error "HISTORY_MAX: [0, 65536]"
+#endif
+
 struct channel*
 channel(const char *name, enum channel_t type)
 {
@@ -23,12 +47,29 @@ channel(const char *name, enum channel_t type)
 	buffer(&c->buffer);
 	input_init(&c->input);
 
+	switch (type) {
+		case CHANNEL_T_CHANNEL:
+			buffer_lines_set(&c->buffer, BUFFER_LINES_CHANNEL);
+			break;
+		case CHANNEL_T_PRIVATE:
+			buffer_lines_set(&c->buffer, BUFFER_LINES_PRIVATE);
+			break;
+		case CHANNEL_T_SERVER:
+			buffer_lines_set(&c->buffer, BUFFER_LINES_SERVER);
+			break;
+		default:
+			break;
+	}
+
+	history_init(&c->buffer.history, (size_t) HISTORY_MAX << 20);
+
 	return c;
 }
 
 void
 channel_free(struct channel *c)
 {
+	buffer_free(&c->buffer);
 	input_free(&c->input);
 	user_list_free(&(c->users));
 	free(c);
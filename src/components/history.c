@@ -0,0 +1,514 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "src/components/buffer.h"
+#include "src/components/history.h"
+#include "src/utils/lz.h"
+#include "src/utils/utils.h"
+
+/* Temporary file directory, otherwise $TMPDIR or /tmp */
+#ifndef HISTORY_DIR
+#define HISTORY_DIR ""
+#endif
+
+/* Histories open at once */
+#ifndef HISTORY_FILES
+#define HISTORY_FILES 32
+#elif (HISTORY_FILES < 1 || HISTORY_FILES > 1024)
+#error "HISTORY_FILES: [1, 1024]"
+#endif
+
+/* Segment size, a multiple of the page size */
+#define HISTORY_SEGMENT_SIZE (1 << 20)
+
+/* Segments mapped at once, including the segment appended to */
+#define HISTORY_MAPPED 4
+
+/* Line headers cached, must be power of 2 */
+#define HISTORY_CACHE 64
+
+/* Bytes of lines per block, compressed once full */
+#define HISTORY_BLOCK_SIZE 16384
+
+/* Decompressed blocks cached */
+#define HISTORY_BLOCKS 4
+
+#if HISTORY_BLOCKS < 2
+/* Required for returned lines to remain valid while decompressing another block */
+#error HISTORY_BLOCKS must be at least 2
+#endif
+
+/* Lines per block, and bytes of a decompressed block, lines followed by their offsets */
+#define HISTORY_BLOCK_LINES (HISTORY_BLOCK_SIZE / sizeof(struct history_rec))
+#define HISTORY_BLOCK_RAW   (HISTORY_BLOCK_SIZE + sizeof(uint16_t) * HISTORY_BLOCK_LINES)
+
+#define HISTORY_INDEX(S, N) \
+	((S)->map + HISTORY_SEGMENT_SIZE - sizeof(struct history_block) * ((N) + 1))
+
+struct history_rec
+{
+	int64_t time;
+	uint16_t text_len;
+	uint8_t from_len;
+	uint8_t type;
+};
+
+struct history_block
+{
+	uint32_t offset;   /* Offset in the segment */
+	uint32_t first;    /* Line number of the first line */
+	uint32_t size;     /* Bytes compressed */
+	uint16_t raw_size; /* Bytes of lines, decompressed */
+	uint16_t lines;
+};
+
+struct history_block_cache
+{
+	unsigned int first; /* Line number of the first line, + 1 */
+	unsigned int used;  /* Clock when last used */
+	char raw[HISTORY_BLOCK_RAW];
+};
+
+struct history_segment
+{
+	char *map;          /* NULL if not mapped */
+	size_t raw;         /* Bytes of blocks, decompressed */
+	size_t size;        /* Bytes of blocks, compressed */
+	unsigned int blocks;
+	unsigned int first; /* Line number of the first line */
+	unsigned int lines;
+	unsigned int slot;  /* Segment of the file */
+	unsigned int used;  /* Clock when last used */
+};
+
+static char history_lz[LZ_BOUND(HISTORY_BLOCK_RAW)];
+static unsigned int history_files;
+
+static char* history_block(struct history*, unsigned int);
+static int history_flush(struct history*);
+static int history_open(struct history*);
+static int history_segment(struct history*);
+static unsigned int history_drop(struct history*);
+static void history_map(struct history*, struct history_segment*);
+
+static int
+history_open(struct history *h)
+{
+	/* Create the unlinked temporary file holding a history's segments */
+
+	static unsigned int n;
+
+	char path[256];
+	const char *dir = HISTORY_DIR;
+	int ret;
+
+	if (!*dir && ((dir = getenv("TMPDIR")) == NULL || !*dir))
+		dir = "/tmp";
+
+	do {
+		ret = snprintf(path, sizeof(path), "%s/rirc.%ld.%u", dir, (long) getpid(), n++);
+
+		if (ret < 0 || (size_t) ret >= sizeof(path))
+			return -1;
+
+	} while ((h->fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0 && errno == EEXIST);
+
+	if (h->fd < 0)
+		return -1;
+
+	unlink(path);
+
+	history_files++;
+
+	if ((h->segs = calloc(h->max / HISTORY_SEGMENT_SIZE, sizeof(*h->segs))) == NULL)
+		fatal("calloc: %s", strerror(errno));
+
+	if ((h->cache = calloc(HISTORY_CACHE + 1, sizeof(*h->cache))) == NULL)
+		fatal("calloc: %s", strerror(errno));
+
+	if ((h->cache_n = calloc(HISTORY_CACHE + 1, sizeof(*h->cache_n))) == NULL)
+		fatal("calloc: %s", strerror(errno));
+
+	if ((h->open = malloc(HISTORY_BLOCK_RAW)) == NULL)
+		fatal("malloc: %s", strerror(errno));
+
+	return 0;
+}
+
+static unsigned int
+history_drop(struct history *h)
+{
+	/* Drop the oldest segment, returning the lines dropped */
+
+	struct history_segment *seg = &h->segs[0];
+	unsigned int lines = seg->lines;
+
+	if (seg->map) {
+		munmap(seg->map, HISTORY_SEGMENT_SIZE);
+		h->mapped--;
+	}
+
+	h->dropped += lines;
+	h->lines -= lines;
+	h->raw -= seg->raw;
+	h->size -= seg->size;
+	h->segs_n--;
+
+	memmove(h->segs, h->segs + 1, sizeof(*h->segs) * h->segs_n);
+
+	return lines;
+}
+
+static void
+history_map(struct history *h, struct history_segment *seg)
+{
+	/* Map a segment, unmapping the least recently used segment other
+	 * than the segment appended to */
+
+	if (h->mapped == HISTORY_MAPPED) {
+
+		struct history_segment *lru = NULL;
+
+		for (size_t i = 0; i + 1 < h->segs_n; i++) {
+			if (h->segs[i].map && (!lru || h->segs[i].used < lru->used))
+				lru = &h->segs[i];
+		}
+
+		if (lru == NULL)
+			fatal("no segment to unmap");
+
+		munmap(lru->map, HISTORY_SEGMENT_SIZE);
+		lru->map = NULL;
+		h->mapped--;
+	}
+
+	seg->map = mmap(NULL,
+		HISTORY_SEGMENT_SIZE,
+		PROT_READ | PROT_WRITE,
+		MAP_SHARED,
+		h->fd,
+		(off_t) seg->slot * HISTORY_SEGMENT_SIZE);
+
+	if (seg->map == MAP_FAILED)
+		fatal("mmap: %s", strerror(errno));
+
+	h->mapped++;
+}
+
+static int
+history_segment(struct history *h)
+{
+	/* Start a new segment, reusing the oldest segment's space when the
+	 * history is full. Space is allocated before use, so that writes
+	 * to the mapped segment can't fail */
+
+	struct history_segment *seg;
+	unsigned int slot = 0;
+
+	if (h->segs_n)
+		slot = (h->segs[h->segs_n - 1].slot + 1) % (h->max / HISTORY_SEGMENT_SIZE);
+
+	if ((errno = posix_fallocate(h->fd, (off_t) slot * HISTORY_SEGMENT_SIZE, HISTORY_SEGMENT_SIZE)))
+		return -1;
+
+	seg = &h->segs[h->segs_n++];
+
+	memset(seg, 0, sizeof(*seg));
+
+	seg->first = h->dropped + h->lines - h->open_lines;
+	seg->slot = slot;
+
+	history_map(h, seg);
+
+	seg->used = ++h->used;
+
+	return 0;
+}
+
+static int
+history_flush(struct history *h)
+{
+	/* Compress the open block to the newest segment, returning the
+	 * number of oldest lines dropped to make room, or -1 on error */
+
+	struct history_block block;
+	struct history_segment *seg = (h->segs_n ? &h->segs[h->segs_n - 1] : NULL);
+	size_t raw = h->open_size + sizeof(uint16_t) * h->open_lines;
+	size_t size;
+	unsigned int dropped = 0;
+
+	/* Offsets follow the block's lines */
+	memmove(h->open + h->open_size, h->open + HISTORY_BLOCK_SIZE, sizeof(uint16_t) * h->open_lines);
+
+	if ((size = lz_compress(h->open, raw, history_lz, sizeof(history_lz))) == 0)
+		fatal("lz_compress");
+
+	if (seg == NULL || seg->size + size + sizeof(block) * (seg->blocks + 1) > HISTORY_SEGMENT_SIZE) {
+
+		while (h->segs_n == h->max / HISTORY_SEGMENT_SIZE)
+			dropped += history_drop(h);
+
+		if (history_segment(h) < 0) {
+
+			/* Out of space for a new segment, reuse the oldest, keeping
+			 * the history at the segments held, if allocated in order */
+			if (!h->segs_n || h->segs[h->segs_n - 1].slot + 1 != h->segs_n)
+				return -1;
+
+			h->max = h->segs_n * HISTORY_SEGMENT_SIZE;
+
+			dropped += history_drop(h);
+
+			if (history_segment(h) < 0)
+				return -1;
+		}
+
+		seg = &h->segs[h->segs_n - 1];
+	}
+
+	block.offset   = (uint32_t) seg->size;
+	block.first    = h->dropped + h->lines - h->open_lines;
+	block.size     = (uint32_t) size;
+	block.raw_size = (uint16_t) h->open_size;
+	block.lines    = (uint16_t) h->open_lines;
+
+	memcpy(seg->map + seg->size, history_lz, size);
+	memcpy(HISTORY_INDEX(seg, seg->blocks), &block, sizeof(block));
+
+	seg->blocks++;
+	seg->lines += h->open_lines;
+	seg->raw += raw;
+	seg->size += size;
+
+	h->raw += raw;
+	h->size += size;
+	h->open_lines = 0;
+	h->open_size = 0;
+
+	/* Cached headers may hold text of the open block */
+	memset(h->cache_n, 0, sizeof(*h->cache_n) * (HISTORY_CACHE + 1));
+
+	return (int) dropped;
+}
+
+static char*
+history_block(struct history *h, unsigned int i)
+{
+	/* Return a line's record from its decompressed block, decompressing
+	 * to the least recently used cached block on a miss */
+
+	struct history_block block;
+	struct history_block_cache *cache;
+	struct history_segment *seg;
+	size_t lo = 0, hi = h->segs_n;
+	uint16_t offset;
+	unsigned int b;
+	unsigned int n = h->dropped + i;
+
+	/* Find the last segment starting at or before the line */
+	while (hi - lo > 1) {
+
+		size_t mid = lo + (hi - lo) / 2;
+
+		if (h->segs[mid].first - h->dropped <= i)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	seg = &h->segs[lo];
+
+	if (seg->map == NULL)
+		history_map(h, seg);
+
+	seg->used = ++h->used;
+
+	/* Find the last block of the segment starting at or before the line */
+	for (lo = 0, hi = seg->blocks; hi - lo > 1;) {
+
+		size_t mid = lo + (hi - lo) / 2;
+
+		memcpy(&block, HISTORY_INDEX(seg, mid), sizeof(block));
+
+		if (block.first - h->dropped <= i)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	memcpy(&block, HISTORY_INDEX(seg, lo), sizeof(block));
+
+	if (h->blocks == NULL && (h->blocks = calloc(HISTORY_BLOCKS, sizeof(*h->blocks))) == NULL)
+		fatal("calloc: %s", strerror(errno));
+
+	for (b = 0; b < HISTORY_BLOCKS; b++) {
+		if (h->blocks[b].first == block.first + 1)
+			break;
+	}
+
+	if (b == HISTORY_BLOCKS) {
+
+		/* Keep the most recently used block, holding the last line returned */
+		for (unsigned int k = 0; k < HISTORY_BLOCKS; k++) {
+			if (k != h->blocks_mru && (b == HISTORY_BLOCKS || h->blocks[k].used < h->blocks[b].used))
+				b = k;
+		}
+
+		cache = &h->blocks[b];
+
+		/* Cached headers may hold text of the evicted block */
+		if (cache->first)
+			memset(h->cache_n, 0, sizeof(*h->cache_n) * (HISTORY_CACHE + 1));
+
+		if (lz_decompress(seg->map + block.offset, block.size, cache->raw, sizeof(cache->raw))
+				!= (size_t) block.raw_size + sizeof(uint16_t) * block.lines)
+			fatal("corrupt history block");
+
+		cache->first = block.first + 1;
+	}
+
+	cache = &h->blocks[b];
+	cache->used = ++h->used;
+	h->blocks_mru = b;
+
+	memcpy(&offset, cache->raw + block.raw_size + sizeof(offset) * (n - block.first), sizeof(offset));
+
+	return cache->raw + offset;
+}
+
+void
+history_init(struct history *h, size_t max)
+{
+	memset(h, 0, sizeof(*h));
+
+	h->max = max - (max % HISTORY_SEGMENT_SIZE);
+}
+
+int
+history_add(struct history *h, const struct buffer_line *line)
+{
+	struct history_rec rec = {
+		.time     = (int64_t) line->time,
+		.text_len = line->text_len,
+		.from_len = (uint8_t) line->from_len,
+		.type     = (uint8_t) line->type
+	};
+
+	char *p;
+	size_t len = sizeof(rec) + rec.from_len + rec.text_len + 2;
+	uint16_t offset;
+	int dropped = 0;
+
+	if (!h->max)
+		return -1;
+
+	/* Dropped until another history is freed */
+	if (h->segs == NULL && history_files == HISTORY_FILES)
+		return -1;
+
+	if (h->segs == NULL && history_open(h) < 0)
+		goto err;
+
+	if (h->open_size + len > HISTORY_BLOCK_SIZE || h->open_lines == HISTORY_BLOCK_LINES) {
+		if ((dropped = history_flush(h)) < 0)
+			goto err;
+	}
+
+	offset = (uint16_t) h->open_size;
+	p = h->open + offset;
+
+	memcpy(p, &rec, sizeof(rec));
+	memcpy(p + sizeof(rec), line->from, rec.from_len + 1);
+	memcpy(p + sizeof(rec) + rec.from_len + 1, line->text, rec.text_len + 1);
+	memcpy(h->open + HISTORY_BLOCK_SIZE + sizeof(offset) * h->open_lines, &offset, sizeof(offset));
+
+	h->open_size += len;
+	h->open_lines++;
+	h->lines++;
+
+	return dropped;
+
+err:
+	history_free(h);
+	h->max = 0;
+
+	return -1;
+}
+
+int
+history_ready(const struct history *h)
+{
+	return h->max && (h->segs || history_files < HISTORY_FILES);
+}
+
+struct buffer_line*
+history_line(struct history *h, unsigned int i)
+{
+	struct buffer_line *line;
+	struct history_rec rec;
+	char *p;
+	unsigned int n = h->dropped + i;
+	unsigned int c = (i == 0 ? HISTORY_CACHE : (n & (HISTORY_CACHE - 1)));
+
+	if (i >= h->lines)
+		fatal("invalid index: %u", i);
+
+	if (h->cache_n[c] == n + 1)
+		return &h->cache[c];
+
+	if (i >= h->lines - h->open_lines) {
+
+		uint16_t offset;
+
+		memcpy(&offset, h->open + HISTORY_BLOCK_SIZE + sizeof(offset) * (i - (h->lines - h->open_lines)), sizeof(offset));
+
+		p = h->open + offset;
+	} else {
+		p = history_block(h, i);
+	}
+
+	memcpy(&rec, p, sizeof(rec));
+
+	line = memset(&h->cache[c], 0, sizeof(*line));
+
+	line->from = p + sizeof(rec);
+	line->text = line->from + rec.from_len + 1;
+	line->time = (time_t) rec.time;
+	line->from_len = rec.from_len;
+	line->text_len = rec.text_len;
+	line->type = (enum buffer_line_t) rec.type;
+
+	h->cache_n[c] = n + 1;
+
+	return line;
+}
+
+void
+history_free(struct history *h)
+{
+	size_t max = h->max;
+
+	for (size_t i = 0; i < h->segs_n; i++) {
+		if (h->segs[i].map)
+			munmap(h->segs[i].map, HISTORY_SEGMENT_SIZE);
+	}
+
+	if (h->segs) {
+		close(h->fd);
+		history_files--;
+	}
+
+	free(h->blocks);
+	free(h->cache);
+	free(h->cache_n);
+	free(h->open);
+	free(h->segs);
+
+	history_init(h, max);
+}
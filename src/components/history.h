@@ -0,0 +1,64 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+/* Scrollback history of lines evicted from a buffer
+ *
+ * Lines are appended to an open block, compressed once full and written
+ * to segments of an unlinked temporary file, mapped to memory, with each
+ * segment holding compressed blocks from its start and an index of its
+ * blocks from its end. A bounded number of segments are mapped at once,
+ * and segments are reused, oldest first, once the history reaches its
+ * maximum size, or no space remains for another segment. Files are
+ * created on the first line added, with at most HISTORY_FILES open
+ *
+ * Lines are returned as buffer_line headers from a small cache, with text
+ * in the open block or a small cache of decompressed blocks. Returned
+ * lines remain valid until two further lines are returned, or a line is
+ * added */
+
+#include <stddef.h>
+
+struct buffer_line;
+struct history_block_cache;
+struct history_segment;
+
+struct history
+{
+	char *open;                         /* Open block, of lines not yet compressed */
+	struct buffer_line *cache;          /* Cached headers, the last for the oldest line */
+	struct history_block_cache *blocks; /* Cached decompressed blocks */
+	struct history_segment *segs;       /* Segments, oldest first */
+	size_t max;                         /* Maximum bytes, 0 if disabled */
+	size_t open_size;                   /* Bytes of lines in the open block */
+	size_t raw;                         /* Bytes of blocks held, decompressed */
+	size_t size;                        /* Bytes of blocks held, compressed */
+	size_t segs_n;                      /* Segments held */
+	unsigned int *cache_n;              /* Line number of each cached header, + 1 */
+	unsigned int dropped;               /* Lines dropped, with their segments */
+	unsigned int lines;                 /* Lines held */
+	unsigned int open_lines;            /* Lines in the open block */
+	unsigned int mapped;                /* Segments mapped */
+	unsigned int used;                  /* Clock of segments and blocks used */
+	unsigned int blocks_mru;            /* Cached block most recently used */
+	int fd;
+};
+
+/* Initialize a history of at most the given bytes, 0 disables */
+void history_init(struct history*, size_t);
+
+/* Append a line, returning the number of oldest lines dropped to make
+ * room, or -1 if not added. Errors disable the history, and histories
+ * not yet opened add no lines while HISTORY_FILES are open */
+int history_add(struct history*, const struct buffer_line*);
+
+/* Return non-zero if lines can be added, the history being open or able
+ * to open */
+int history_ready(const struct history*);
+
+/* Return a line, indexed from the oldest held */
+struct buffer_line* history_line(struct history*, unsigned int);
+
+/* Free a history, leaving it empty */
+void history_free(struct history*);
+
+#endif
@@ -0,0 +1,393 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/components/search.h"
+#include "src/utils/utils.h"
+
+/* Minimum table size, must be power of 2 */
+#define SEARCH_SIZE_MIN 64
+
+/* Query words looked up in the index, further words are matched only */
+#define SEARCH_WORDS_MAX 16
+
+#if (SEARCH_SIZE_MIN & (SEARCH_SIZE_MIN - 1))
+/* Required for proper masking when indexing */
+#error SEARCH_SIZE_MIN must be a power of 2
+#endif
+
+#define SEARCH_WORD_CHAR(C) (isalnum((C)) || (C) >= 0x80)
+
+/* Line number relative to the oldest line indexed, for comparing across overflow */
+#define SEARCH_KEY(S, N) ((N) - (S)->first)
+
+struct search_list
+{
+	unsigned int *lines; /* [start, len) indexed, ascending */
+	uint32_t hash;       /* 0 if unused */
+	unsigned int start;
+	unsigned int len;
+	unsigned int cap;
+};
+
+static int search_contains(struct search*, struct search_list*, unsigned int);
+static int search_word_eq(const char*, const char*, size_t);
+static size_t search_word(const char**, const char**);
+static struct search_list* search_list(struct search*, uint32_t, int);
+static uint32_t search_hash(const char*, size_t);
+static unsigned int search_bound(struct search*, struct search_list*, unsigned int);
+static void search_prune(struct search*, struct search_list*);
+static void search_rehash(struct search*);
+
+static size_t
+search_word(const char **p, const char **word)
+{
+	/* Return the length of the next word from p, 0 if none, advancing p */
+
+	const unsigned char *s = (const unsigned char *) *p;
+
+	while (*s && !SEARCH_WORD_CHAR(*s))
+		s++;
+
+	*word = (const char *) s;
+
+	while (*s && SEARCH_WORD_CHAR(*s))
+		s++;
+
+	*p = (const char *) s;
+
+	return (size_t) (*p - *word);
+}
+
+static int
+search_word_eq(const char *a, const char *b, size_t len)
+{
+	while (len--) {
+		if (tolower((unsigned char) *a++) != tolower((unsigned char) *b++))
+			return 0;
+	}
+
+	return 1;
+}
+
+static uint32_t
+search_hash(const char *word, size_t len)
+{
+	/* FNV-1a of the case folded word, never 0 */
+
+	uint32_t hash = 2166136261U;
+
+	while (len--) {
+		hash ^= (uint32_t) tolower((unsigned char) *word++);
+		hash *= 16777619U;
+	}
+
+	return hash ? hash : 1;
+}
+
+static unsigned int
+search_bound(struct search *s, struct search_list *l, unsigned int n)
+{
+	/* Return the index of the first line of a list at or after line n */
+
+	unsigned int lo = l->start;
+	unsigned int hi = l->len;
+
+	while (lo < hi) {
+
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (SEARCH_KEY(s, l->lines[mid]) < SEARCH_KEY(s, n))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static int
+search_contains(struct search *s, struct search_list *l, unsigned int n)
+{
+	unsigned int i = search_bound(s, l, n);
+
+	return i < l->len && l->lines[i] == n;
+}
+
+static void
+search_prune(struct search *s, struct search_list *l)
+{
+	/* Prune a list's lines before the oldest line indexed, freeing the
+	 * list once empty, and compacting once mostly pruned */
+
+	if (l->start < l->len && (int) (l->lines[l->start] - s->first) < 0) {
+
+		unsigned int lo = l->start;
+		unsigned int hi = l->len;
+
+		/* Lines pruned are a prefix of the list */
+		while (lo < hi) {
+
+			unsigned int mid = lo + (hi - lo) / 2;
+
+			if ((int) (l->lines[mid] - s->first) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		l->start = lo;
+	}
+
+	if (l->start == l->len) {
+		free(l->lines);
+		l->lines = NULL;
+		l->start = 0;
+		l->len = 0;
+		l->cap = 0;
+	} else if (l->start && l->start >= l->len - l->start) {
+		memmove(l->lines, l->lines + l->start, sizeof(*l->lines) * (l->len - l->start));
+		l->len -= l->start;
+		l->start = 0;
+	}
+}
+
+static void
+search_rehash(struct search *s)
+{
+	/* Resize the table to twice the lists not empty, dropping empty lists */
+
+	struct search_list *table = s->table;
+	unsigned int size = s->size;
+	unsigned int used = 0;
+
+	for (unsigned int i = 0; i < size; i++) {
+		if (table[i].hash) {
+			search_prune(s, &table[i]);
+			used += (table[i].len > 0);
+		}
+	}
+
+	for (s->size = SEARCH_SIZE_MIN; s->size < (used + 1) * 2; s->size *= 2)
+		;
+
+	if ((s->table = calloc(s->size, sizeof(*s->table))) == NULL)
+		fatal("calloc: %s", strerror(errno));
+
+	s->used = 0;
+
+	for (unsigned int i = 0; i < size; i++) {
+		if (table[i].len)
+			*search_list(s, table[i].hash, 1) = table[i];
+	}
+
+	free(table);
+}
+
+static struct search_list*
+search_list(struct search *s, uint32_t hash, int insert)
+{
+	/* Return the list of a word's hash, inserted if not found, or NULL */
+
+	unsigned int i;
+
+	if (s->table == NULL) {
+
+		if (!insert)
+			return NULL;
+
+		if ((s->table = calloc(SEARCH_SIZE_MIN, sizeof(*s->table))) == NULL)
+			fatal("calloc: %s", strerror(errno));
+
+		s->size = SEARCH_SIZE_MIN;
+	}
+
+	for (i = hash & (s->size - 1); s->table[i].hash; i = (i + 1) & (s->size - 1)) {
+		if (s->table[i].hash == hash)
+			return &s->table[i];
+	}
+
+	if (!insert)
+		return NULL;
+
+	if ((s->used + 1) > s->size / 4 * 3) {
+		search_rehash(s);
+		return search_list(s, hash, insert);
+	}
+
+	s->table[i].hash = hash;
+	s->used++;
+
+	return &s->table[i];
+}
+
+void
+search_init(struct search *s)
+{
+	memset(s, 0, sizeof(*s));
+}
+
+void
+search_add(struct search *s, unsigned int n, const char *from, const char *text)
+{
+	const char *fields[] = { from, text };
+
+	for (size_t i = 0; i < ELEMS(fields); i++) {
+
+		const char *p = fields[i];
+		const char *word;
+		size_t len;
+
+		while ((len = search_word(&p, &word))) {
+
+			struct search_list *l = search_list(s, search_hash(word, len), 1);
+
+			/* Words repeated in a line are indexed once */
+			if (l->len > l->start && l->lines[l->len - 1] == n)
+				continue;
+
+			if (l->len == l->cap) {
+
+				search_prune(s, l);
+
+				if (l->len == l->cap) {
+					l->cap = (l->cap ? l->cap * 2 : 4);
+					if ((l->lines = realloc(l->lines, sizeof(*l->lines) * l->cap)) == NULL)
+						fatal("realloc: %s", strerror(errno));
+				}
+			}
+
+			l->lines[l->len++] = n;
+		}
+	}
+
+	/* Sweep lists not added to since lines were dropped, amortized over
+	 * a number of lines proportional to the table size */
+	if (s->sweep) {
+		s->sweep--;
+	} else if (s->table) {
+
+		for (unsigned int i = 0; i < s->size; i++) {
+			if (s->table[i].len)
+				search_prune(s, &s->table[i]);
+		}
+
+		s->sweep = s->size;
+	}
+}
+
+void
+search_drop(struct search *s, unsigned int n)
+{
+	if ((int) (n - s->first) > 0)
+		s->first = n;
+}
+
+int
+search_find(struct search *s, const char *query, unsigned int *n)
+{
+	struct search_list *lists[SEARCH_WORDS_MAX];
+	struct search_list *l = NULL;
+	const char *word;
+	size_t len, k = 0;
+	unsigned int i;
+
+	if ((int) (*n - s->first) <= 0)
+		return 0;
+
+	while (k < ELEMS(lists) && (len = search_word(&query, &word))) {
+
+		struct search_list *list;
+
+		if ((list = search_list(s, search_hash(word, len), 0)) == NULL)
+			return 0;
+
+		search_prune(s, list);
+
+		if (list->len == 0)
+			return 0;
+
+		for (i = 0; i < k && lists[i] != list; i++)
+			;
+
+		if (i < k)
+			continue;
+
+		lists[k++] = list;
+
+		if (l == NULL || list->len - list->start < l->len - l->start)
+			l = list;
+	}
+
+	if (l == NULL)
+		return 0;
+
+	/* Lines of the shortest list, newest first, in each other list */
+	for (i = search_bound(s, l, *n); i > l->start; i--) {
+
+		unsigned int line = l->lines[i - 1];
+		size_t j;
+
+		for (j = 0; j < k && (lists[j] == l || search_contains(s, lists[j], line)); j++)
+			;
+
+		if (j == k) {
+			*n = line;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+int
+search_match(const char *query, const char *from, const char *text)
+{
+	const char *word;
+	size_t len;
+
+	if (!search_query(query))
+		return 0;
+
+	while ((len = search_word(&query, &word))) {
+
+		const char *fields[] = { from, text };
+		int found = 0;
+
+		for (size_t i = 0; i < ELEMS(fields) && !found; i++) {
+
+			const char *p = fields[i];
+			const char *w;
+			size_t n;
+
+			while (!found && (n = search_word(&p, &w)))
+				found = (n == len && search_word_eq(w, word, len));
+		}
+
+		if (!found)
+			return 0;
+	}
+
+	return 1;
+}
+
+int
+search_query(const char *query)
+{
+	const char *word;
+
+	return search_word(&query, &word) != 0;
+}
+
+void
+search_free(struct search *s)
+{
+	for (unsigned int i = 0; i < s->size; i++)
+		free(s->table[i].lines);
+
+	free(s->table);
+
+	search_init(s);
+}
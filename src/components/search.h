@@ -0,0 +1,50 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+/* Full-text index of buffer lines
+ *
+ * Lines are split into words of letters, digits and non-ASCII bytes, case
+ * folded and hashed to a table of posting lists, of the numbers of lines
+ * containing each word in ascending order. Lines are indexed as they're
+ * added, and pruned below the oldest line kept, lazily from each posting
+ * list as it's added to or searched, and by a sweep of the table every
+ * so many lines added
+ *
+ * Lines found contain each word's hash, and are checked against the words
+ * of the line for collisions with search_match */
+
+struct search_list;
+
+struct search
+{
+	struct search_list *table; /* Open addressed by word hash */
+	unsigned int first;        /* Oldest line indexed */
+	unsigned int size;         /* Table size, power of 2 */
+	unsigned int sweep;        /* Lines added until the next sweep */
+	unsigned int used;         /* Table entries used */
+};
+
+/* Initialize an empty index */
+void search_init(struct search*);
+
+/* Index line n, of from and text */
+void search_add(struct search*, unsigned int, const char*, const char*);
+
+/* Prune lines before line n */
+void search_drop(struct search*, unsigned int);
+
+/* Find the newest line before line *n with each word of a query, setting
+ * *n and returning 1, or returning 0 if not found */
+int search_find(struct search*, const char*, unsigned int*);
+
+/* Return 1 if a line's from and text contain each word of a query, 0 if
+ * not or the query has no words */
+int search_match(const char*, const char*, const char*);
+
+/* Return 1 if a query has a word to search for */
+int search_query(const char*);
+
+/* Free an index, leaving it empty */
+void search_free(struct search*);
+
+#endif
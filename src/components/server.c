@@ -132,6 +132,8 @@ server_reset(struct server *s)
 {
 	mode_reset(&(s->usermodes), &(s->mode_str));
 	s->ping = 0;
+	s->sendq.lines = 0;
+	s->sendq.delay = 0;
 	s->quitting = 0;
 	s->nicks.next = 0;
 }
@@ -31,6 +31,10 @@ struct server
 	struct server *prev;
 	struct user_list ignore;
 	unsigned ping;
+	struct {
+		unsigned lines; /* lines queued for sending */
+		unsigned delay; /* seconds the oldest line has been queued */
+	} sendq;
 	unsigned quitting : 1;
 	void *connection;
 };
@@ -42,12 +42,6 @@
 /* Size of a full colour string for purposes of pre-formating text to print */
 #define COLOUR_SIZE sizeof(RESET_ATTRIBUTES FG(255) BG(255))
 
-#ifndef BUFFER_PADDING
-#define BUFFER_PADDING 1
-#elif BUFFER_PADDING != 0 && BUFFER_PADDING != 1
-#error "BUFFER_PADDING options are 0 (no pad), 1 (padded)"
-#endif
-
 static int actv_colours[ACTIVITY_T_SIZE] = ACTIVITY_COLOURS
 static int nick_colours[] = NICK_COLOURS
 
@@ -164,9 +158,9 @@ _draw_buffer_line(
 	check_coords(coords);
 
 	char *print_p1,
-	     *print_p2,
-	     *p1 = line->text,
-	     *p2 = line->text + line->text_len;
+	     *print_p2;
+
+	unsigned int rows = buffer_line_rows(line, text_w);
 
 	if (!line->cached.initialized) {
 		/* Initialize static cached properties of drawn lines */
@@ -212,6 +206,7 @@ _draw_buffer_line(
 			case BUFFER_LINE_NICK:
 			case BUFFER_LINE_PART:
 			case BUFFER_LINE_QUIT:
+			case BUFFER_LINE_CLIENT:
 				if (!_draw_fmt(&header_ptr, &buff_n, &text_n, 0,
 						_colour(BUFFER_LINE_HEADER_FG_NEUTRAL, -1)))
 					goto print_header;
@@ -242,9 +237,6 @@ print_header:
 		printf(MOVE(%d, 1) "%s " RESET_ATTRIBUTES, coords.r1, header);
 	}
 
-	while (skip--)
-		word_wrap(text_w, &p1, p2);
-
 	do {
 		char *sep = " "VERTICAL_SEPARATOR" ";
 
@@ -254,11 +246,10 @@ print_header:
 			fputs(sep, stdout);
 		}
 
-		if (*p1) {
+		if (*line->text) {
 			printf(MOVE(%d, %d), coords.r1, head_w);
 
-			print_p1 = p1;
-			print_p2 = word_wrap(text_w, &p1, p2);
+			print_p1 = buffer_line_wrap(line, text_w, skip, &print_p2);
 
 			fputs(_colour(line->text[0] == QUOTE_CHAR
 					? BUFFER_LINE_TEXT_FG_GREEN
@@ -271,7 +262,7 @@ print_header:
 
 		coords.r1++;
 
-	} while (*p1 && coords.r1 <= coords.rN);
+	} while (++skip < rows && coords.r1 <= coords.rN);
 }
 
 static void
@@ -300,9 +291,9 @@ _draw_buffer(struct buffer *b, struct coords coords)
 	 *
 	 * So the general steps for drawing are:
 	 *
-	 * 1. Starting from line L = scrollback, traverse backwards through the
-	 *    buffer summing the rows required to draw lines, until the sum
-	 *    exceeds the number of rows available
+	 * 1. Find the top-most line L, such that drawing lines from L to the
+	 *    scrollback requires at least the number of rows available, or L
+	 *    is the buffer's tail
 	 *
 	 * 2. L now points to the top-most line to be drawn. L might not be able
 	 *    to draw in full, so discard the excessive word-wrapped segments and
@@ -333,29 +324,17 @@ _draw_buffer(struct buffer *b, struct coords coords)
 	if (line == NULL)
 		return;
 
-	struct buffer_line *tail = buffer_tail(b);
 	struct buffer_line *head = buffer_head(b);
 
 	/* Find top line */
-	for (;;) {
-
-		split_buffer_cols(line, NULL, &text_w, col_total, b->pad);
-
-		row_count += buffer_line_rows(line, text_w);
+	buffer_i = buffer_rows_back(b, col_total, buffer_i, row_total, &row_count);
 
-		if (line == tail)
-			break;
-
-		if (row_count >= row_total)
-			break;
-
-		line = buffer_line(b, --buffer_i);
-	}
+	line = buffer_line(b, buffer_i);
 
 	/* Handle impartial top line print */
 	if (row_count > row_total) {
 
-		split_buffer_cols(line, &head_w, &text_w, col_total, b->pad);
+		buffer_line_split(line, &head_w, &text_w, col_total, b->pad);
 
 		_draw_buffer_line(
 			line,
@@ -377,7 +356,7 @@ _draw_buffer(struct buffer *b, struct coords coords)
 	/* Draw all remaining lines */
 	while (coords.r1 <= coords.rN) {
 
-		split_buffer_cols(line, &head_w, &text_w, col_total, b->pad);
+		buffer_line_split(line, &head_w, &text_w, col_total, b->pad);
 
 		_draw_buffer_line(
 			line,
@@ -584,10 +563,10 @@ _draw_status(struct channel *c)
 	/* TODO: channel modes, channel type_flag, servermodes */
 
 	/* server / private chat:
-	 * |-[usermodes]-(ping)---...|
+	 * |-[usermodes]-(ping)-(sendq)---...|
 	 *
 	 * channel:
-	 * |-[usermodes]-[chancount chantype chanmodes]/[priv]-(ping)---...|
+	 * |-[usermodes]-[chancount chantype chanmodes]/[priv]-(ping)-(sendq)---...|
 	 */
 
 	float sb;
@@ -669,6 +648,14 @@ _draw_status(struct channel *c)
 			goto print_status;
 	}
 
+	/* -(sendq) */
+	if (c->server && c->server->sendq.lines) {
+		ret = snprintf(status_buff + col, cols - col + 1,
+				HORIZONTAL_SEPARATOR "(sendq %u, %us)", c->server->sendq.lines, c->server->sendq.delay);
+		if (ret < 0 || (col += ret) >= cols)
+			goto print_status;
+	}
+
 	/* -(scrollback%) */
 	if ((sb = buffer_scrollback_status(&c->buffer))) {
 		ret = snprintf(status_buff + col, cols - col + 1,
@@ -784,30 +771,3 @@ _draw_fmt(char **ptr, size_t *buff_n, size_t *text_n, int txt, const char *fmt,
 
 	return 1;
 }
-
-void
-split_buffer_cols(
-	struct buffer_line *line,
-	unsigned int *head_w,
-	unsigned int *text_w,
-	unsigned int cols,
-	unsigned int pad)
-{
-	unsigned int _head_w = sizeof(" HH:MM   "VERTICAL_SEPARATOR" ");
-
-	if (BUFFER_PADDING)
-		_head_w += pad;
-	else
-		_head_w += line->from_len;
-
-	/* If header won't fit, split in half */
-	if (_head_w >= cols)
-		_head_w = cols / 2;
-
-	_head_w -= 1;
-
-	if (head_w)
-		*head_w = _head_w;
-	if (text_w)
-		*text_w = cols - _head_w + 1;
-}
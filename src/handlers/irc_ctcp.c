@@ -18,7 +18,7 @@
 
 #define sendf(S, ...) \
 	do { int ret; \
-	     if ((ret = io_sendf((S)->connection, __VA_ARGS__))) \
+	     if ((ret = io_sendf_bulk((S)->connection, __VA_ARGS__))) \
 	         failf((S), "Send fail: %s", io_err(ret)); \
 	} while (0)
 
@@ -29,7 +29,7 @@
 
 #define sendf(S, ...) \
 	do { int ret; \
-	     if ((ret = io_sendf((S)->connection, __VA_ARGS__))) \
+	     if ((ret = io_sendf_bulk((S)->connection, __VA_ARGS__))) \
 	         failf((S), "Send fail: %s", io_err(ret)); \
 	} while (0)
 
@@ -552,21 +552,8 @@ irc_recv_numeric(struct server *s, struct irc_message *m)
 	/* :server <code> <target> [args] */
 
 	char *targ;
-	int code = 0;
 	irc_recv_f handler = NULL;
 
-	for (const char *p = m->command; *p; p++) {
-
-		if (!isdigit(*p))
-			failf(s, "NUMERIC: invalid");
-
-		code *= 10;
-		code += *p - '0';
-
-		if (code > 999)
-			failf(s, "NUMERIC: out of range");
-	}
-
 	/* Message target is only used to establish s->nick when registering with a server */
 	if (!(irc_message_param(m, &targ))) {
 		io_dx(s->connection);
@@ -574,21 +561,21 @@ irc_recv_numeric(struct server *s, struct irc_message *m)
 	}
 
 	/* Message target should match s->nick or '*' if unregistered, otherwise out of sync */
-	if (strcmp(targ, s->nick) && strcmp(targ, "*") && code != 1) {
+	if (strcmp(targ, s->nick) && strcmp(targ, "*") && m->code != 1) {
 		io_dx(s->connection);
 		failf(s, "NUMERIC: target mismatched, nick is '%s', received '%s'", s->nick, targ);
 	}
 
-	if (ARR_ELEM(irc_numerics, code))
-		handler = irc_numerics[code];
+	if (m->code < ELEMS(irc_numerics))
+		handler = irc_numerics[m->code];
 
 	if (handler)
 		return (*handler)(s, m);
 
 	if (m->params)
-		failf(s, "Numeric type '%u' unknown: %s", code, m->params);
+		failf(s, "Numeric type '%u' unknown: %s", m->code, m->params);
 	else
-		failf(s, "Numeric type '%u' unknown", code);
+		failf(s, "Numeric type '%u' unknown", m->code);
 }
 
 static int
@@ -1,10 +1,11 @@
-#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <netdb.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,20 +13,45 @@
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <termios.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <poll.h>
+
+#if defined(__linux__) && !defined(IO_EVENTS_POLL)
+#define IO_EVENTS_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(IO_SCAN_SCALAR)
+#define IO_SCAN_X86
+#include <immintrin.h>
+#endif
+
 #include "config.h"
 #include "src/io.h"
+#include "utils/timer.h"
 #include "utils/utils.h"
 
 #define IO_RECV_SIZE 4096
 
+/* Maximum number of reads per connection per event loop iteration */
+#define IO_RECV_BATCH 16
+
 /* RFC 2812, section 2.3 */
 #ifndef IO_MESG_LEN
 #define IO_MESG_LEN 510
 #endif
 
+/* IRCv3 message-tags, maximum tags length including '@' and separating space */
+#ifndef IO_TAGS_LEN
+#define IO_TAGS_LEN 8191
+#endif
+
+#define IO_LINE_LEN (IO_TAGS_LEN + IO_MESG_LEN)
+
 #ifndef IO_PING_MIN
 #define IO_PING_MIN 150
 #elif (IO_PING_MIN < 0 || IO_PING_MIN > 86400)
@@ -62,20 +88,72 @@
 #error "IO_RECONNECT_BACKOFF_MAX: [0, 86400]"
 #endif
 
+#ifndef IO_RECONNECT_JITTER
+#define IO_RECONNECT_JITTER 50
+#elif (IO_RECONNECT_JITTER < 0 || IO_RECONNECT_JITTER > 100)
+#error "IO_RECONNECT_JITTER: [0, 100]"
+#endif
+
+#ifndef IO_RECONNECT_MAX
+#define IO_RECONNECT_MAX 4
+#elif (IO_RECONNECT_MAX < 0 || IO_RECONNECT_MAX > 1024)
+#error "IO_RECONNECT_MAX: [0, 1024]"
+#endif
+
+#ifndef IO_DNS_CACHE_TTL
+#define IO_DNS_CACHE_TTL 300
+#elif (IO_DNS_CACHE_TTL < 0 || IO_DNS_CACHE_TTL > 86400)
+#error "IO_DNS_CACHE_TTL: [0, 86400]"
+#endif
+
+#ifndef IO_SENDQ_HIGH
+#define IO_SENDQ_HIGH 8192
+#elif (IO_SENDQ_HIGH < 512 || IO_SENDQ_HIGH > 1048576)
+#error "IO_SENDQ_HIGH: [512, 1048576]"
+#endif
+
+#ifndef IO_SENDQ_MAX
+#define IO_SENDQ_MAX 65536
+#elif (IO_SENDQ_MAX < IO_SENDQ_HIGH || IO_SENDQ_MAX > 16777216)
+#error "IO_SENDQ_MAX: [IO_SENDQ_HIGH, 16777216]"
+#endif
+
+#ifndef IO_FLOOD_BURST
+#define IO_FLOOD_BURST 5
+#elif (IO_FLOOD_BURST < 0 || IO_FLOOD_BURST > 1024)
+#error "IO_FLOOD_BURST: [0, 1024]"
+#endif
+
+#ifndef IO_FLOOD_RATE
+#define IO_FLOOD_RATE 2000
+#elif (IO_FLOOD_RATE < 1 || IO_FLOOD_RATE > 60000)
+#error "IO_FLOOD_RATE: [1, 60000]"
+#endif
+
+/* Connection attempts racing, and milliseconds between starting
+ * attempts to successive addresses, RFC 8305, section 5 */
+#define IO_CX_MAX 4
+#define IO_CX_DELAY 250
+
+/* Maximum number of queued lines coalesced per writev() */
+#define IO_SEND_IOV 16
+
+/* Capture file header, followed by records of bytes received */
+#define IO_CAPTURE_MAGIC "rirc capture 1\n"
+
 #if EAGAIN == EWOULDBLOCK
 #define CHECK_BLOCK(X) ((X) == EAGAIN)
 #else
 #define CHECK_BLOCK(X) ((X) == EAGAIN || (X) == EWOULDBLOCK)
 #endif
 
-#define PT_CF(X) do { io_check_fatal((#X), (X)); } while (0)
-#define PT_LK(X) PT_CF(pthread_mutex_lock((X)))
-#define PT_UL(X) PT_CF(pthread_mutex_unlock((X)))
-#define PT_CB(...) \
-	do { PT_LK(&cb_mutex); \
-	     io_cb(__VA_ARGS__); \
-	     PT_UL(&cb_mutex); \
-	} while (0)
+/* Event loop readiness flags, independent of epoll/poll */
+#define IO_EV_IN  (1 << 0)
+#define IO_EV_OUT (1 << 1)
+#define IO_EV_ERR (1 << 2)
+
+/* Maximum number of ready events handled per event loop iteration */
+#define IO_EV_MAX 64
 
 enum io_err_t
 {
@@ -84,15 +162,54 @@ enum io_err_t
 	IO_ERR_CXNG,
 	IO_ERR_DXED,
 	IO_ERR_FMT,
+	IO_ERR_QUEUE,
 	IO_ERR_SEND,
 	IO_ERR_TRUNC,
 };
 
-struct io_lock
+struct io_line
+{
+	struct io_line *next;
+	uint64_t time; /* monotonic time queued */
+	size_t len;
+	char buf[];
+};
+
+struct io_lines
+{
+	struct io_line *head;
+	struct io_line *tail;
+	unsigned n;
+};
+
+struct io_capture_rec
+{
+	/* Capture record, in host byte order, followed by len bytes
+	 * as received from the socket of connection id */
+	uint64_t time; /* milliseconds since capture started */
+	uint32_t id;
+	uint32_t len;
+};
+
+struct io_dns
+{
+	/* Resolver request, owned by the resolver thread until its
+	 * result is written to the resolver pipe */
+	struct connection *c; /* requesting connection, NULL if cancelled */
+	struct addrinfo *res; /* resolved addresses, copied */
+	char *host;
+	char *port;
+	int err; /* getaddrinfo error */
+	int errnum;
+};
+
+struct io_dns_cache
 {
-	pthread_cond_t cnd;
-	pthread_mutex_t mtx;
-	volatile int predicate;
+	struct io_dns_cache *next;
+	struct addrinfo *res; /* resolved addresses, copied */
+	uint64_t expire;
+	char *host;
+	char *port;
 };
 
 struct connection
@@ -107,100 +224,190 @@ struct connection
 		IO_ST_CXNG, /* Socket connection in progress */
 		IO_ST_CXED, /* Socket connected */
 		IO_ST_PING, /* Socket connected, network state in question */
-	} st_c, /* current thread state */
-	  st_f; /* forced thread state */
+	} st_c; /* current connection state */
 	char ip[INET6_ADDRSTRLEN];
 	int soc;
+	struct addrinfo *ai_cur; /* next address to attempt */
+	struct addrinfo *ai_res; /* resolved addresses, copied */
+	struct io_dns *dns;      /* pending resolver request, or NULL */
 	struct {
-		size_t i;
-		char cl;
-		char buf[IO_MESG_LEN + 1]; /* callback message buffer */
-		char tmp[IO_RECV_SIZE];    /* socket recv buffer */
+		struct addrinfo *ai;
+		int soc;
+	} cx[IO_CX_MAX];  /* connection attempts in progress */
+	unsigned cx_n;
+	uint64_t cx_time; /* monotonic time connecting started */
+	unsigned cx_user : 1; /* connecting by io_cx */
+	unsigned cx_wait : 1; /* connecting queued by IO_RECONNECT_MAX */
+	struct {
+		size_t i;  /* length of the partial line at the start of the buffer */
+		char cl;   /* last byte received, for CRLF split across reads */
+		char *ext; /* buffer for partial lines longer than IO_MESG_LEN, or NULL */
+		char buf[IO_MESG_LEN + IO_RECV_SIZE]; /* partial line, then recv data */
 	} read;
-	struct io_lock lock;
+	struct {
+		struct io_lines out;  /* lines released by flood control, in send order */
+		struct io_lines prio; /* lines held by flood control, priority lane */
+		struct io_lines bulk; /* lines held by flood control, bulk lane */
+		size_t off;  /* bytes of out.head already sent */
+		size_t size; /* bytes queued, including sent bytes of out.head */
+		uint64_t flood;   /* flood control theoretical release time */
+		struct timer timer; /* flood control deadline for held lines */
+		unsigned high : 1; /* queue is backlogged, SEND_1 sent */
+	} send;
+	struct connection *next;
+	struct connection *prev;
+	struct timer timer; /* timed state transitions */
+	unsigned ev;      /* event loop flags registered for soc */
+	unsigned id;      /* capture stream id */
+	unsigned ping;
 	unsigned rx_backoff;
-	pthread_t pt_tid;
 };
 
-static const char* io_strerror(struct connection*, int);
-static enum io_state_t io_state_cxed(struct connection*);
-static enum io_state_t io_state_cxng(struct connection*);
-static enum io_state_t io_state_dxed(struct connection*);
-static enum io_state_t io_state_ping(struct connection*);
-static enum io_state_t io_state_rxng(struct connection*);
-static void io_check_fatal(const char*, int);
-static void io_lock_wait(struct io_lock*, struct timespec*);
-static void io_net_set_timeout(struct connection*, unsigned);
-static void io_recv(struct connection*, const char*, size_t);
+struct io_event
+{
+	struct connection *c; /* NULL for stdin, IO_EV_DNS for resolver results */
+	unsigned ev;
+};
+
+static const char* io_strerror(int);
+static void io_capture_fail(struct connection*);
+static void io_capture_write(struct connection*, const char*, size_t);
+static int io_dns_resolve(const char*, const char*, struct addrinfo**);
+static struct addrinfo* io_ai_copy(const struct addrinfo*);
+static struct addrinfo* io_ai_interleave(struct addrinfo*);
+static struct addrinfo* io_dns_cache_get(const char*, const char*);
+static void io_ai_free(struct addrinfo*);
+static void io_dns_cache_del(const char*, const char*);
+static void io_dns_cache_put(const char*, const char*, const struct addrinfo*);
+static void io_dns_cancel(struct connection*);
+static void io_dns_init(void);
+static void io_dns_recv(void);
+static void io_dns_start(struct connection*);
+static void* io_dns_thread(void*);
+static int io_ev_wait(struct io_event*, int);
+static int io_send_flush(struct connection*);
+static int io_send_sched(struct connection*, uint64_t);
+static int io_timeout(uint64_t);
+static void io_timer_add(struct timer*, uint64_t);
+static int io_vsendf(struct connection*, int, const char*, va_list);
+static struct io_line* io_lines_pop(struct io_lines*);
+static uint64_t io_time(void);
+static void io_ev_init(void);
+static void io_ev_cx(struct connection*, int);
+static void io_ev_set(struct connection*, unsigned);
+static void io_event_soc(struct connection*, unsigned);
+static void io_event_timeout(void*);
+static void io_lines_free(struct io_lines*);
+static void io_lines_push(struct io_lines*, struct io_line*);
+static void io_loop(void);
+static void io_net_connect(struct connection*, int);
+static void io_net_connected(struct connection*, unsigned);
+static void io_net_cx_close(struct connection*);
+static void io_net_cx_event(struct connection*);
+static void io_net_recv(struct connection*);
+static void io_net_send(struct connection*);
+static void io_read_inp(void);
+static void io_recv(struct connection*, size_t);
+static char* io_recv_buf(struct connection*);
+static void io_send_free(struct connection*);
+static void io_send_release(struct connection*, uint64_t);
+static void io_send_tick(void*);
+static unsigned io_send_delay(struct connection*, uint64_t);
+static uint64_t io_rand(void);
+static void io_cx_sched(void);
+static void io_cx_start(struct connection*);
 static void io_sig_init(void);
-static void io_soc_close(int*);
-static void io_soc_shutdown(int);
-static void io_state_force(struct connection*, enum io_state_t);
+static void io_soc_close(struct connection*);
+static void io_state_cxed(struct connection*);
+static void io_state_cxng(struct connection*);
+static void io_state_dxed(struct connection*);
+static void io_state_ping(struct connection*);
+static void io_state_rxng(struct connection*);
 static void io_tty_init(void);
 static void io_tty_term(void);
 static void io_tty_winsize(void);
-static void* io_thread(void*);
 static unsigned io_cols;
 static unsigned io_rows;
 
 static int io_running;
-static pthread_mutex_t cb_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct connection *connections;
+static struct timer_wheel io_timers;
+static struct io_dns_cache *io_dns_cache;
+static FILE *io_capture_fp;
+static uint64_t io_capture_time;
+static unsigned io_capture_id;
+static int io_dns_fds[2] = { -1, -1 }; /* resolver results pipe */
+
+/* Event loop source for resolver results, distinct from stdin (NULL) and sockets */
+static char io_dns_src;
+#define IO_EV_DNS ((struct connection *) (void *) &io_dns_src)
+
+/* Resolver function, replaceable in testing */
+static int (*io_dns_getaddrinfo)(const char*, const char*, const struct addrinfo*, struct addrinfo**) = getaddrinfo;
 static struct termios term;
 static volatile sig_atomic_t flag_sigwinch_cb; /* sigwinch callback */
 static volatile sig_atomic_t flag_tty_resized; /* sigwinch ws resize */
 
-static void
-io_check_fatal(const char *f, int ret)
-{
-	if (ret < 0)
-		fatal("%s: %s", f, strerror(ret));
-}
+#ifdef IO_EVENTS_EPOLL
+static int io_epfd = -1;
+#else
+static size_t io_pfds_n;
+static struct pollfd *io_pfds;
+static struct connection **io_pfds_c;
+#endif
+
+static size_t io_scan_init(const char*, size_t);
+static size_t io_scan_scalar(const char*, size_t);
+#ifdef IO_SCAN_X86
+static size_t io_scan_sse2(const char*, size_t);
+static size_t io_scan_avx2(const char*, size_t);
+#endif
+
+/* Length of the leading span of printable bytes, resolved on first use */
+static size_t (*io_scan)(const char*, size_t) = io_scan_init;
 
 static const char*
-io_strerror(struct connection *c, int errnum)
+io_strerror(int errnum)
 {
-	PT_CF(strerror_r(errnum, c->read.tmp, sizeof(c->read.tmp)));
-	return c->read.tmp;
-}
+	static char buf[128];
 
-static void
-io_soc_close(int *soc)
-{
-	if (*soc >= 0 && close(*soc) < 0) {
-		fatal("close: %s", strerror(errno));
-	}
-	*soc = -1;
+	if (strerror_r(errnum, buf, sizeof(buf)))
+		fatal("strerror_r: %s", strerror(errno));
+
+	return buf;
 }
 
-static void
-io_soc_shutdown(int soc)
+static uint64_t
+io_time(void)
 {
-	if (soc >= 0 && shutdown(soc, SHUT_RDWR) < 0 && errno != ENOTCONN) {
-		fatal("shutdown: %s", strerror(errno));
-	}
+	/* Monotonic time in milliseconds */
+
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+		fatal("clock_gettime: %s", strerror(errno));
+
+	return ((uint64_t) ts.tv_sec * 1000) + ((uint64_t) ts.tv_nsec / 1000000);
 }
 
 static void
-io_lock_wait(struct io_lock *lock, struct timespec *timeout)
+io_soc_close(struct connection *c)
 {
-	PT_LK(&(lock->mtx));
+	io_ev_set(c, 0);
+	io_send_free(c);
 
-	int ret = 0;
-
-	while (lock->predicate == 0 && ret == 0) {
-		if (timeout) {
-			ret = pthread_cond_timedwait(&(lock->cnd), &(lock->mtx), timeout);
-		} else {
-			ret = pthread_cond_wait(&(lock->cnd), &(lock->mtx));
-		}
-	}
+	timer_del(&io_timers, &(c->timer));
 
-	if (ret && (timeout == NULL || ret != ETIMEDOUT))
-		fatal("io_lock_wait: %s", strerror(ret));
+	free(c->read.ext);
+	c->read.ext = NULL;
+	c->read.cl = 0;
+	c->read.i = 0;
 
-	lock->predicate = 0;
+	if (c->soc >= 0 && close(c->soc) < 0) {
+		fatal("close: %s", strerror(errno));
+	}
 
-	PT_UL(&(lock->mtx));
+	c->soc = -1;
 }
 
 struct connection*
@@ -214,11 +421,22 @@ connection(const void *obj, const char *host, const char *port)
 	c->obj = obj;
 	c->host = strdup(host);
 	c->port = strdup(port);
+	c->soc = -1;
 	c->st_c = IO_ST_DXED;
-	c->st_f = IO_ST_INVALID;
-	PT_CF(pthread_cond_init(&(c->lock.cnd), NULL));
-	PT_CF(pthread_mutex_init(&(c->lock.mtx), NULL));
-	PT_CF(pthread_create(&c->pt_tid, NULL, io_thread, c));
+	c->id = ++io_capture_id;
+	c->timer.f = io_event_timeout;
+	c->timer.arg = c;
+	c->send.timer.f = io_send_tick;
+	c->send.timer.arg = c;
+
+	if (connections == NULL) {
+		connections = c->next = c->prev = c;
+	} else {
+		c->next = connections;
+		c->prev = connections->prev;
+		connections->prev->next = c;
+		connections->prev = c;
+	}
 
 	return c;
 }
@@ -226,17 +444,45 @@ connection(const void *obj, const char *host, const char *port)
 int
 io_sendf(struct connection *c, const char *fmt, ...)
 {
+	int ret;
+	va_list ap;
+
+	va_start(ap, fmt);
+	ret = io_vsendf(c, 1, fmt, ap);
+	va_end(ap);
+
+	return ret;
+}
+
+int
+io_sendf_bulk(struct connection *c, const char *fmt, ...)
+{
+	int ret;
+	va_list ap;
+
+	va_start(ap, fmt);
+	ret = io_vsendf(c, 0, fmt, ap);
+	va_end(ap);
+
+	return ret;
+}
+
+static int
+io_vsendf(struct connection *c, int prio, const char *fmt, va_list ap)
+{
+	/* Queue a formatted line on the priority or bulk lane, writing as
+	 * much as flood control and the socket allow without blocking */
+
 	char sendbuf[IO_MESG_LEN + 2];
 	int ret;
 	size_t len;
-	va_list ap;
+	struct io_line *line;
+	uint64_t now;
 
 	if (c->st_c != IO_ST_CXED && c->st_c != IO_ST_PING)
 		return IO_ERR_DXED;
 
-	va_start(ap, fmt);
 	ret = vsnprintf(sendbuf, sizeof(sendbuf) - 2, fmt, ap);
-	va_end(ap);
 
 	if (ret <= 0)
 		return IO_ERR_FMT;
@@ -246,375 +492,1518 @@ io_sendf(struct connection *c, const char *fmt, ...)
 	if (len >= sizeof(sendbuf) - 2)
 		return IO_ERR_TRUNC;
 
+	if (c->send.size + len + 2 > IO_SENDQ_MAX)
+		return IO_ERR_QUEUE;
+
 	debug("send: (%zu) %s", len, sendbuf);
 
+	/* Keepalive traffic is never delayed behind bulk traffic */
+	if (!strncmp(sendbuf, "PING ", 5) || !strncmp(sendbuf, "PONG ", 5))
+		prio = 1;
+
 	sendbuf[len++] = '\r';
 	sendbuf[len++] = '\n';
 
-	if (send(c->soc, sendbuf, len, 0) < 0)
-		return IO_ERR_SEND;
-
-	return IO_ERR_NONE;
-}
+	if ((line = malloc(sizeof(*line) + len)) == NULL)
+		fatal("malloc: %s", strerror(errno));
 
-int
-io_cx(struct connection *c)
-{
-	/* Force a socket thread into IO_ST_CXNG state */
+	now = io_time();
 
-	enum io_err_t err = IO_ERR_NONE;
+	memcpy(line->buf, sendbuf, len);
+	line->len = len;
+	line->time = now;
 
-	PT_LK(&(c->lock.mtx));
+	/* QUIT is released without flood control, to be written before closing */
+	if (!strncmp(sendbuf, "QUIT ", 5))
+		io_lines_push(&(c->send.out), line);
+	else
+		io_lines_push((prio ? &(c->send.prio) : &(c->send.bulk)), line);
 
-	switch (c->st_c) {
-		case IO_ST_CXNG: err = IO_ERR_CXNG; break;
-		case IO_ST_CXED: err = IO_ERR_CXED; break;
-		case IO_ST_PING: err = IO_ERR_CXED; break;
-		default:
-			io_state_force(c, IO_ST_CXNG);
-	}
+	c->send.size += len;
 
-	PT_UL(&(c->lock.mtx));
+	if (io_send_sched(c, now) < 0)
+		return IO_ERR_SEND;
 
-	return err;
+	return IO_ERR_NONE;
 }
 
-int
-io_dx(struct connection *c)
+static void
+io_lines_push(struct io_lines *l, struct io_line *line)
 {
-	/* Force a socket thread into IO_ST_DXED state */
+	line->next = NULL;
 
-	enum io_err_t err = IO_ERR_NONE;
+	if (l->tail)
+		l->tail->next = line;
+	else
+		l->head = line;
 
-	PT_LK(&(c->lock.mtx));
+	l->tail = line;
+	l->n++;
+}
 
-	switch (c->st_c) {
-		case IO_ST_DXED: err = IO_ERR_DXED; break;
-		default:
-			io_state_force(c, IO_ST_DXED);
-	}
+static struct io_line*
+io_lines_pop(struct io_lines *l)
+{
+	struct io_line *line;
 
-	PT_UL(&(c->lock.mtx));
+	if ((line = l->head) == NULL)
+		return NULL;
 
-	return err;
-}
+	if ((l->head = line->next) == NULL)
+		l->tail = NULL;
 
-void
-io_free(struct connection *c)
-{
-	pthread_t pt_tid = c->pt_tid;
+	l->n--;
 
-	PT_CF(pthread_cancel(pt_tid));
-	PT_CF(pthread_join(pt_tid, NULL));
-	PT_CF(pthread_cond_destroy(&(c->lock.cnd)));
-	PT_CF(pthread_mutex_destroy(&(c->lock.mtx)));
-	io_soc_close(&(c->soc));
-	free((void*)c->host);
-	free((void*)c->port);
-	free(c);
+	return line;
 }
 
 static void
-io_state_force(struct connection *c, enum io_state_t st_f)
+io_lines_free(struct io_lines *l)
 {
-	/* Wake and force a connection thread's state */
-
-	c->st_f = st_f;
+	struct io_line *line;
 
-	switch (c->st_c) {
-		case IO_ST_DXED: /* io_lock_wait() */
-		case IO_ST_RXNG: /* io_lock_wait() */
-			c->lock.predicate = 1;
-			PT_CF(pthread_cond_signal(&(c->lock.cnd)));
-			break;
-		case IO_ST_CXNG: /* connect() */
-		case IO_ST_CXED: /* recv() */
-		case IO_ST_PING: /* recv() */
-			io_soc_shutdown(c->soc);
-			break;
-		default:
-			fatal("Unknown net state: %d", c->st_c);
-	}
+	while ((line = io_lines_pop(l)))
+		free(line);
 }
 
-static enum io_state_t
-io_state_dxed(struct connection *c)
+static void
+io_send_release(struct connection *c, uint64_t now)
 {
-	io_lock_wait(&c->lock, NULL);
+	/* Move held lines to the output queue, priority lane first, at the
+	 * rate permitted by flood control. Modelled on the RFC 1459 server
+	 * side flood control: each line advances a timer by IO_FLOOD_RATE,
+	 * and lines are held while the timer is more than IO_FLOOD_BURST
+	 * lines ahead of the current time */
 
-	return IO_ST_CXNG;
-}
+	struct io_line *line;
+	struct io_lines *l;
 
-static enum io_state_t
-io_state_rxng(struct connection *c)
-{
-	struct timespec ts;
+	for (;;) {
 
-	if (c->rx_backoff == 0) {
-		c->rx_backoff = IO_RECONNECT_BACKOFF_BASE;
-	} else {
-		c->rx_backoff = MIN(
-			IO_RECONNECT_BACKOFF_FACTOR * c->rx_backoff,
-			IO_RECONNECT_BACKOFF_MAX
-		);
-	}
+		if (c->send.prio.head)
+			l = &(c->send.prio);
+		else if (c->send.bulk.head)
+			l = &(c->send.bulk);
+		else
+			break;
 
-	PT_CB(IO_CB_INFO, c->obj, "Attemping reconnect in %02u:%02u",
-		(c->rx_backoff / 60),
-		(c->rx_backoff % 60));
+		if (IO_FLOOD_BURST && c->send.flood > now + (uint64_t) (IO_FLOOD_BURST - 1) * IO_FLOOD_RATE)
+			break;
 
-	if (clock_gettime(CLOCK_REALTIME, &ts) < 0)
-		fatal("clock_gettime: %s", strerror(errno));
+		line = io_lines_pop(l);
 
-	ts.tv_sec += c->rx_backoff;
+		io_lines_push(&(c->send.out), line);
 
-	io_lock_wait(&c->lock, &ts);
+		c->send.flood = MAX(c->send.flood, now) + IO_FLOOD_RATE;
+	}
 
-	return IO_ST_CXNG;
+	if (c->send.prio.head || c->send.bulk.head)
+		io_timer_add(&(c->send.timer), c->send.flood - (uint64_t) (IO_FLOOD_BURST - 1) * IO_FLOOD_RATE);
+	else
+		timer_del(&io_timers, &(c->send.timer));
 }
 
-static enum io_state_t
-io_state_cxng(struct connection *c)
+static int
+io_send_sched(struct connection *c, uint64_t now)
 {
-	/* TODO: handle shutdown() on socket at all points, will fatal for now */
-	/* TODO: mutex should protect access to c->soc, else race condition
-	 *       when the main thread tries to shutdown() for cancel */
-	/* TODO: how to cancel getaddrinfo/getnameinfo? */
-	/* FIXME: addrinfo leak if canceled during connection */
-
-	int ret, soc = -1;
-
-	struct addrinfo *p, *res, hints = {
-		.ai_family   = AF_UNSPEC,
-		.ai_flags    = AI_PASSIVE,
-		.ai_protocol = IPPROTO_TCP,
-		.ai_socktype = SOCK_STREAM
-	};
-
-	PT_CB(IO_CB_INFO, c->obj, "Connecting to %s:%s ...", c->host, c->port);
-
-	if ((ret = getaddrinfo(c->host, c->port, &hints, &res))) {
-
-		if (ret == EAI_SYSTEM)
-			PT_CB(IO_CB_ERR, c->obj, "Error resolving host: %s", io_strerror(c, errno));
-		else
-			PT_CB(IO_CB_ERR, c->obj, "Error resolving host: %s", gai_strerror(ret));
+	/* Release held lines, write as much of the output queue as the
+	 * socket accepts and update backlog state. Returns -1 on socket error */
 
-		return IO_ST_RXNG;
-	}
+	unsigned lines;
 
-	for (p = res; p != NULL; p = p->ai_next) {
+	io_send_release(c, now);
 
-		if ((soc = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0)
-			continue;
+	if (io_send_flush(c) < 0)
+		return -1;
 
-		if (connect(soc, p->ai_addr, p->ai_addrlen) == 0)
-			break;
+	io_ev_set(c, (c->send.out.head ? (IO_EV_IN | IO_EV_OUT) : IO_EV_IN));
 
-		io_soc_close(&soc);
-	}
+	lines = c->send.out.n + c->send.prio.n + c->send.bulk.n;
 
-	if (p == NULL) {
-		PT_CB(IO_CB_ERR, c->obj, "Error connecting: %s", io_strerror(c, errno));
-		freeaddrinfo(res);
-		return IO_ST_RXNG;
+	if (lines == 0 && c->send.high) {
+		c->send.high = 0;
+		io_cb(IO_CB_SEND_0, c->obj, 0U, 0U);
 	}
 
-	c->soc = soc;
-
-	if ((ret = getnameinfo(p->ai_addr, p->ai_addrlen, c->ip, sizeof(c->ip), NULL, 0, NI_NUMERICHOST))) {
-
-		if (ret == EAI_SYSTEM)
-			PT_CB(IO_CB_ERR, c->obj, "Error resolving numeric host: %s", io_strerror(c, errno));
-		else
-			PT_CB(IO_CB_ERR, c->obj, "Error resolving numeric host: %s", gai_strerror(ret));
-
-		*c->ip = 0;
+	if (lines && !c->send.high && (timer_pending(&(c->send.timer)) || c->send.size > IO_SENDQ_HIGH)) {
+		c->send.high = 1;
+		io_cb(IO_CB_SEND_1, c->obj, lines, io_send_delay(c, now));
 	}
 
-	freeaddrinfo(res);
-	return IO_ST_CXED;
+	return 0;
 }
 
-static enum io_state_t
-io_state_cxed(struct connection *c)
+static void
+io_send_tick(void *arg)
 {
-	io_net_set_timeout(c, IO_PING_MIN);
-	ssize_t ret;
-
-	while ((ret = recv(c->soc, c->read.tmp, sizeof(c->read.tmp), 0)) > 0)
-		io_recv(c, c->read.tmp, (size_t) ret);
-
-	if (CHECK_BLOCK(errno)) {
-		return IO_ST_PING;
-	}
-
-	// FIXME:
-	// EINTR when coming back from sleep?
+	/* Flood control deadline, release held lines */
 
-	if (ret == 0) {
-		PT_CB(IO_CB_DXED, c->obj, "connection closed");
-	} else if (errno == EPIPE || errno == ECONNRESET) {
-		PT_CB(IO_CB_DXED, c->obj, "connection closed by peer");
-	} else {
-		PT_CB(IO_CB_DXED, c->obj, "recv error: %s", io_strerror(c, errno));
-	}
+	struct connection *c = arg;
 
-	io_soc_close(&(c->soc));
+	io_net_send(c);
 
-	return (ret == 0 ? IO_ST_DXED : IO_ST_CXNG);
+	if (c->send.high)
+		io_cb(IO_CB_SEND_N, c->obj,
+			c->send.out.n + c->send.prio.n + c->send.bulk.n,
+			io_send_delay(c, io_time()));
 }
 
-static enum io_state_t
-io_state_ping(struct connection *c)
+static unsigned
+io_send_delay(struct connection *c, uint64_t now)
 {
-	io_net_set_timeout(c, IO_PING_REFRESH);
-	ssize_t ret;
-	unsigned ping = IO_PING_MIN;
-
-	for (;;) {
+	/* Seconds since the oldest queued line was sent with io_sendf */
 
-		if ((ret = recv(c->soc, c->read.tmp, sizeof(c->read.tmp), 0)) > 0) {
-			io_recv(c, c->read.tmp, (size_t) ret);
-			return IO_ST_CXED;
-		}
+	uint64_t t = now;
 
-		if (ret == 0) {
-			PT_CB(IO_CB_DXED, c->obj, "connection closed");
-		} else if (CHECK_BLOCK(errno)) {
-			if ((ping += IO_PING_REFRESH) < IO_PING_MAX) {
-				PT_CB(IO_CB_PING_N, c->obj, ping);
-				continue;
-			}
-			PT_CB(IO_CB_DXED, c->obj, "connection timeout (%u)", ping);
-		} else {
-			PT_CB(IO_CB_DXED, c->obj, "recv error: %s", io_strerror(c, errno));
-		}
+	if (c->send.out.head)
+		t = MIN(t, c->send.out.head->time);
 
-		break;
-	}
+	if (c->send.prio.head)
+		t = MIN(t, c->send.prio.head->time);
 
-	io_soc_close(&(c->soc));
+	if (c->send.bulk.head)
+		t = MIN(t, c->send.bulk.head->time);
 
-	return (ret == 0 ? IO_ST_DXED : IO_ST_CXNG);
+	return (unsigned) ((now - t) / 1000);
 }
 
-static void*
-io_thread(void *arg)
+static int
+io_send_flush(struct connection *c)
 {
-	struct connection *c = arg;
+	/* Write released lines, coalesced, until the output queue is
+	 * empty or the socket would block. Returns -1 on socket error */
 
-	sigset_t sigset;
-	PT_CF(sigfillset(&sigset));
-	PT_CF(pthread_sigmask(SIG_BLOCK, &sigset, NULL));
+	struct iovec iov[IO_SEND_IOV];
+	struct io_line *line;
+	ssize_t ret;
+	size_t n;
 
-	for (;;) {
+	while (c->send.out.head) {
 
-		enum io_state_t st_f, /* transition state from */
-		                st_t; /* transition state to */
+		line = c->send.out.head;
 
-		enum io_state_t (*st_fn)(struct connection*);
+		iov[0].iov_base = line->buf + c->send.off;
+		iov[0].iov_len = line->len - c->send.off;
 
-		switch (c->st_c) {
-			case IO_ST_DXED: st_fn = io_state_dxed; break;
-			case IO_ST_CXNG: st_fn = io_state_cxng; break;
-			case IO_ST_RXNG: st_fn = io_state_rxng; break;
-			case IO_ST_CXED: st_fn = io_state_cxed; break;
-			case IO_ST_PING: st_fn = io_state_ping; break;
-			default:
-				fatal("invalid state: %d", c->st_c);
+		for (n = 1, line = line->next; line && n < IO_SEND_IOV; n++, line = line->next) {
+			iov[n].iov_base = line->buf;
+			iov[n].iov_len = line->len;
 		}
 
-		st_f = c->st_c;
-		st_t = st_fn(c);
+		if ((ret = writev(c->soc, iov, (int) n)) < 0) {
 
-		PT_LK(&(c->lock.mtx));
+			if (CHECK_BLOCK(errno) || errno == EINTR)
+				return 0;
 
-		if (c->st_f != IO_ST_INVALID) {
-			c->st_c = c->st_f;
-			c->st_f = IO_ST_INVALID;
-		} else {
-			c->st_c = st_t;
+			return -1;
 		}
 
-		PT_UL(&(c->lock.mtx));
-
-		if (st_f == IO_ST_PING && st_t == IO_ST_CXED)
-			PT_CB(IO_CB_PING_0, c->obj, 0);
-
-		if (st_f == IO_ST_CXED && st_t == IO_ST_PING)
-			PT_CB(IO_CB_PING_1, c->obj, IO_PING_MIN);
+		/* Release fully written lines, resume partial writes on next flush */
+		for (size_t sent = (size_t) ret + c->send.off; (line = c->send.out.head);) {
 
-		if (st_f == IO_ST_CXNG && st_t == IO_ST_CXED)
-			PT_CB(IO_CB_CXED, c->obj, "Connected to %s [%s]", c->host, c->ip);
+			if (sent < line->len) {
+				c->send.off = sent;
+				break;
+			}
 
-		if (st_t == IO_ST_DXED || (st_f == IO_ST_CXNG && st_t == IO_ST_CXED))
-			c->rx_backoff = 0;
+			sent -= line->len;
+			c->send.size -= line->len;
+			c->send.off = 0;
+			free(io_lines_pop(&(c->send.out)));
+		}
 	}
 
-	return NULL;
+	return 0;
 }
 
 static void
-io_recv(struct connection *c, const char *buf, size_t n)
+io_send_free(struct connection *c)
 {
-	size_t ci = c->read.i;
+	/* Discard the send queue, clearing its backlog state */
 
-	for (size_t i = 0; i < n; i++) {
+	if (c->send.high)
+		io_cb(IO_CB_SEND_0, c->obj, 0U, 0U);
 
-		char cc = buf[i];
+	io_lines_free(&(c->send.out));
+	io_lines_free(&(c->send.prio));
+	io_lines_free(&(c->send.bulk));
 
-		if (ci && cc == '\n' && ((i && buf[i - 1] == '\r') || (!i && c->read.cl == '\r'))) {
+	c->send.flood = 0;
+	c->send.high = 0;
+	c->send.off = 0;
+	c->send.size = 0;
 
-			c->read.buf[ci] = 0;
+	timer_del(&io_timers, &(c->send.timer));
+}
 
-			debug(" recv: (%zu) %s", ci, c->read.buf);
+int
+io_cx(struct connection *c)
+{
+	/* Schedule a connection attempt from the event loop */
 
-			PT_LK(&cb_mutex);
-			io_cb_read_soc(c->read.buf, ci, c->obj);
-			PT_UL(&cb_mutex);
+	enum io_err_t err = IO_ERR_NONE;
 
-			ci = 0;
-		} else if (ci < IO_MESG_LEN && (isprint(cc) || cc == 0x01)) {
-			c->read.buf[ci++] = cc;
-		}
+	switch (c->st_c) {
+		case IO_ST_CXNG: err = IO_ERR_CXNG; break;
+		case IO_ST_CXED: err = IO_ERR_CXED; break;
+		case IO_ST_PING: err = IO_ERR_CXED; break;
+		default:
+			c->st_c = IO_ST_CXNG;
+			c->cx_user = 1;
+			io_timer_add(&(c->timer), io_time());
 	}
 
-	c->read.cl = buf[n - 1];
-	c->read.i = ci;
+	return err;
 }
 
-static void
-io_net_set_timeout(struct connection *c, unsigned timeout)
+int
+io_dx(struct connection *c)
 {
-	struct timeval tv = {
-		.tv_sec = timeout
-	};
+	/* Close a connection and enter IO_ST_DXED state */
 
-	if (setsockopt(c->soc, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
-		fatal("setsockopt: %s", strerror(errno));
-}
+	enum io_err_t err = IO_ERR_NONE;
 
-static void
-sigaction_sigwinch(int sig)
-{
-	UNUSED(sig);
+	switch (c->st_c) {
+		case IO_ST_DXED: err = IO_ERR_DXED; break;
+		case IO_ST_CXED:
+		case IO_ST_PING:
+			/* Write lines released, e.g. QUIT, before closing */
+			if (io_send_flush(c) < 0)
+				debug("send: %s", strerror(errno));
+			io_cb(IO_CB_DXED, c->obj, "connection closed");
+			/* FALLTHROUGH */
+		default:
+			io_state_dxed(c);
+	}
 
-	flag_sigwinch_cb = 1;
-	flag_tty_resized = 0;
+	return err;
 }
 
-static void
-io_sig_init(void)
+void
+io_free(struct connection *c)
 {
-	struct sigaction sa;
+	io_soc_close(c);
+	io_net_cx_close(c);
+	io_dns_cancel(c);
+	io_ai_free(c->ai_res);
 
-	sa.sa_handler = sigaction_sigwinch;
-	sa.sa_flags = 0;
-	sigemptyset(&sa.sa_mask);
+	if (c->next == c) {
+		connections = NULL;
+	} else {
+		c->next->prev = c->prev;
+		c->prev->next = c->next;
+		if (connections == c)
+			connections = c->next;
+	}
+
+	free((void*)c->host);
+	free((void*)c->port);
+	free(c);
+
+	io_cx_sched();
+}
+
+static void
+io_state_dxed(struct connection *c)
+{
+	io_soc_close(c);
+	io_net_cx_close(c);
+	io_dns_cancel(c);
+	io_ai_free(c->ai_res);
+
+	c->ai_cur = NULL;
+	c->ai_res = NULL;
+	c->cx_user = 0;
+	c->cx_wait = 0;
+	c->rx_backoff = 0;
+	c->st_c = IO_ST_DXED;
+	timer_del(&io_timers, &(c->timer));
+
+	io_cx_sched();
+}
+
+static void
+io_state_rxng(struct connection *c)
+{
+	/* Schedule a reconnect after the backoff delay, less a random jitter
+	 * of up to IO_RECONNECT_JITTER percent of the delay */
+
+	uint64_t delay;
+
+	if (c->rx_backoff == 0) {
+		c->rx_backoff = IO_RECONNECT_BACKOFF_BASE;
+	} else {
+		c->rx_backoff = MIN(
+			IO_RECONNECT_BACKOFF_FACTOR * c->rx_backoff,
+			IO_RECONNECT_BACKOFF_MAX
+		);
+	}
+
+	delay = (uint64_t) c->rx_backoff * 1000;
+	delay -= io_rand() % (delay * IO_RECONNECT_JITTER / 100 + 1);
+
+	io_cb(IO_CB_INFO, c->obj, "Attemping reconnect in %02u:%02u",
+		(unsigned) ((delay + 999) / 1000 / 60),
+		(unsigned) ((delay + 999) / 1000 % 60));
+
+	c->st_c = IO_ST_RXNG;
+	io_timer_add(&(c->timer), io_time() + delay);
+
+	io_cx_sched();
+}
+
+static void
+io_cx_start(struct connection *c)
+{
+	/* Start connecting, or queue the connection while IO_RECONNECT_MAX
+	 * connections are resolving or connecting */
+
+	struct connection *p = connections;
+	unsigned n = 0;
+
+	if (IO_RECONNECT_MAX && p) {
+		do {
+			if (p != c && p->st_c == IO_ST_CXNG && (p->dns || p->ai_res))
+				n++;
+		} while ((p = p->next) != connections);
+	}
+
+	if (IO_RECONNECT_MAX && n >= IO_RECONNECT_MAX) {
+
+		if (!c->cx_wait)
+			io_cb(IO_CB_INFO, c->obj, "Connection queued, %u connections in progress", n);
+
+		if (c->st_c != IO_ST_CXNG)
+			c->st_c = IO_ST_RXNG;
+
+		c->cx_wait = 1;
+		timer_del(&io_timers, &(c->timer));
+		return;
+	}
+
+	c->cx_user = 0;
+	c->cx_wait = 0;
+
+	io_state_cxng(c);
+}
+
+static void
+io_cx_sched(void)
+{
+	/* Schedule the next queued connection, if any, for when a connection
+	 * leaves the connecting state. Connections queued by io_cx are taken
+	 * first, then in the order connections were created */
+
+	struct connection *c, *next = NULL;
+
+	if ((c = connections) == NULL)
+		return;
+
+	do {
+		if (c->cx_wait && !timer_pending(&(c->timer)) && (!next || (c->cx_user && !next->cx_user)))
+			next = c;
+	} while ((c = c->next) != connections);
+
+	if (next)
+		io_timer_add(&(next->timer), io_time());
+}
+
+static uint64_t
+io_rand(void)
+{
+	/* xorshift64*, seeded from the clock and process id */
+
+	static uint64_t x;
+
+	if (x == 0)
+		x = (io_time() << 16) ^ (uint64_t) getpid() ^ 0x9E3779B97F4A7C15ULL;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+static void
+io_state_cxng(struct connection *c)
+{
+	c->st_c = IO_ST_CXNG;
+	timer_del(&io_timers, &(c->timer));
+	c->cx_time = io_time();
+
+	io_cb(IO_CB_INFO, c->obj, "Connecting to %s:%s ...", c->host, c->port);
+
+	if ((c->ai_res = io_dns_cache_get(c->host, c->port)) == NULL) {
+		io_dns_start(c);
+		return;
+	}
+
+	c->ai_cur = c->ai_res;
+
+	io_net_connect(c, 0);
+}
+
+static void
+io_state_cxed(struct connection *c)
+{
+	/* Enter connected state from connecting, or a ping timeout */
+
+	enum io_state_t st_f = c->st_c;
+
+	c->st_c = IO_ST_CXED;
+	if (IO_PING_MIN)
+		io_timer_add(&(c->timer), io_time() + IO_PING_MIN * 1000);
+	else
+		timer_del(&io_timers, &(c->timer));
+	c->ping = 0;
+
+	if (st_f == IO_ST_PING)
+		io_cb(IO_CB_PING_0, c->obj, 0);
+
+	if (st_f == IO_ST_CXNG) {
+		c->rx_backoff = 0;
+		io_cx_sched();
+		io_cb(IO_CB_CXED, c->obj, "Connected to %s [%s] in %ums",
+			c->host,
+			c->ip,
+			(unsigned) MIN(io_time() - c->cx_time, UINT_MAX));
+	}
+}
+
+static void
+io_state_ping(struct connection *c)
+{
+	if (c->st_c == IO_ST_CXED) {
+		c->st_c = IO_ST_PING;
+		c->ping = IO_PING_MIN;
+		io_cb(IO_CB_PING_1, c->obj, c->ping);
+	} else {
+		c->ping += IO_PING_REFRESH;
+
+		if (IO_PING_MAX && c->ping >= IO_PING_MAX) {
+			io_cb(IO_CB_DXED, c->obj, "connection timeout (%u)", c->ping);
+			io_soc_close(c);
+			io_cx_start(c);
+			return;
+		}
+
+		io_cb(IO_CB_PING_N, c->obj, c->ping);
+	}
+
+	if (IO_PING_REFRESH)
+		io_timer_add(&(c->timer), io_time() + IO_PING_REFRESH * 1000);
+	else
+		timer_del(&io_timers, &(c->timer));
+}
+
+static void
+io_dns_init(void)
+{
+	if (pipe(io_dns_fds) < 0)
+		fatal("pipe: %s", strerror(errno));
+
+	for (int i = 0; i < 2; i++) {
+		if (fcntl(io_dns_fds[i], F_SETFD, FD_CLOEXEC) < 0)
+			fatal("fcntl: %s", strerror(errno));
+	}
+
+	if (fcntl(io_dns_fds[0], F_SETFL, fcntl(io_dns_fds[0], F_GETFL) | O_NONBLOCK) < 0)
+		fatal("fcntl: %s", strerror(errno));
+}
+
+static void
+io_dns_start(struct connection *c)
+{
+	/* Resolve a connection's host on a detached thread, the result
+	 * is handled by the event loop when written to the resolver pipe */
+
+	int ret;
+	pthread_t tid;
+	pthread_attr_t attr;
+	sigset_t set, oset;
+	struct io_dns *dns;
+
+	if (io_dns_fds[0] < 0)
+		io_dns_init();
+
+	if ((dns = calloc(1, sizeof(*dns))) == NULL)
+		fatal("calloc: %s", strerror(errno));
+
+	if ((dns->host = strdup(c->host)) == NULL || (dns->port = strdup(c->port)) == NULL)
+		fatal("strdup: %s", strerror(errno));
+
+	dns->c = c;
+
+	/* Signals are handled by the event loop thread only */
+	sigfillset(&set);
+
+	if ((ret = pthread_sigmask(SIG_SETMASK, &set, &oset)))
+		fatal("pthread_sigmask: %s", strerror(ret));
+
+	if ((ret = pthread_attr_init(&attr)))
+		fatal("pthread_attr_init: %s", strerror(ret));
+
+	if ((ret = pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)))
+		fatal("pthread_attr_setdetachstate: %s", strerror(ret));
+
+	ret = pthread_create(&tid, &attr, io_dns_thread, dns);
+
+	pthread_attr_destroy(&attr);
+	pthread_sigmask(SIG_SETMASK, &oset, NULL);
+
+	if (ret) {
+		io_cb(IO_CB_ERR, c->obj, "Error resolving host: %s", io_strerror(ret));
+		free(dns->host);
+		free(dns->port);
+		free(dns);
+		io_state_rxng(c);
+		return;
+	}
+
+	c->dns = dns;
+}
+
+static void*
+io_dns_thread(void *arg)
+{
+	struct io_dns *dns = arg;
+
+	if ((dns->err = io_dns_resolve(dns->host, dns->port, &(dns->res))) == EAI_SYSTEM)
+		dns->errnum = errno;
+
+	if (write(io_dns_fds[1], &dns, sizeof(dns)) != sizeof(dns))
+		fatal("write: %s", strerror(errno));
+
+	return NULL;
+}
+
+static int
+io_dns_resolve(const char *host, const char *port, struct addrinfo **res)
+{
+	int ret;
+	struct addrinfo *ai;
+
+	struct addrinfo hints = {
+		.ai_family   = AF_UNSPEC,
+		.ai_flags    = AI_PASSIVE,
+		.ai_protocol = IPPROTO_TCP,
+		.ai_socktype = SOCK_STREAM
+	};
+
+	if ((ret = (*io_dns_getaddrinfo)(host, port, &hints, &ai)))
+		return ret;
+
+	*res = io_ai_interleave(io_ai_copy(ai));
+
+	freeaddrinfo(ai);
+
+	return 0;
+}
+
+static void
+io_dns_recv(void)
+{
+	/* Handle results written to the resolver pipe */
+
+	struct connection *c;
+	struct io_dns *dns;
+	ssize_t ret;
+
+	while ((ret = read(io_dns_fds[0], &dns, sizeof(dns))) == sizeof(dns)) {
+
+		if ((c = dns->c) == NULL) {
+			io_ai_free(dns->res);
+		} else if (dns->err) {
+			c->dns = NULL;
+			if (dns->err == EAI_SYSTEM)
+				io_cb(IO_CB_ERR, c->obj, "Error resolving host: %s", io_strerror(dns->errnum));
+			else
+				io_cb(IO_CB_ERR, c->obj, "Error resolving host: %s", gai_strerror(dns->err));
+			io_state_rxng(c);
+		} else {
+			c->dns = NULL;
+			c->ai_cur = c->ai_res = dns->res;
+			io_dns_cache_put(c->host, c->port, dns->res);
+			io_net_connect(c, 0);
+		}
+
+		free(dns->host);
+		free(dns->port);
+		free(dns);
+	}
+
+	if (ret < 0 && !CHECK_BLOCK(errno) && errno != EINTR)
+		fatal("read: %s", strerror(errno));
+}
+
+static void
+io_dns_cancel(struct connection *c)
+{
+	/* Cancel a pending resolver request, freed once its result is read */
+
+	if (c->dns) {
+		c->dns->c = NULL;
+		c->dns = NULL;
+	}
+}
+
+static struct addrinfo*
+io_dns_cache_get(const char *host, const char *port)
+{
+	/* Return a copy of unexpired cached addresses for host:port, or NULL */
+
+	struct io_dns_cache *d;
+	uint64_t now = io_time();
+
+	for (d = io_dns_cache; d; d = d->next) {
+		if (!strcmp(d->host, host) && !strcmp(d->port, port)) {
+			if (d->expire > now)
+				return io_ai_copy(d->res);
+			io_dns_cache_del(host, port);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+io_dns_cache_put(const char *host, const char *port, const struct addrinfo *res)
+{
+	struct io_dns_cache *d;
+
+	if (IO_DNS_CACHE_TTL == 0)
+		return;
+
+	io_dns_cache_del(host, port);
+
+	if ((d = calloc(1, sizeof(*d))) == NULL)
+		fatal("calloc: %s", strerror(errno));
+
+	if ((d->host = strdup(host)) == NULL || (d->port = strdup(port)) == NULL)
+		fatal("strdup: %s", strerror(errno));
+
+	d->expire = io_time() + (uint64_t) IO_DNS_CACHE_TTL * 1000;
+	d->next = io_dns_cache;
+	d->res = io_ai_copy(res);
+
+	io_dns_cache = d;
+}
+
+static void
+io_dns_cache_del(const char *host, const char *port)
+{
+	struct io_dns_cache **dp, *d;
+
+	for (dp = &io_dns_cache; (d = *dp); dp = &(d->next)) {
+		if (!strcmp(d->host, host) && !strcmp(d->port, port)) {
+			*dp = d->next;
+			io_ai_free(d->res);
+			free(d->host);
+			free(d->port);
+			free(d);
+			return;
+		}
+	}
+}
+
+static struct addrinfo*
+io_ai_copy(const struct addrinfo *ai)
+{
+	/* Copy an address list, each entry allocated with its address.
+	 * Copies are freed with io_ai_free rather than freeaddrinfo */
+
+	struct addrinfo *res = NULL, **tail = &res;
+
+	for (; ai; ai = ai->ai_next) {
+
+		struct addrinfo *p;
+
+		if ((p = malloc(sizeof(*p) + ai->ai_addrlen)) == NULL)
+			fatal("malloc: %s", strerror(errno));
+
+		*p = *ai;
+		p->ai_addr = memcpy(p + 1, ai->ai_addr, ai->ai_addrlen);
+		p->ai_canonname = NULL;
+		p->ai_next = NULL;
+
+		*tail = p;
+		tail = &(p->ai_next);
+	}
+
+	return res;
+}
+
+static struct addrinfo*
+io_ai_interleave(struct addrinfo *ai)
+{
+	/* Reorder addresses alternating between the family of the first
+	 * address and others, preserving order within each family, such
+	 * that racing connection attempts alternate IPv6 and IPv4,
+	 * RFC 8305, section 4 */
+
+	struct addrinfo *a = NULL, **a_tail = &a;
+	struct addrinfo *b = NULL, **b_tail = &b;
+	struct addrinfo *res = NULL, **tail = &res;
+
+	if (ai == NULL)
+		return NULL;
+
+	for (struct addrinfo *p = ai, *next; p; p = next) {
+
+		next = p->ai_next;
+		p->ai_next = NULL;
+
+		if (p->ai_family == ai->ai_family) {
+			*a_tail = p;
+			a_tail = &(p->ai_next);
+		} else {
+			*b_tail = p;
+			b_tail = &(p->ai_next);
+		}
+	}
+
+	while (a || b) {
+
+		if (a) {
+			*tail = a;
+			tail = &(a->ai_next);
+			a = a->ai_next;
+		}
+
+		if (b) {
+			*tail = b;
+			tail = &(b->ai_next);
+			b = b->ai_next;
+		}
+	}
+
+	*tail = NULL;
+
+	return res;
+}
+
+static void
+io_ai_free(struct addrinfo *ai)
+{
+	struct addrinfo *p;
+
+	while ((p = ai)) {
+		ai = ai->ai_next;
+		free(p);
+	}
+}
+
+static void
+io_net_connect(struct connection *c, int err)
+{
+	/* Start a non-blocking connection attempt to the next resolved address,
+	 * racing any attempts in progress. Attempts to successive addresses are
+	 * started every IO_CX_DELAY milliseconds, or as soon as one fails, and
+	 * the first to connect is taken, RFC 8305 */
+
+	int soc;
+	struct addrinfo *p;
+
+	timer_del(&io_timers, &(c->timer));
+
+	while ((p = c->ai_cur) != NULL && c->cx_n < IO_CX_MAX) {
+
+		c->ai_cur = p->ai_next;
+
+		if ((soc = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0) {
+			err = errno;
+			continue;
+		}
+
+		if (fcntl(soc, F_SETFL, fcntl(soc, F_GETFL) | O_NONBLOCK) < 0)
+			fatal("fcntl: %s", strerror(errno));
+
+		if (connect(soc, p->ai_addr, p->ai_addrlen) < 0 && errno != EINPROGRESS) {
+			err = errno;
+			if (close(soc) < 0)
+				fatal("close: %s", strerror(errno));
+			continue;
+		}
+
+		c->cx[c->cx_n].ai = p;
+		c->cx[c->cx_n].soc = soc;
+		c->cx_n++;
+
+		io_ev_cx(c, soc);
+
+		if (c->ai_cur && c->cx_n < IO_CX_MAX)
+			io_timer_add(&(c->timer), io_time() + IO_CX_DELAY);
+
+		return;
+	}
+
+	if (c->cx_n)
+		return;
+
+	io_cb(IO_CB_ERR, c->obj, "Error connecting: %s", io_strerror(err));
+
+	/* Resolve again on reconnect, in case addresses have changed */
+	io_dns_cache_del(c->host, c->port);
+
+	io_ai_free(c->ai_res);
+	c->ai_cur = NULL;
+	c->ai_res = NULL;
+
+	io_state_rxng(c);
+}
+
+static void
+io_net_connected(struct connection *c, unsigned i)
+{
+	/* Take connection attempt i as the connection's socket, closing others */
+
+	int ret;
+	struct addrinfo *p = c->cx[i].ai;
+
+	if ((ret = getnameinfo(p->ai_addr, p->ai_addrlen, c->ip, sizeof(c->ip), NULL, 0, NI_NUMERICHOST))) {
+
+		if (ret == EAI_SYSTEM)
+			io_cb(IO_CB_ERR, c->obj, "Error resolving numeric host: %s", io_strerror(errno));
+		else
+			io_cb(IO_CB_ERR, c->obj, "Error resolving numeric host: %s", gai_strerror(ret));
+
+		*c->ip = 0;
+	}
+
+	c->soc = c->cx[i].soc;
+	c->cx[i] = c->cx[--c->cx_n];
+
+	io_net_cx_close(c);
+
+	io_ai_free(c->ai_res);
+	c->ai_cur = NULL;
+	c->ai_res = NULL;
+
+	/* Registered for connection attempt writability */
+	c->ev = IO_EV_OUT;
+
+	io_ev_set(c, IO_EV_IN);
+	io_state_cxed(c);
+}
+
+static void
+io_net_cx_event(struct connection *c)
+{
+	/* Handle completed connection attempts, taking the first connected,
+	 * or starting the next attempt if any failed */
+
+	int err = 0;
+	struct pollfd pfds[IO_CX_MAX];
+	unsigned i, n = c->cx_n;
+
+	for (i = 0; i < n; i++) {
+		pfds[i].fd = c->cx[i].soc;
+		pfds[i].events = POLLOUT;
+		pfds[i].revents = 0;
+	}
+
+	if (poll(pfds, n, 0) < 0) {
+		if (errno == EINTR)
+			return;
+		fatal("poll: %s", strerror(errno));
+	}
+
+	/* Attempts are removed by swapping in the last, iterate in reverse */
+	for (i = n; i--;) {
+
+		int soc_err = 0;
+		socklen_t len = sizeof(soc_err);
+
+		if (pfds[i].revents == 0)
+			continue;
+
+		if (getsockopt(c->cx[i].soc, SOL_SOCKET, SO_ERROR, &soc_err, &len) < 0)
+			soc_err = errno;
+
+		if (soc_err == 0) {
+			io_net_connected(c, i);
+			return;
+		}
+
+		if (close(c->cx[i].soc) < 0)
+			fatal("close: %s", strerror(errno));
+
+		c->cx[i] = c->cx[--c->cx_n];
+
+		err = soc_err;
+	}
+
+	if (err)
+		io_net_connect(c, err);
+}
+
+static void
+io_net_cx_close(struct connection *c)
+{
+	/* Close connection attempts in progress */
+
+	while (c->cx_n) {
+		if (close(c->cx[--c->cx_n].soc) < 0)
+			fatal("close: %s", strerror(errno));
+	}
+}
+
+int
+io_capture(const char *path)
+{
+	if (io_capture_fp)
+		fclose(io_capture_fp);
+
+	if ((io_capture_fp = fopen(path, "wb")) == NULL)
+		return -1;
+
+	if (fputs(IO_CAPTURE_MAGIC, io_capture_fp) == EOF) {
+		fclose(io_capture_fp);
+		io_capture_fp = NULL;
+		return -1;
+	}
+
+	io_capture_time = io_time();
+
+	return 0;
+}
+
+static void
+io_capture_write(struct connection *c, const char *buf, size_t n)
+{
+	struct io_capture_rec rec = {
+		.time = io_time() - io_capture_time,
+		.id = c->id,
+		.len = (uint32_t) n,
+	};
+
+	if (fwrite(&rec, sizeof(rec), 1, io_capture_fp) != 1
+	 || fwrite(buf, 1, n, io_capture_fp) != n)
+		io_capture_fail(c);
+}
+
+static void
+io_capture_fail(struct connection *c)
+{
+	io_cb(IO_CB_ERR, c->obj, "Capture failed: %s", strerror(errno));
+
+	fclose(io_capture_fp);
+	io_capture_fp = NULL;
+}
+
+static void
+io_net_recv(struct connection *c)
+{
+	/* Read until the socket would block, or for at most IO_RECV_BATCH reads,
+	 * leaving any further data in the socket receive buffer until the next
+	 * event loop iteration. Received data is never dropped, a connection
+	 * that can't be kept up with is throttled by TCP flow control */
+
+	int err, rd = 0;
+	ssize_t ret;
+	unsigned n = 0;
+
+	do {
+		if ((ret = recv(c->soc, io_recv_buf(c) + c->read.i, IO_RECV_SIZE, 0)) <= 0)
+			break;
+
+		rd = 1;
+
+		if (io_capture_fp)
+			io_capture_write(c, io_recv_buf(c) + c->read.i, (size_t) ret);
+
+		io_recv(c, (size_t) ret);
+
+	} while (++n < IO_RECV_BATCH && (c->st_c == IO_ST_CXED || c->st_c == IO_ST_PING));
+
+	err = errno;
+
+	if (rd) {
+
+		if (io_capture_fp && fflush(io_capture_fp))
+			io_capture_fail(c);
+
+		io_cb_read_soc_end(c->obj);
+
+		/* Connection state may have changed within a callback */
+		if (c->st_c != IO_ST_CXED && c->st_c != IO_ST_PING)
+			return;
+
+		io_state_cxed(c);
+	}
+
+	if (ret > 0 || (ret < 0 && (CHECK_BLOCK(err) || err == EINTR)))
+		return;
+
+	if (ret == 0) {
+		io_cb(IO_CB_DXED, c->obj, "connection closed");
+	} else if (err == EPIPE || err == ECONNRESET) {
+		io_cb(IO_CB_DXED, c->obj, "connection closed by peer");
+	} else {
+		io_cb(IO_CB_DXED, c->obj, "recv error: %s", io_strerror(err));
+	}
+
+	if (ret == 0) {
+		io_state_dxed(c);
+	} else {
+		io_soc_close(c);
+		io_cx_start(c);
+	}
+}
+
+static void
+io_net_send(struct connection *c)
+{
+	if (io_send_sched(c, io_time()) < 0) {
+
+		if (errno == EPIPE || errno == ECONNRESET)
+			io_cb(IO_CB_DXED, c->obj, "connection closed by peer");
+		else
+			io_cb(IO_CB_DXED, c->obj, "send error: %s", io_strerror(errno));
+
+		io_soc_close(c);
+		io_cx_start(c);
+	}
+}
+
+static void
+io_event_soc(struct connection *c, unsigned ev)
+{
+	/* Handle socket readiness for a connection */
+
+	switch (c->st_c) {
+		case IO_ST_CXNG:
+			io_net_cx_event(c);
+			break;
+		case IO_ST_CXED:
+		case IO_ST_PING:
+			if (ev & (IO_EV_IN | IO_EV_ERR))
+				io_net_recv(c);
+			if ((ev & IO_EV_OUT) && (c->st_c == IO_ST_CXED || c->st_c == IO_ST_PING))
+				io_net_send(c);
+			break;
+		default:
+			fatal("invalid state for socket event: %d", c->st_c);
+	}
+}
+
+static void
+io_event_timeout(void *arg)
+{
+	/* Handle a connection's timed state transition */
+
+	struct connection *c = arg;
+
+	switch (c->st_c) {
+		case IO_ST_RXNG:
+			io_cx_start(c);
+			break;
+		case IO_ST_CXNG:
+			if (c->ai_res)
+				io_net_connect(c, 0);
+			else
+				io_cx_start(c);
+			break;
+		case IO_ST_CXED:
+		case IO_ST_PING:
+			io_state_ping(c);
+			break;
+		default:
+			fatal("invalid state for timeout: %d", c->st_c);
+	}
+}
+
+static int
+io_timeout(uint64_t now)
+{
+	/* Return the time in milliseconds until the timer wheel must next
+	 * be run, or -1 if no timers are pending */
+
+	int64_t t;
+
+	if ((t = timer_next(&io_timers, now)) < 0)
+		return -1;
+
+	return (int) MIN(t, INT32_MAX);
+}
+
+static void
+io_timer_add(struct timer *t, uint64_t expire)
+{
+	/* Add a timer at a monotonic deadline, in milliseconds */
+
+	if (io_timers.now == 0)
+		timer_init(&io_timers, io_time());
+
+	timer_add(&io_timers, t, expire);
+}
+
+#ifdef IO_EVENTS_EPOLL
+static void
+io_ev_init(void)
+{
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+	struct epoll_event ev_dns = { .events = EPOLLIN, .data.ptr = IO_EV_DNS };
+
+	if (io_dns_fds[0] < 0)
+		io_dns_init();
+
+	if ((io_epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+		fatal("epoll_create1: %s", strerror(errno));
+
+	if (epoll_ctl(io_epfd, EPOLL_CTL_ADD, STDIN_FILENO, &ev) < 0)
+		fatal("epoll_ctl: %s", strerror(errno));
+
+	if (epoll_ctl(io_epfd, EPOLL_CTL_ADD, io_dns_fds[0], &ev_dns) < 0)
+		fatal("epoll_ctl: %s", strerror(errno));
+}
+
+static void
+io_ev_set(struct connection *c, unsigned ev)
+{
+	/* Set the events of interest for a connection's socket */
+
+	int op;
+	struct epoll_event e = { .data.ptr = c };
+
+	if (c->soc < 0 || c->ev == ev || io_epfd < 0) {
+		c->ev = ev;
+		return;
+	}
+
+	if (ev & IO_EV_IN)  e.events |= EPOLLIN;
+	if (ev & IO_EV_OUT) e.events |= EPOLLOUT;
+
+	if (c->ev == 0)
+		op = EPOLL_CTL_ADD;
+	else if (ev == 0)
+		op = EPOLL_CTL_DEL;
+	else
+		op = EPOLL_CTL_MOD;
+
+	if (epoll_ctl(io_epfd, op, c->soc, &e) < 0)
+		fatal("epoll_ctl: %s", strerror(errno));
+
+	c->ev = ev;
+}
+
+static void
+io_ev_cx(struct connection *c, int soc)
+{
+	/* Register a connection attempt's socket, removed on close */
+
+	struct epoll_event e = { .events = EPOLLOUT, .data.ptr = c };
+
+	if (io_epfd >= 0 && epoll_ctl(io_epfd, EPOLL_CTL_ADD, soc, &e) < 0)
+		fatal("epoll_ctl: %s", strerror(errno));
+}
+
+static int
+io_ev_wait(struct io_event *events, int timeout)
+{
+	struct epoll_event ev[IO_EV_MAX];
+	int ret;
+
+	if ((ret = epoll_wait(io_epfd, ev, IO_EV_MAX, timeout)) < 0)
+		return ret;
+
+	for (int i = 0; i < ret; i++) {
+		events[i].c = ev[i].data.ptr;
+		events[i].ev = 0;
+		if (ev[i].events & EPOLLIN)  events[i].ev |= IO_EV_IN;
+		if (ev[i].events & EPOLLOUT) events[i].ev |= IO_EV_OUT;
+		if (ev[i].events & (EPOLLERR | EPOLLHUP)) events[i].ev |= IO_EV_ERR;
+	}
+
+	return ret;
+}
+#else
+static void
+io_ev_init(void)
+{
+	/* poll descriptors are collected on each wait */
+
+	if (io_dns_fds[0] < 0)
+		io_dns_init();
+}
+
+static void
+io_ev_cx(struct connection *c, int soc)
+{
+	/* poll descriptors are collected on each wait */
+
+	UNUSED(c);
+	UNUSED(soc);
+}
+
+static void
+io_ev_set(struct connection *c, unsigned ev)
+{
+	c->ev = ev;
+}
+
+static int
+io_ev_wait(struct io_event *events, int timeout)
+{
+	struct connection *c;
+	int n = 0, ret;
+	size_t nfds = 2;
+
+	if ((c = connections)) {
+		do {
+			nfds += 1 + c->cx_n;
+		} while ((c = c->next) != connections);
+	}
+
+	if (nfds > io_pfds_n) {
+		if ((io_pfds = realloc(io_pfds, nfds * sizeof(*io_pfds))) == NULL)
+			fatal("realloc: %s", strerror(errno));
+		if ((io_pfds_c = realloc(io_pfds_c, nfds * sizeof(*io_pfds_c))) == NULL)
+			fatal("realloc: %s", strerror(errno));
+		io_pfds_n = nfds;
+	}
+
+	io_pfds[0].fd = STDIN_FILENO;
+	io_pfds[0].events = POLLIN;
+	io_pfds_c[0] = NULL;
+	io_pfds[1].fd = io_dns_fds[0];
+	io_pfds[1].events = POLLIN;
+	io_pfds_c[1] = IO_EV_DNS;
+	nfds = 2;
+
+	if ((c = connections)) {
+		do {
+			if (c->soc >= 0 && c->ev) {
+				io_pfds[nfds].fd = c->soc;
+				io_pfds[nfds].events = 0;
+				if (c->ev & IO_EV_IN)  io_pfds[nfds].events |= POLLIN;
+				if (c->ev & IO_EV_OUT) io_pfds[nfds].events |= POLLOUT;
+				io_pfds_c[nfds++] = c;
+			}
+			for (unsigned i = 0; i < c->cx_n; i++) {
+				io_pfds[nfds].fd = c->cx[i].soc;
+				io_pfds[nfds].events = POLLOUT;
+				io_pfds_c[nfds++] = c;
+			}
+		} while ((c = c->next) != connections);
+	}
+
+	if ((ret = poll(io_pfds, nfds, timeout)) <= 0)
+		return ret;
+
+	for (size_t i = 0; i < nfds && n < IO_EV_MAX; i++) {
+
+		if (io_pfds[i].revents == 0)
+			continue;
+
+		events[n].c = io_pfds_c[i];
+		events[n].ev = 0;
+		if (io_pfds[i].revents & POLLIN)  events[n].ev |= IO_EV_IN;
+		if (io_pfds[i].revents & POLLOUT) events[n].ev |= IO_EV_OUT;
+		if (io_pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL)) events[n].ev |= IO_EV_ERR;
+		n++;
+	}
+
+	return n;
+}
+#endif
+
+static size_t
+io_scan_init(const char *buf, size_t n)
+{
+	/* Select the widest scan supported by the cpu */
+
+	io_scan = io_scan_scalar;
+
+#ifdef IO_SCAN_X86
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		io_scan = io_scan_avx2;
+	else
+		io_scan = io_scan_sse2;
+#endif
+
+	return io_scan(buf, n);
+}
+
+static size_t
+io_scan_scalar(const char *buf, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n && buf[i] >= 0x20 && buf[i] <= 0x7E; i++)
+		;
+
+	return i;
+}
+
+#ifdef IO_SCAN_X86
+static size_t
+io_scan_sse2(const char *buf, size_t n)
+{
+	/* Bytes outside [0x20, 0x7E], including 0x80 and above as negative
+	 * signed bytes, fail the signed range comparison */
+
+	const __m128i lo = _mm_set1_epi8(0x1F);
+	const __m128i hi = _mm_set1_epi8(0x7F);
+	size_t i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+
+		__m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+		__m128i ok = _mm_and_si128(_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi));
+		unsigned mask = (unsigned) _mm_movemask_epi8(ok) ^ 0xFFFFU;
+
+		if (mask)
+			return i + (size_t) __builtin_ctz(mask);
+	}
+
+	return i + io_scan_scalar(buf + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static size_t
+io_scan_avx2(const char *buf, size_t n)
+{
+	const __m256i lo = _mm256_set1_epi8(0x1F);
+	const __m256i hi = _mm256_set1_epi8(0x7F);
+	size_t i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+
+		__m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+		__m256i ok = _mm256_and_si256(_mm256_cmpgt_epi8(v, lo), _mm256_cmpgt_epi8(hi, v));
+		unsigned mask = ~(unsigned) _mm256_movemask_epi8(ok);
+
+		if (mask)
+			return i + (size_t) __builtin_ctz(mask);
+	}
+
+	/* Remaining bytes scanned inline, avoiding a mixed AVX/SSE call */
+	for (; i < n && buf[i] >= 0x20 && buf[i] <= 0x7E; i++)
+		;
+
+	return i;
+}
+#endif
+
+static char*
+io_recv_buf(struct connection *c)
+{
+	/* Receive buffer, starting with the partial line */
+
+	return (c->read.ext ? c->read.ext : c->read.buf);
+}
+
+static void
+io_recv(struct connection *c, size_t n)
+{
+	/* Frame CRLF terminated lines from n bytes received at the end of
+	 * the partial line in the receive buffer, keeping only printable
+	 * bytes and the CTCP delimiter. Lines are truncated to IO_MESG_LEN
+	 * bytes, or IO_LINE_LEN bytes when starting with message tags.
+	 *
+	 * Lines are filtered in place and passed to the callback as slices
+	 * of the receive buffer. Spans of printable bytes are found by
+	 * io_scan and only moved when preceded by a dropped byte, other bytes
+	 * are handled one at a time.
+	 *
+	 * The remaining partial line is moved to the start of read.buf for
+	 * the next recv, or to read.ext if too long to fit */
+
+	char *buf = io_recv_buf(c);
+	char cl = c->read.cl;
+	size_t i = c->read.i; /* read position */
+	size_t w = c->read.i; /* write position */
+	size_t s = 0;         /* line start */
+	size_t len;
+
+	n += i;
+
+	while (i < n) {
+
+		size_t k = io_scan(buf + i, n - i);
+		size_t max = (buf[(w > s) ? s : i] == '@') ? IO_LINE_LEN : IO_MESG_LEN;
+
+		if (w - s < max) {
+			size_t m = MIN(k, max - (w - s));
+			if (w != i)
+				memmove(buf + w, buf + i, m);
+			w += m;
+		}
+
+		if ((i += k) == n)
+			break;
+
+		char cc = buf[i];
+
+		if (w > s && cc == '\n' && (k ? buf[i - 1] : cl) == '\r') {
+
+			buf[w] = 0;
+
+			debug(" recv: (%zu) %s", w - s, buf + s);
+
+			io_cb_read_soc(buf + s, w - s, c->obj);
+
+			/* Connection closed within callback */
+			if (c->st_c != IO_ST_CXED && c->st_c != IO_ST_PING)
+				return;
+
+			s = w = i + 1;
+
+		} else if (w - s < max && cc == 0x01) {
+			buf[w++] = cc;
+		}
+
+		cl = cc;
+		i++;
+	}
+
+	c->read.cl = buf[n - 1];
+	c->read.i = len = (s < w ? w - s : 0);
+
+	if (len > IO_MESG_LEN && !c->read.ext) {
+		if ((c->read.ext = malloc(IO_LINE_LEN + IO_RECV_SIZE)) == NULL)
+			fatal("malloc: %s", strerror(errno));
+		memcpy(c->read.ext, buf + s, len);
+	} else if (len <= IO_MESG_LEN && c->read.ext) {
+		memcpy(c->read.buf, buf + s, len);
+		free(c->read.ext);
+		c->read.ext = NULL;
+	} else if (len && s) {
+		memmove(buf, buf + s, len);
+	}
+}
+
+static void
+sigaction_sigwinch(int sig)
+{
+	UNUSED(sig);
+
+	flag_sigwinch_cb = 1;
+	flag_tty_resized = 0;
+}
+
+static void
+io_sig_init(void)
+{
+	struct sigaction sa;
+
+	sa.sa_handler = sigaction_sigwinch;
+	sa.sa_flags = 0;
+	sigemptyset(&sa.sa_mask);
 
 	if (sigaction(SIGWINCH, &sa, NULL) < 0)
 		fatal("sigaction - SIGWINCH: %s", strerror(errno));
+
+	/* Socket errors are handled by return value */
+	sa.sa_handler = SIG_IGN;
+
+	if (sigaction(SIGPIPE, &sa, NULL) < 0)
+		fatal("sigaction - SIGPIPE: %s", strerror(errno));
 }
 
 static void
@@ -649,35 +2038,77 @@ io_tty_term(void)
 		fatal_noexit("tcsetattr: %s", strerror(errno));
 }
 
+static void
+io_read_inp(void)
+{
+	char buf[128];
+	ssize_t ret;
+
+	if ((ret = read(STDIN_FILENO, buf, sizeof(buf))) > 0)
+		io_cb_read_inp(buf, ret);
+	else if (ret == 0)
+		fatal("read: EOF");
+	else if (errno != EINTR && !CHECK_BLOCK(errno))
+		fatal("read: %s", strerror(errno));
+}
+
 void
 io_init(void)
 {
 	io_sig_init();
 	io_tty_init();
+	io_ev_init();
 
 	io_running = 1;
 
+	io_loop();
+
+	if (io_capture_fp) {
+		fclose(io_capture_fp);
+		io_capture_fp = NULL;
+	}
+}
+
+static void
+io_loop(void)
+{
+	struct io_event events[IO_EV_MAX];
+
+	int idle = 0;
+
 	while (io_running) {
 
-		char buf[128];
-		ssize_t ret = read(STDIN_FILENO, buf, sizeof(buf));
+		int dns = 0, inp = 0, ret;
 
-		if (ret > 0) {
-			PT_LK(&cb_mutex);
-			io_cb_read_inp(buf, ret);
-			PT_UL(&cb_mutex);
+		if ((ret = io_ev_wait(events, idle ? 0 : io_timeout(io_time()))) < 0 && errno != EINTR)
+			fatal("io_ev_wait: %s", strerror(errno));
+
+		if (flag_sigwinch_cb) {
+			flag_sigwinch_cb = 0;
+			io_cb(IO_CB_SIGNAL, NULL, IO_SIGWINCH);
 		}
 
-		if (ret <= 0) {
-			if (errno == EINTR) {
-				if (flag_sigwinch_cb) {
-					flag_sigwinch_cb = 0;
-					PT_CB(IO_CB_SIGNAL, NULL, IO_SIGWINCH);
-				}
-			} else {
-				fatal("read: %s", ret ? strerror(errno) : "EOF");
-			}
+		/* Socket events are handled before stdin, since input
+		 * can free connections with events pending */
+		for (int i = 0; i < ret; i++) {
+			if (events[i].c == NULL)
+				inp = 1;
+			else if (events[i].c == IO_EV_DNS)
+				dns = 1;
+			else if (events[i].c->soc >= 0 || events[i].c->cx_n)
+				io_event_soc(events[i].c, events[i].ev);
 		}
+
+		if (dns)
+			io_dns_recv();
+
+		if (inp)
+			io_read_inp();
+
+		/* Connections freed by callbacks delete their timers */
+		timer_run(&io_timers, io_time());
+
+		idle = io_cb_idle();
 	}
 }
 
@@ -726,6 +2157,7 @@ io_err(int err)
 		case IO_ERR_CXNG:  return "socket connection in progress";
 		case IO_ERR_DXED:  return "socket not connected";
 		case IO_ERR_FMT:   return "failed to format message";
+		case IO_ERR_QUEUE: return "send queue full";
 		case IO_ERR_SEND:  return "failed to send message";
 		case IO_ERR_TRUNC: return "data truncated";
 		default:
@@ -48,6 +48,11 @@
  *   (A) io_cx: establish network connection
  *   (B) io_dx: close network connection
  *
+ * All sockets and stdin are multiplexed by a single event loop, using
+ * epoll where available and poll otherwise. Timed transitions (ping,
+ * reconnect, flood control) are driven by the same loop from a timer
+ * wheel on a monotonic clock
+ *
  * Network state implicit transitions result in informational callback types:
  *   (C) on connection attempt:  IO_CB_INFO
  *   (E) on connection failure:  IO_CB_ERROR
@@ -57,23 +62,58 @@
  *   (H) on ping timeout update: IO_CB_PING_N
  *   (I) on ping normal:         IO_CB_PING_0
  *
+ * Lines written with io_sendf are queued per connection and written to
+ * the socket as it becomes writable, so sending never blocks. Lines are
+ * released to the socket at the rate permitted by client side flood
+ * control, a burst of IO_FLOOD_BURST lines refilled at one line per
+ * IO_FLOOD_RATE milliseconds. Lines written with io_sendf_bulk are held
+ * behind those written with io_sendf, except PING and PONG. QUIT isn't
+ * held by flood control, and lines released are written once more when
+ * closed by io_dx, so QUIT is sent before disconnecting. A backlogged
+ * queue results in informational callback types:
+ *   on lines held or queue above IO_SENDQ_HIGH bytes:  IO_CB_SEND_1
+ *   on flood control release while backlogged:        IO_CB_SEND_N
+ *   on queue drained, or discarded when closed:       IO_CB_SEND_0
+ * and sending fails once IO_SENDQ_MAX bytes are queued
+ *
  * Successful reads on stdin and connected sockets result in data callbacks:
  *   from stdin:  io_cb_read_inp
- *   from socket: io_cb_read_soc
+ *   from socket: io_cb_read_soc, for each complete line read
+ *                io_cb_read_soc_end, once all lines read are handled
+ *
+ * Each event loop iteration reads at most a bounded amount from any one
+ * socket, so a busy connection can't starve others or user input. Data
+ * beyond that is left to the next iteration, never dropped
  *
  * Signals registered to be caught result in non-signal handler context
  * callback with type IO_CB_SIGNAL
  *
+ * Background work is done by io_cb_idle, once per event loop iteration,
+ * with the loop polling rather than waiting for events while it returns
+ * non-zero
+ *
+ * Hosts are resolved on a background thread, cancelled by io_dx, and
+ * resolved addresses are reused for reconnecting for IO_DNS_CACHE_TTL
+ * seconds, or until no address can be connected to. Connection attempts
+ * to resolved addresses alternate address families and are started in
+ * a staggered race, the first to connect is taken (RFC 8305)
+ *
  * Failed connection attempts enter a retry cycle with exponential
  * backoff time given by:
  *   t(n) = t(n - 1) * factor
  *   t(0) = base
+ * less a random jitter of up to IO_RECONNECT_JITTER percent. At most
+ * IO_RECONNECT_MAX connections resolve or connect at once, others are
+ * queued, those explicitly connected by io_cx first
  *
- * Calling io_init starts the io context and doesn't return until io_term
+ * Bytes received on all sockets can be captured to a file with io_capture,
+ * as records of the time received and the connection received on, to be
+ * replayed offline through the same receive path
+ *
+ * Calling io_init starts the io context and doesn't return until io_term,
+ * all callbacks are made from within that context
  */
 
-#define IO_MAX_CONNECTIONS 8
-
 struct connection;
 
 enum io_sig_t
@@ -93,11 +133,14 @@ enum io_cb_t
 	IO_CB_PING_0, /* <unsigned ping> */
 	IO_CB_PING_1, /* <unsigned ping> */
 	IO_CB_PING_N, /* <unsigned ping> */
+	IO_CB_SEND_0, /* <unsigned lines>, <unsigned delay> */
+	IO_CB_SEND_1, /* <unsigned lines>, <unsigned delay> */
+	IO_CB_SEND_N, /* <unsigned lines>, <unsigned delay> */
 	IO_CB_SIGNAL, /* <io_sig_t sig> */
 	IO_CB_SIZE
 };
 
-/* Returns a connection, or NULL if limit is reached */
+/* Returns a new connection, in state dxed */
 struct connection* connection(
 	const void*,  /* callback object */
 	const char*,  /* host */
@@ -109,8 +152,9 @@ void io_free(struct connection*);
 int io_cx(struct connection*);
 int io_dx(struct connection*);
 
-/* Formatted write to connection */
+/* Formatted write to connection, priority and bulk lanes */
 int io_sendf(struct connection*, const char*, ...);
+int io_sendf_bulk(struct connection*, const char*, ...);
 
 /* IO state callback */
 void io_cb(enum io_cb_t, const void*, ...);
@@ -118,6 +162,13 @@ void io_cb(enum io_cb_t, const void*, ...);
 /* IO data callback */
 void io_cb_read_inp(char*, size_t);
 void io_cb_read_soc(char*, size_t, const void*);
+void io_cb_read_soc_end(const void*);
+
+/* IO idle callback, returning non-zero while work remains */
+int io_cb_idle(void);
+
+/* Capture bytes received to file, returning non-zero with errno set on error */
+int io_capture(const char*);
 
 /* Start/stop IO context */
 void io_init(void);
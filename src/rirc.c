@@ -54,6 +54,7 @@ static const char *const rirc_usage =
 "\nHelp:"
 "\n  -h, --help      Print this message and exit"
 "\n  -v, --version   Print rirc version and exit"
+"\n      --capture=FILE  Capture bytes received to FILE, see bench/replay.c"
 "\n"
 "\nOptions:"
 "\n  -s, --server=SERVER       Connect to SERVER"
@@ -83,6 +84,7 @@ opt_arg_str(char c)
 		case 'c': return "-c/--chans";
 		case 'u': return "-u/--username";
 		case 'r': return "-r/--realname";
+		case 'C': return "--capture";
 		default:
 			fatal("unknown option flag '%c'", c);
 	}
@@ -127,6 +129,7 @@ parse_args(int argc, char **argv)
 		{"realname", required_argument, 0, 'r'},
 		{"help",     no_argument,       0, 'h'},
 		{"version",  no_argument,       0, 'v'},
+		{"capture",  required_argument, 0, 'C'},
 		{0, 0, 0, 0}
 	};
 
@@ -139,7 +142,7 @@ parse_args(int argc, char **argv)
 		const char *username;
 		const char *realname;
 		struct server *s;
-	} cli_servers[IO_MAX_CONNECTIONS];
+	} cli_servers[argc];
 
 	/* FIXME: getopt_long is a GNU extension */
 	while (0 < (opt_c = getopt_long(argc, argv, ":s:p:w:n:c:r:u:hv", long_opts, &opt_i))) {
@@ -151,8 +154,7 @@ parse_args(int argc, char **argv)
 				if (*optarg == '-')
 					arg_error("-s/--server requires an argument");
 
-				if (++n_servers == IO_MAX_CONNECTIONS)
-					arg_error("exceeded maximum number of servers (%d)", IO_MAX_CONNECTIONS);
+				n_servers++;
 
 				cli_servers[n_servers - 1].host = optarg;
 				cli_servers[n_servers - 1].port = "6667";
@@ -209,6 +211,11 @@ parse_args(int argc, char **argv)
 				puts(rirc_version);
 				exit(EXIT_SUCCESS);
 
+			case 'C': /* Capture bytes received, long option only */
+				if (io_capture(optarg))
+					arg_error("capture '%s': %s", optarg, strerror(errno));
+				break;
+
 			case '?':
 				arg_error("unknown options '%s'", argv[optind - 1]);
 
@@ -5,6 +5,7 @@
  */
 
 #include <ctype.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
@@ -22,11 +23,22 @@
 /* See: https://vt100.net/docs/vt100-ug/chapter3.html */
 #define CTRL(k) ((k) & 0x1f)
 
+#ifndef BUFFER_IDLE_RELEASE
+#define BUFFER_IDLE_RELEASE 0
+#elif (BUFFER_IDLE_RELEASE < 0 || BUFFER_IDLE_RELEASE > 2592000)
+#error "BUFFER_IDLE_RELEASE: [0, 2592000]"
+#endif
+
+/* Lines reflowed per event loop iteration after the terminal is resized */
+#define REFLOW_LINES 4096
+
 static void _newline(struct channel*, enum buffer_line_t, const char*, const char*, va_list);
 static void state_io_cxed(struct server*);
 static void state_io_dxed(struct server*, va_list);
 static void state_io_ping(struct server*, unsigned int);
+static void state_io_sendq(struct server*, va_list);
 static void state_io_signal(enum io_sig_t);
+static void state_release_idle(void);
 
 static int state_input_linef(struct channel*);
 static int state_input_ctrlch(const char*, size_t);
@@ -37,6 +49,7 @@ static uint16_t state_complete_list(char*, uint16_t, uint16_t, const char**);
 static uint16_t state_complete_user(char*, uint16_t, uint16_t, int);
 
 static void command(struct channel*, char*);
+static void command_search(struct channel*, const char*, int);
 
 static struct
 {
@@ -44,6 +57,7 @@ static struct
 	struct channel *default_channel; /* the default rirc channel at startup */
 	struct server_list servers;
 	union draw draw;
+	int reflow;                      /* buffers are reflowed when idle */
 } state;
 
 struct server_list*
@@ -79,7 +93,7 @@ static const char *irc_list[] = {
 // TODO: from command handler list
 /* List of rirc commands for tab completeion */
 static const char *cmd_list[] = {
-	"clear", "close", "connect", "quit", "set", NULL};
+	"clear", "close", "connect", "quit", "search", "searchall", "set", NULL};
 
 /* Set draw bits */
 #define X(BIT) void draw_##BIT(void) { state.draw.bits.BIT = 1; }
@@ -127,6 +141,8 @@ state_term(void)
 
 	channel_free(state.default_channel);
 
+	state.reflow = 0;
+
 	if ((s1 = state_server_list()->head) == NULL)
 		return;
 
@@ -136,6 +152,9 @@ state_term(void)
 		io_free(s2->connection);
 		server_free(s2);
 	} while (s1 != state_server_list()->head);
+
+	state_server_list()->head = NULL;
+	state_server_list()->tail = NULL;
 }
 
 void
@@ -161,21 +180,37 @@ newlinef(struct channel *c, enum buffer_line_t type, const char *from, const cha
 static void
 _newline(struct channel *c, enum buffer_line_t type, const char *from, const char *fmt, va_list ap)
 {
-	char buf[TEXT_LENGTH_MAX];
+	char buf[TEXT_LENGTH_MAX + 1];
+	char *str = buf;
 	char prefix = 0;
 	const char *from_str;
 	const char *text_str;
 	int len;
 	size_t from_len;
 	size_t text_len;
+	va_list ap_copy;
+
+	va_copy(ap_copy, ap);
+
+	/* Messages longer than a buffer line are formatted to the heap,
+	 * and split over multiple lines by buffer_newline */
+	if ((len = vsnprintf(buf, sizeof(buf), fmt, ap)) >= (int) sizeof(buf)) {
 
-	if ((len = vsnprintf(buf, sizeof(buf), fmt, ap)) < 0) {
+		if ((str = malloc((size_t) len + 1)) == NULL)
+			fatal("malloc: %s", strerror(errno));
+
+		len = vsnprintf(str, (size_t) len + 1, fmt, ap_copy);
+	}
+
+	va_end(ap_copy);
+
+	if (len < 0) {
 		text_str = "newlinef error: vsprintf failure";
 		text_len = strlen(text_str);
 		from_str = "-!!-";
 		from_len = strlen(from_str);
 	} else {
-		text_str = buf;
+		text_str = str;
 		text_len = len;
 		from_str = from;
 
@@ -204,6 +239,9 @@ _newline(struct channel *c, enum buffer_line_t type, const char *from, const cha
 		text_len,
 		prefix);
 
+	if (str != buf)
+		free(str);
+
 	if (c == current_channel()) {
 		draw_buffer();
 	} else {
@@ -251,7 +289,7 @@ state_server_set_chans(struct server *s, const char *chans)
 void
 channel_clear(struct channel *c)
 {
-	memset(&(c->buffer), 0, sizeof(c->buffer));
+	buffer_free(&(c->buffer));
 	draw_buffer();
 }
 
@@ -497,33 +535,24 @@ buffer_scrollback_back(struct channel *c)
 
 	struct buffer *b = &c->buffer;
 
-	unsigned int buffer_i = b->scrollback,
-	             count = 0,
-	             text_w = 0,
+	unsigned int buffer_i,
+	             count,
 	             cols = io_tty_cols(),
 	             rows = io_tty_rows() - 4;
 
-	struct buffer_line *line = buffer_line(b, buffer_i);
+	struct buffer_line *line = buffer_line(b, b->scrollback);
 
 	/* Skip redraw */
 	if (line == buffer_tail(b))
 		return;
 
 	/* Find top line */
-	for (;;) {
+	buffer_i = buffer_rows_back(b, cols, b->scrollback, rows, &count);
 
-		split_buffer_cols(line, NULL, &text_w, cols, b->pad);
-
-		count += buffer_line_rows(line, text_w);
-
-		if (count >= rows)
-			break;
-
-		if (line == buffer_tail(b))
-			return;
+	if (count < rows)
+		return;
 
-		line = buffer_line(b, --buffer_i);
-	}
+	line = buffer_line(b, buffer_i);
 
 	b->scrollback = buffer_i;
 
@@ -540,8 +569,7 @@ buffer_scrollback_forw(struct channel *c)
 {
 	/* Scroll a buffer forward one page */
 
-	unsigned int count = 0,
-	             text_w = 0,
+	unsigned int count,
 	             cols = io_tty_cols(),
 	             rows = io_tty_rows() - 4;
 
@@ -553,21 +581,10 @@ buffer_scrollback_forw(struct channel *c)
 	if (line == buffer_head(b))
 		return;
 
-	/* Find top line */
-	for (;;) {
-
-		split_buffer_cols(line, NULL, &text_w, cols, b->pad);
+	/* Find bottom line */
+	b->scrollback = buffer_rows_forw(b, cols, b->scrollback, rows, &count);
 
-		count += buffer_line_rows(line, text_w);
-
-		if (line == buffer_head(b))
-			break;
-
-		if (count >= rows)
-			break;
-
-		line = buffer_line(b, ++b->scrollback);
-	}
+	line = buffer_line(b, b->scrollback);
 
 	/* Bottom line in view draws in full; scroll forward one additional line */
 	if (count == rows && line != buffer_head(b))
@@ -756,11 +773,21 @@ state_io_ping(struct server *s, unsigned int ping)
 		newlinef(s->channel, 0, "-!!-", "sendf fail: %s", io_err(ret));
 }
 
+static void
+state_io_sendq(struct server *s, va_list ap)
+{
+	s->sendq.lines = va_arg(ap, unsigned int);
+	s->sendq.delay = va_arg(ap, unsigned int);
+
+	draw_status();
+}
+
 static void
 state_io_signal(enum io_sig_t sig)
 {
 	switch (sig) {
 		case IO_SIGWINCH:
+			state.reflow = 1;
 			draw_all();
 			break;
 		default:
@@ -789,6 +816,11 @@ io_cb(enum io_cb_t type, const void *cb_obj, ...)
 		case IO_CB_PING_N:
 			state_io_ping(s, va_arg(ap, unsigned int));
 			break;
+		case IO_CB_SEND_0:
+		case IO_CB_SEND_1:
+		case IO_CB_SEND_N:
+			state_io_sendq(s, ap);
+			break;
 		case IO_CB_ERR:
 			_newline(s->channel, 0, "-!!-", va_arg(ap, const char *), ap);
 			break;
@@ -807,6 +839,55 @@ io_cb(enum io_cb_t type, const void *cb_obj, ...)
 	redraw();
 }
 
+static void
+command_search(struct channel *c, const char *query, int all)
+{
+	/* Search for lines with each word of a query, newest first, moving
+	 * the scrollback to the line found, and continuing through other
+	 * channels if all. Without a query, repeat the last search from
+	 * the scrollback. Searches past a bound of lines unindexed stop
+	 * with the scrollback at the last line matched, to be repeated */
+
+	static char last[MAX_SEARCH];
+
+	struct channel *start = c;
+	unsigned int i = c->buffer.head;
+	int ret;
+
+	if (query && search_query(query)) {
+		snprintf(last, sizeof(last), "%s", query);
+	} else if (!query && *last) {
+		i = c->buffer.scrollback;
+	} else {
+		newlinef(c, BUFFER_LINE_CLIENT, "-!!-", ":%s [words]", (all ? "searchall" : "search"));
+		return;
+	}
+
+	do {
+		if ((ret = buffer_search(&(c->buffer), last, &i))) {
+
+			c->buffer.scrollback = i;
+
+			if (ret < 0)
+				newlinef(c, BUFFER_LINE_CLIENT, "-!!-", "search: no match yet, repeat to continue");
+
+			if (c != current_channel()) {
+				channel_set_current(c);
+			} else {
+				draw_buffer();
+				draw_status();
+			}
+			return;
+		}
+
+		c = channel_get_next(c);
+		i = c->buffer.head;
+
+	} while (all && c != start);
+
+	newlinef(current_channel(), BUFFER_LINE_CLIENT, "-!!-", "search: no match");
+}
+
 static void
 command(struct channel *c, char *buf)
 {
@@ -869,8 +950,41 @@ command(struct channel *c, char *buf)
 		return;
 	}
 
+	if (!strcasecmp(cmnd, "search") || !strcasecmp(cmnd, "searchall")) {
+		command_search(c, strtok_r(NULL, "", &saveptr), !strcasecmp(cmnd, "searchall"));
+		return;
+	}
+
 	if (!strcasecmp(cmnd, "set")) {
 		/* TODO user, real, nicks, pass, key */
+
+		const char *opt = strtok_r(NULL, " ", &saveptr);
+		const char *val = strtok_r(NULL, " ", &saveptr);
+
+		if (opt && !strcasecmp(opt, "scrollback")) {
+
+			char *end;
+			unsigned long lines;
+
+			if (val == NULL) {
+				struct history *h = &(c->buffer.history);
+
+				newlinef(c, 0, "--", "scrollback: %u lines", c->buffer.lines_max);
+
+				if (h->size) {
+					newlinef(c, 0, "--", "history: %u lines, %zu KiB, compressed %.1f:1",
+						h->lines, h->size / 1024, (double) h->raw / (double) h->size);
+				}
+			} else if ((lines = strtoul(val, &end, 10)) == 0 || *end || lines > BUFFER_LINES_MAX) {
+				newlinef(c, 0, "-!!-", "invalid scrollback: %s, [1, %d]", val, BUFFER_LINES_MAX);
+			} else {
+				buffer_lines_set(&(c->buffer), (unsigned int) lines);
+				draw_buffer();
+				draw_status();
+			}
+		} else {
+			newlinef(c, 0, "-!!-", ":set scrollback [lines]");
+		}
 		return;
 	}
 
@@ -1050,6 +1164,88 @@ io_cb_read_soc(char *buf, size_t len, const void *cb_obj)
 		newlinef(c, 0, "-!!-", "failed to parse message");
 	else
 		irc_recv((struct server *)cb_obj, &m);
+}
+
+void
+io_cb_read_soc_end(const void *cb_obj)
+{
+	/* Draw once for all lines handled from a single socket read */
+
+	UNUSED(cb_obj);
+
+	state_release_idle();
 
 	redraw();
 }
+
+int
+io_cb_idle(void)
+{
+	/* Index the rows of the current channel's lines, and after the
+	 * terminal is resized reflow the rows of other buffers drawn before,
+	 * REFLOW_LINES lines at a time. Buffers are drawn from the lines in
+	 * view until indexed */
+
+	unsigned int cols = io_tty_cols();
+	struct channel *c;
+	struct server *s;
+
+	if (buffer_rows_reflow(&(current_channel()->buffer), cols, REFLOW_LINES))
+		return 1;
+
+	if (!state.reflow)
+		return 0;
+
+	if (buffer_rows_reflow(&(state.default_channel->buffer), cols, REFLOW_LINES))
+		return 1;
+
+	if ((s = state_server_list()->head)) {
+		do {
+			c = s->clist.head;
+
+			do {
+				if (buffer_rows_reflow(&(c->buffer), cols, REFLOW_LINES))
+					return 1;
+
+			} while ((c = c->next) != s->clist.head);
+
+		} while ((s = s->next) != state_server_list()->head);
+	}
+
+	return (state.reflow = 0);
+}
+
+static void
+state_release_idle(void)
+{
+	/* Release the scrollback of channels with no lines added in
+	 * BUFFER_IDLE_RELEASE seconds, other than the current channel,
+	 * moving lines to history. Checked at most once a minute, as
+	 * memory grows only as lines are received */
+
+	static time_t last;
+	struct channel *c;
+	struct server *s;
+	time_t now;
+
+	if (!BUFFER_IDLE_RELEASE || (now = time(NULL)) - last < 60)
+		return;
+
+	last = now;
+
+	if ((s = state_server_list()->head) == NULL)
+		return;
+
+	do {
+		c = s->clist.head;
+
+		do {
+			struct buffer_line *line = buffer_head(&(c->buffer));
+
+			if (c != current_channel() && line && now - line->time >= BUFFER_IDLE_RELEASE)
+				buffer_trim(&(c->buffer));
+
+		} while ((c = c->next) != s->clist.head);
+
+	} while ((s = s->next) != state_server_list()->head);
+}
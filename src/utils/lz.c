@@ -0,0 +1,182 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "src/utils/lz.h"
+
+#define LZ_HASH_BITS 12
+#define LZ_OFFSET_MAX 65535
+
+static inline uint32_t lz_read32(const char*);
+static inline uint32_t lz_hash(const char*);
+static size_t lz_sequence(char*, size_t, size_t, const char*, size_t, size_t, size_t);
+
+static inline uint32_t
+lz_read32(const char *p)
+{
+	uint32_t x;
+
+	memcpy(&x, p, sizeof(x));
+
+	return x;
+}
+
+static inline uint32_t
+lz_hash(const char *p)
+{
+	return (lz_read32(p) * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static size_t
+lz_sequence(char *dst, size_t i, size_t cap, const char *lit, size_t lit_len, size_t offset, size_t match_len)
+{
+	/* Write a sequence at dst + i, returning the index following it, or 0
+	 * if longer than cap. Sequences with a match_len of 0 have no match */
+
+	size_t ml = (match_len ? match_len - LZ_MATCH_MIN : 0);
+	size_t n = 1 + lit_len;
+
+	if (lit_len >= 15)
+		n += (lit_len - 15) / 255 + 1;
+
+	if (match_len)
+		n += 2 + (ml >= 15 ? (ml - 15) / 255 + 1 : 0);
+
+	if (n > cap - i)
+		return 0;
+
+	dst[i++] = (char) (((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+
+	if (lit_len >= 15) {
+		for (n = lit_len - 15; n >= 255; n -= 255)
+			dst[i++] = (char) 255;
+		dst[i++] = (char) n;
+	}
+
+	memcpy(dst + i, lit, lit_len);
+	i += lit_len;
+
+	if (match_len == 0)
+		return i;
+
+	dst[i++] = (char) (offset & 0xff);
+	dst[i++] = (char) (offset >> 8);
+
+	if (ml >= 15) {
+		for (n = ml - 15; n >= 255; n -= 255)
+			dst[i++] = (char) 255;
+		dst[i++] = (char) n;
+	}
+
+	return i;
+}
+
+size_t
+lz_compress(const char *src, size_t len, char *dst, size_t cap)
+{
+	uint32_t table[1 << LZ_HASH_BITS] = {0};
+	size_t anchor = 0;
+	size_t i = 0;
+	size_t j = 0;
+
+	while (i + LZ_MATCH_MIN <= len) {
+
+		uint32_t h = lz_hash(src + i);
+		size_t match = table[h];
+		size_t match_len;
+
+		table[h] = (uint32_t) i;
+
+		if (match >= i || i - match > LZ_OFFSET_MAX || lz_read32(src + match) != lz_read32(src + i)) {
+			/* Skip faster through incompressible data */
+			i += 1 + ((i - anchor) >> 6);
+			continue;
+		}
+
+		for (match_len = LZ_MATCH_MIN; i + match_len < len; match_len++) {
+			if (src[match + match_len] != src[i + match_len])
+				break;
+		}
+
+		if ((j = lz_sequence(dst, j, cap, src + anchor, i - anchor, i - match, match_len)) == 0)
+			return 0;
+
+		i += match_len;
+		anchor = i;
+	}
+
+	return lz_sequence(dst, j, cap, src + anchor, len - anchor, 0, 0);
+}
+
+size_t
+lz_decompress(const char *src, size_t len, char *dst, size_t cap)
+{
+	const unsigned char *p = (const unsigned char *) src;
+	const unsigned char *end = p + len;
+	size_t j = 0;
+
+	for (;;) {
+
+		size_t lit_len;
+		size_t match_len;
+		size_t offset;
+
+		/* Sequences end with literals only */
+		if (p == end)
+			return 0;
+
+		lit_len = *p >> 4;
+		match_len = *p & 0xf;
+		p++;
+
+		if (lit_len == 15) {
+			do {
+				if (p == end)
+					return 0;
+				lit_len += *p;
+			} while (*p++ == 255);
+		}
+
+		if (lit_len > (size_t) (end - p) || lit_len > cap - j)
+			return 0;
+
+		memcpy(dst + j, p, lit_len);
+		p += lit_len;
+		j += lit_len;
+
+		/* Last sequence, literals only */
+		if (p == end)
+			break;
+
+		if (end - p < 2)
+			return 0;
+
+		offset = (size_t) p[0] | ((size_t) p[1] << 8);
+		p += 2;
+
+		if (match_len == 15) {
+			do {
+				if (p == end)
+					return 0;
+				match_len += *p;
+			} while (*p++ == 255);
+		}
+
+		match_len += LZ_MATCH_MIN;
+
+		if (offset == 0 || offset > j || match_len > cap - j)
+			return 0;
+
+		/* Matches may overlap their output */
+		if (offset >= match_len) {
+			memcpy(dst + j, dst + j - offset, match_len);
+			j += match_len;
+		} else {
+			while (match_len--) {
+				dst[j] = dst[j - offset];
+				j++;
+			}
+		}
+	}
+
+	return j;
+}
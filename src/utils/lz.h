@@ -0,0 +1,31 @@
+#ifndef LZ_H
+#define LZ_H
+
+/* LZ77 block compression, in the manner of LZ4
+ *
+ * Compressed blocks are a series of sequences, each a token byte of
+ * literal length and match length nibbles, literal length extension
+ * bytes, literals, a 2 byte little endian match offset, and match length
+ * extension bytes. Nibbles of 15 are extended by following bytes summed
+ * until a byte less than 255. Matches are at least LZ_MATCH_MIN bytes,
+ * at most 65535 bytes back, and the last sequence has literals only
+ *
+ * Compression is greedy with a single entry hash table of 4 byte
+ * prefixes, favouring speed over ratio, as for log-like text */
+
+#include <stddef.h>
+
+#define LZ_MATCH_MIN 4
+
+/* Maximum compressed length of N bytes */
+#define LZ_BOUND(N) ((N) + ((N) / 255) + 16)
+
+/* Compress len bytes of src to dst, returning the compressed length,
+ * or 0 if longer than cap */
+size_t lz_compress(const char*, size_t, char*, size_t);
+
+/* Decompress len bytes of src to dst, returning the decompressed length,
+ * or 0 if malformed or longer than cap */
+size_t lz_decompress(const char*, size_t, char*, size_t);
+
+#endif
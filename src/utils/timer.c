@@ -0,0 +1,177 @@
+#include <string.h>
+
+#include "src/utils/timer.h"
+#include "src/utils/utils.h"
+
+#define TIMER_LVL_MASK (TIMER_LVL_SIZE - 1)
+
+/* Ticks spanned by a slot at level L */
+#define TIMER_SPAN(L) ((uint64_t) 1 << (TIMER_LVL_BITS * (L)))
+
+static uint64_t timer_next_tick(struct timer_wheel*);
+static void timer_cascade(struct timer_wheel*, unsigned, unsigned);
+static void timer_insert(struct timer_wheel*, struct timer*);
+static void timer_tick(struct timer_wheel*);
+static void timer_unlink(struct timer_wheel*, struct timer*);
+
+void
+timer_init(struct timer_wheel *w, uint64_t now)
+{
+	memset(w, 0, sizeof(*w));
+
+	w->now = now;
+}
+
+void
+timer_add(struct timer_wheel *w, struct timer *t, uint64_t expire)
+{
+	if (t->prev)
+		timer_unlink(w, t);
+
+	t->expire = MAX(expire, w->now + 1);
+
+	timer_insert(w, t);
+}
+
+void
+timer_del(struct timer_wheel *w, struct timer *t)
+{
+	if (t->prev)
+		timer_unlink(w, t);
+}
+
+void
+timer_run(struct timer_wheel *w, uint64_t now)
+{
+	/* Advance to each tick at which timers fire or cascade, skipping
+	 * the ticks between */
+
+	uint64_t next;
+
+	while (w->now < now) {
+
+		if ((next = timer_next_tick(w)) > now) {
+			w->now = now;
+			break;
+		}
+
+		w->now = next - 1;
+
+		timer_tick(w);
+	}
+}
+
+int64_t
+timer_next(struct timer_wheel *w, uint64_t now)
+{
+	uint64_t next;
+
+	if ((next = timer_next_tick(w)) == UINT64_MAX)
+		return -1;
+
+	if (next <= now)
+		return 0;
+
+	return (int64_t) MIN(next - now, INT64_MAX);
+}
+
+static uint64_t
+timer_next_tick(struct timer_wheel *w)
+{
+	/* Return the first tick after the last tick run at which a slot
+	 * fires or cascades, the earliest non-empty slot of each level */
+
+	uint64_t next = UINT64_MAX;
+
+	for (unsigned lvl = 0; lvl < TIMER_LVL_N; lvl++) {
+
+		unsigned shift = TIMER_LVL_BITS * lvl;
+
+		if (w->n[lvl] == 0)
+			continue;
+
+		for (uint64_t i = (w->now >> shift) + 1; i <= (w->now >> shift) + TIMER_LVL_SIZE; i++) {
+			if (w->slots[lvl][i & TIMER_LVL_MASK]) {
+				next = MIN(next, i << shift);
+				break;
+			}
+		}
+	}
+
+	return next;
+}
+
+static void
+timer_tick(struct timer_wheel *w)
+{
+	/* Advance one tick, cascading each level whose slot boundary is
+	 * reached, lowest first, then firing the lowest level's slot */
+
+	struct timer *t;
+	uint64_t now = ++w->now;
+
+	for (unsigned lvl = 1; lvl < TIMER_LVL_N && !(now & (TIMER_SPAN(lvl) - 1)); lvl++)
+		timer_cascade(w, lvl, (now >> (TIMER_LVL_BITS * lvl)) & TIMER_LVL_MASK);
+
+	while ((t = w->slots[0][now & TIMER_LVL_MASK])) {
+		timer_unlink(w, t);
+		(*t->f)(t->arg);
+	}
+}
+
+static void
+timer_cascade(struct timer_wheel *w, unsigned lvl, unsigned i)
+{
+	struct timer *t, *next;
+
+	next = w->slots[lvl][i];
+	w->slots[lvl][i] = NULL;
+
+	while ((t = next)) {
+		next = t->next;
+		w->n[lvl]--;
+		timer_insert(w, t);
+	}
+}
+
+static void
+timer_insert(struct timer_wheel *w, struct timer *t)
+{
+	/* Insert at the lowest level spanning the deadline. Deadlines beyond
+	 * the highest level are inserted at its furthest slot, and reinserted
+	 * as it cascades */
+
+	struct timer **slot;
+	uint64_t delta = t->expire - w->now;
+	uint64_t expire = t->expire;
+	unsigned lvl = 0;
+
+	while (lvl < TIMER_LVL_N - 1 && delta >= TIMER_SPAN(lvl + 1))
+		lvl++;
+
+	if (delta >= TIMER_SPAN(TIMER_LVL_N))
+		expire = w->now + TIMER_SPAN(TIMER_LVL_N) - 1;
+
+	slot = &(w->slots[lvl][(expire >> (TIMER_LVL_BITS * lvl)) & TIMER_LVL_MASK]);
+
+	if ((t->next = *slot))
+		t->next->prev = &(t->next);
+
+	t->prev = slot;
+	t->lvl = lvl;
+	*slot = t;
+
+	w->n[lvl]++;
+}
+
+static void
+timer_unlink(struct timer_wheel *w, struct timer *t)
+{
+	if ((*t->prev = t->next))
+		t->next->prev = t->prev;
+
+	t->next = NULL;
+	t->prev = NULL;
+
+	w->n[t->lvl]--;
+}
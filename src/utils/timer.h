@@ -0,0 +1,62 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+/* Hierarchical timer wheel
+ *
+ * Timers expire at a deadline in ticks of a monotonic clock, e.g.
+ * milliseconds, and are kept in TIMER_LVL_N levels of TIMER_LVL_SIZE
+ * slots, each level spanning TIMER_LVL_SIZE times the level below.
+ * Timers are added to the lowest level spanning their deadline and
+ * cascade to lower levels as the wheel advances, firing from the lowest
+ *
+ * Adding and deleting timers is O(1), advancing the wheel is O(1) per
+ * tick elapsed with pending timers, with ticks skipped while the levels
+ * below the next cascade are empty
+ *
+ * Timer callbacks are made from timer_run, and can add or delete timers
+ */
+
+#include <stdint.h>
+
+#define TIMER_LVL_BITS 6
+#define TIMER_LVL_SIZE (1U << TIMER_LVL_BITS)
+#define TIMER_LVL_N    5
+
+struct timer
+{
+	struct timer *next;
+	struct timer **prev; /* NULL if not pending */
+	uint64_t expire;
+	void (*f)(void*);
+	void *arg;
+	unsigned lvl;
+};
+
+struct timer_wheel
+{
+	struct timer *slots[TIMER_LVL_N][TIMER_LVL_SIZE];
+	uint64_t now; /* last tick run */
+	unsigned n[TIMER_LVL_N];
+};
+
+void timer_init(struct timer_wheel*, uint64_t);
+
+/* Add a timer, or reschedule a pending timer, expiring after the
+ * given tick. Deadlines at or before the last tick run expire on
+ * the next tick */
+void timer_add(struct timer_wheel*, struct timer*, uint64_t);
+
+/* Delete a timer, if pending */
+void timer_del(struct timer_wheel*, struct timer*);
+
+/* Run timers expiring up to and including the given tick */
+void timer_run(struct timer_wheel*, uint64_t);
+
+/* Ticks from the given tick until the wheel must next be run, or -1 if
+ * no timers are pending. The wheel may be run before any timer expires,
+ * to cascade timers between levels */
+int64_t timer_next(struct timer_wheel*, uint64_t);
+
+#define timer_pending(T) ((T)->prev != NULL)
+
+#endif
@@ -1,3 +1,4 @@
+#include <ctype.h>
 #include <errno.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -241,7 +242,7 @@ irc_message_parse(struct irc_message *m, char *buf, size_t len)
 {
 	/* RFC 2812, section 2.3.1
 	 *
-	 * message    =   [ ":" prefix SPACE ] command [ params ] crlf
+	 * message    =   [ "@" tags SPACE ] [ ":" prefix SPACE ] command [ params ] crlf
 	 * prefix     =   servername / ( nickname [ [ "!" user ] "@" host ] )
 	 * command    =   1*letter / 3digit
 	 * params     =   *14( SPACE middle ) [ SPACE ":" trailing ]
@@ -254,6 +255,10 @@ irc_message_parse(struct irc_message *m, char *buf, size_t len)
 	 *
 	 * SPACE      =   %x20        ; space character
 	 * crlf       =   %x0D %x0A   ; "carriage return" "linefeed"
+	 *
+	 * IRCv3 message-tags
+	 *
+	 * tags       =   tag *[ ";" tag ]
 	 */
 
 	UNUSED(len);
@@ -263,6 +268,28 @@ irc_message_parse(struct irc_message *m, char *buf, size_t len)
 	if (!str_trim(&buf))
 		return 0;
 
+	if (*buf == '@') {
+
+		/* Tags, unparsed:
+		 *  =  @key[=value][;key[=value]]...
+		 */
+
+		buf++;
+
+		m->tags = buf;
+
+		while (*buf && *buf != ' ')
+			buf++;
+
+		m->len_tags = buf - m->tags;
+
+		if (*buf == ' ')
+			*buf++ = 0;
+
+		if (!str_trim(&buf))
+			return 0;
+	}
+
 	if (*buf == ':') {
 
 		/* Prefix:
@@ -307,6 +334,22 @@ irc_message_parse(struct irc_message *m, char *buf, size_t len)
 
 	m->len_command = buf - m->command;
 
+	/* Numeric replies are resolved to their code once here, and
+	 * commands otherwise starting with a digit are malformed */
+	if (isdigit((unsigned char) *m->command)) {
+
+		if (m->len_command != 3)
+			return 0;
+
+		for (const char *p = m->command; p < buf; p++) {
+
+			if (!isdigit((unsigned char) *p))
+				return 0;
+
+			m->code = (m->code * 10) + (*p - '0');
+		}
+	}
+
 	if (*buf == ' ')
 		*buf++ = 0;
 
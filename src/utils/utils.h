@@ -49,9 +49,12 @@ struct irc_message
 	const char *command;
 	const char *from;
 	const char *host;
+	const char *tags;
 	size_t len_command;
 	size_t len_from;
 	size_t len_host;
+	size_t len_tags;
+	unsigned code;
 	unsigned n_params;
 	unsigned split : 1;
 };
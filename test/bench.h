@@ -0,0 +1,213 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/* bench.h -- benchmark framework for rirc
+ *
+ * Benchmark functions are called with an iteration count, and are rerun
+ * with increasing counts until a run takes at least BENCH_TIME_MIN
+ * milliseconds. Results are reported on stderr, so the output of code
+ * under benchmark can be discarded
+ *
+ * Calls to malloc, calloc and realloc made after including bench.h are
+ * counted, and reported per iteration
+ *
+ * Results are compared against a baseline, and can be saved as one, by
+ * setting in the environment:
+ *
+ *   - BENCH_BASELINE   - file of results to report changes against
+ *   - BENCH_SAVE       - file to append results to
+ *
+ * e.g.:
+ *
+ *   BENCH_SAVE=bench.txt make bench
+ *   BENCH_BASELINE=bench.txt make bench
+ *
+ * Defines the following macros:
+ *
+ *   - BENCHMARK(X)     - benchmark entry, void X(size_t)
+ *   - bench_items(N)   - set the number of items processed per iteration,
+ *                        reported as items per second
+ *   - bench_bytes(N)   - set the number of bytes processed per iteration,
+ *                        reported as GB per second
+ *   - bench_abort(M)   - abort the benchmark run with message
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef BENCH_TIME_MIN
+#define BENCH_TIME_MIN 500
+#endif
+
+#define BENCHMARK(X) { &(X), #X }
+
+struct benchmark
+{
+	void (*bm_ptr)(size_t);
+	const char *bm_str;
+};
+
+static double _bench_bytes_;
+static double _bench_items_;
+static size_t _bench_allocs_;
+
+#define run_benchmarks(X) \
+	_run_benchmarks_(__FILE__, X, sizeof(X) / sizeof(X[0]))
+
+#define bench_bytes(N) \
+	do { _bench_bytes_ = (double)(N); } while (0)
+
+#define bench_items(N) \
+	do { _bench_items_ = (double)(N); } while (0)
+
+#define bench_abort(M) \
+	do { \
+		fprintf(stderr, "%s:%d: " M "\n", __FILE__, __LINE__); \
+		exit(EXIT_FAILURE); \
+	} while (0)
+
+static inline void*
+_bench_malloc_(size_t size)
+{
+	_bench_allocs_++;
+	return malloc(size);
+}
+
+static inline void*
+_bench_calloc_(size_t nmemb, size_t size)
+{
+	_bench_allocs_++;
+	return calloc(nmemb, size);
+}
+
+static inline void*
+_bench_realloc_(void *ptr, size_t size)
+{
+	_bench_allocs_++;
+	return realloc(ptr, size);
+}
+
+static inline uint64_t
+_bench_time_(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+		bench_abort("clock_gettime");
+
+	return ((uint64_t) ts.tv_sec * 1000000000) + (uint64_t) ts.tv_nsec;
+}
+
+static inline int
+_bench_baseline_(const char *filename, const char *name, double *ns, double *allocs)
+{
+	/* Find the last result saved for a benchmark, returning non-zero if found */
+
+	char buf[256];
+	char key[256];
+	int found = 0;
+	const char *path;
+	FILE *f;
+
+	if ((path = getenv("BENCH_BASELINE")) == NULL || (f = fopen(path, "r")) == NULL)
+		return 0;
+
+	snprintf(key, sizeof(key), "%s:%s", filename, name);
+
+	while (fgets(buf, sizeof(buf), f)) {
+
+		char k[256];
+		double x, y;
+
+		if (sscanf(buf, "%255s %lf %lf", k, &x, &y) == 3 && !strcmp(k, key)) {
+			*ns = x;
+			*allocs = y;
+			found = 1;
+		}
+	}
+
+	fclose(f);
+
+	return found;
+}
+
+static inline int
+_run_benchmarks_(const char *filename, struct benchmark benchmarks[], size_t len)
+{
+	struct benchmark *bm;
+	const char *save;
+	FILE *f = NULL;
+
+	if ((save = getenv("BENCH_SAVE")) && (f = fopen(save, "a")) == NULL)
+		bench_abort("BENCH_SAVE");
+
+	fprintf(stderr, "%s...\n", filename);
+
+	for (bm = benchmarks; len--; bm++) {
+
+		double allocs, base_ns, base_allocs;
+		size_t n = 1;
+		uint64_t t;
+
+		for (;;) {
+
+			_bench_allocs_ = 0;
+			_bench_bytes_ = 0;
+			_bench_items_ = 0;
+
+			t = _bench_time_();
+			(*bm->bm_ptr)(n);
+			t = _bench_time_() - t;
+
+			if (t >= (uint64_t) BENCH_TIME_MIN * 1000000 || n > SIZE_MAX / 100)
+				break;
+
+			/* Scale towards the minimum time, growing at most 100x per run */
+			if (t == 0 || (double) n * BENCH_TIME_MIN * 1200000.0 / t > n * 100.0)
+				n *= 100;
+			else
+				n = (size_t) ((double) n * BENCH_TIME_MIN * 1200000.0 / t) + 1;
+		}
+
+		allocs = (double) _bench_allocs_ / n;
+
+		fprintf(stderr, "  %-40s %10zu %14.1f ns/op", bm->bm_str, n, (double) t / n);
+
+		if (allocs)
+			fprintf(stderr, " %10.2f allocs/op", allocs);
+
+		if (_bench_bytes_)
+			fprintf(stderr, " %14.2f GB/s", (_bench_bytes_ * n) / t);
+
+		if (_bench_items_)
+			fprintf(stderr, " %14.0f items/s", (_bench_items_ * n * 1e9) / t);
+
+		if (_bench_baseline_(filename, bm->bm_str, &base_ns, &base_allocs)) {
+
+			fprintf(stderr, " %+7.1f%%", (((double) t / n) - base_ns) * 100.0 / base_ns);
+
+			if (allocs != base_allocs)
+				fprintf(stderr, " (allocs/op was %.2f)", base_allocs);
+		}
+
+		fprintf(stderr, "\n");
+
+		if (f)
+			fprintf(f, "%s:%s %.1f %.2f\n", filename, bm->bm_str, (double) t / n, allocs);
+	}
+
+	if (f && fclose(f))
+		bench_abort("BENCH_SAVE");
+
+	return EXIT_SUCCESS;
+}
+
+/* Allocations counted by the code under benchmark */
+#define malloc(S)     _bench_malloc_((S))
+#define calloc(N, S)  _bench_calloc_((N), (S))
+#define realloc(P, S) _bench_realloc_((P), (S))
+
+#endif
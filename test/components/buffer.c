@@ -1,7 +1,12 @@
 #include <limits.h>
+#include <signal.h>
+#include <sys/resource.h>
 
 #include "test/test.h"
 #include "src/components/buffer.c"
+#include "src/components/history.c"
+#include "src/components/search.c"
+#include "src/utils/lz.c"
 #include "src/utils/utils.c"
 
 static char*
@@ -23,6 +28,15 @@ _buffer_newline(struct buffer *b, const char *t)
 	buffer_newline(b, BUFFER_LINE_OTHER, "", t, 0, strlen(t), 0);
 }
 
+static void
+_buffer_fill(struct buffer *b)
+{
+	/* Fill a buffer, allocating its lines before indices are set directly */
+
+	for (unsigned i = 0; i < b->lines_max; i++)
+		_buffer_newline(b, _fmt_int((int) i));
+}
+
 static void
 test_buffer(void)
 {
@@ -58,11 +72,11 @@ test_buffer_head(void)
 
 	assert_ptr_null(buffer_head(&b));
 
-	for (i = 0; i < BUFFER_LINES_MAX + 1; i++)
+	for (i = 0; i < BUFFER_LINES + 1; i++)
 		_buffer_newline(&b, _fmt_int(i + 1));
 
-	assert_strcmp(buffer_head(&b)->text, _fmt_int(BUFFER_LINES_MAX + 1));
-	assert_eq(buffer_size(&b), BUFFER_LINES_MAX);
+	assert_strcmp(buffer_head(&b)->text, _fmt_int(BUFFER_LINES + 1));
+	assert_eq(buffer_size(&b), BUFFER_LINES);
 }
 
 static void
@@ -77,16 +91,16 @@ test_buffer_tail(void)
 
 	assert_ptr_null(buffer_tail(&b));
 
-	for (i = 0; i < BUFFER_LINES_MAX; i++)
+	for (i = 0; i < BUFFER_LINES; i++)
 		_buffer_newline(&b, _fmt_int(i + 1));
 
 	assert_strcmp(buffer_tail(&b)->text, _fmt_int(1));
-	assert_eq(buffer_size(&b), BUFFER_LINES_MAX);
+	assert_eq(buffer_size(&b), BUFFER_LINES);
 
 	_buffer_newline(&b, _fmt_int(i + 1));
 
 	assert_strcmp(buffer_tail(&b)->text, _fmt_int(2));
-	assert_eq(buffer_size(&b), BUFFER_LINES_MAX);
+	assert_eq(buffer_size(&b), BUFFER_LINES);
 }
 
 static void
@@ -104,6 +118,8 @@ test_buffer_line(void)
 	assert_ptr_null(buffer_line(&b, b.tail));
 	assert_ptr_null(buffer_line(&b, b.scrollback));
 
+	_buffer_fill(&b);
+
 	/* For any buffer line retrieval, these conditions should always hold */
 	#define CHECK_BUFFER(B) \
 	    assert_fatal(buffer_line(&(B), (B).tail - 1)); \
@@ -120,7 +136,7 @@ test_buffer_line(void)
 	 * a, c : invalid */
 
 	b.tail = 1;
-	b.head = 1 + BUFFER_LINES_MAX;
+	b.head = 1 + BUFFER_LINES;
 	CHECK_BUFFER(b);
 
 	/* Inverted case:
@@ -131,7 +147,7 @@ test_buffer_line(void)
 	 * a, c : valid */
 
 	b.tail = UINT_MAX - 1;
-	b.head = UINT_MAX - 1 + BUFFER_LINES_MAX;
+	b.head = UINT_MAX - 1 + BUFFER_LINES;
 	CHECK_BUFFER(b);
 
 	/* Edge case, head is 0
@@ -140,7 +156,7 @@ test_buffer_line(void)
 	 * a : invalid
 	 * b : valid */
 
-	b.tail = 0 - BUFFER_LINES_MAX;
+	b.tail = 0 - BUFFER_LINES;
 	b.head = 0;
 	CHECK_BUFFER(b);
 
@@ -150,7 +166,7 @@ test_buffer_line(void)
 	 * a : invalid
 	 * b : valid */
 
-	b.tail = UINT_MAX - BUFFER_LINES_MAX;
+	b.tail = UINT_MAX - BUFFER_LINES;
 	b.head = UINT_MAX;
 	CHECK_BUFFER(b);
 
@@ -161,7 +177,7 @@ test_buffer_line(void)
 	 * b : invalid */
 
 	b.tail = 0;
-	b.head = 0 + BUFFER_LINES_MAX;
+	b.head = 0 + BUFFER_LINES;
 	CHECK_BUFFER(b);
 
 	/* Edge case, tail is UINT_MAX
@@ -171,7 +187,7 @@ test_buffer_line(void)
 	 * c    : invalid */
 
 	b.tail = UINT_MAX;
-	b.head = UINT_MAX + BUFFER_LINES_MAX;
+	b.head = UINT_MAX + BUFFER_LINES;
 	CHECK_BUFFER(b);
 
 	#undef CHECK_BUFFER
@@ -212,7 +228,7 @@ test_buffer_scrollback(void)
 	assert_strcmp(buffer_line(&b, b.scrollback)->text, "b");
 
 	/* Buffer scrollback stays locked to the buffer tail when incrementing */
-	b.head = b.tail + BUFFER_LINES_MAX;
+	b.head = b.tail + BUFFER_LINES;
 	assert_true(buffer_full(&b));
 
 	_buffer_newline(&b, "e");
@@ -230,9 +246,10 @@ test_buffer_scrollback_status(void)
 	struct buffer b;
 
 	buffer(&b);
+	_buffer_fill(&b);
 
-	b.head = (BUFFER_LINES_MAX / 2) - 1;
-	b.tail = UINT_MAX - (BUFFER_LINES_MAX / 2);
+	b.head = (BUFFER_LINES / 2) - 1;
+	b.tail = UINT_MAX - (BUFFER_LINES / 2);
 	b.scrollback = b.tail;
 
 	assert_true(buffer_full(&b));
@@ -240,7 +257,7 @@ test_buffer_scrollback_status(void)
 	b.scrollback = b.tail;
 	assert_ueq((100 * buffer_scrollback_status(&b)), 100);
 
-	b.scrollback = b.tail + (BUFFER_LINES_MAX / 2);
+	b.scrollback = b.tail + (BUFFER_LINES / 2);
 	assert_ueq((100 * buffer_scrollback_status(&b)), 50);
 
 	b.scrollback = b.head - 1;
@@ -255,23 +272,24 @@ test_buffer_index_overflow(void)
 	struct buffer b;
 
 	buffer(&b);
+	_buffer_fill(&b);
 
 	b.head = UINT_MAX;
 	b.tail = UINT_MAX - 1;
 	b.scrollback = b.tail;
 
 	assert_eq(buffer_size(&b), 1);
-	assert_eq(BUFFER_MASK(b.head), (BUFFER_LINES_MAX - 1));
+	assert_eq(BUFFER_MASK(&b, b.head), (BUFFER_LINES - 1));
 
 	_buffer_newline(&b, _fmt_int(0));
 
 	assert_eq(buffer_size(&b), 2);
-	assert_eq(BUFFER_MASK(b.head), 0);
+	assert_eq(BUFFER_MASK(&b, b.head), 0);
 
 	_buffer_newline(&b, _fmt_int(-1));
 
 	assert_eq(buffer_size(&b), 3);
-	assert_strcmp(b.buffer_lines[0].text, _fmt_int(-1));
+	assert_strcmp(BUFFER_LINE(&b, 0)->text, _fmt_int(-1));
 }
 
 static void
@@ -307,19 +325,19 @@ test_buffer_line_overlength(void)
 
 	_buffer_newline(&b, text);
 
-	assert_ueq(b.buffer_lines[0].text_len, TEXT_LENGTH_MAX);
-	assert_ueq(b.buffer_lines[2].text_len, TEXT_LENGTH_MAX / 2);
+	assert_ueq(BUFFER_LINE(&b, 0)->text_len, TEXT_LENGTH_MAX);
+	assert_ueq(BUFFER_LINE(&b, 2)->text_len, TEXT_LENGTH_MAX / 2);
 
 	assert_eq(buffer_size(&b), 3);
 
-	assert_eq(b.buffer_lines[0].text[0], 'a');
-	assert_eq(b.buffer_lines[0].text[TEXT_LENGTH_MAX - 1], 'A');
+	assert_eq(BUFFER_LINE(&b, 0)->text[0], 'a');
+	assert_eq(BUFFER_LINE(&b, 0)->text[TEXT_LENGTH_MAX - 1], 'A');
 
-	assert_eq(b.buffer_lines[1].text[0], 'b');
-	assert_eq(b.buffer_lines[1].text[TEXT_LENGTH_MAX - 1], 'B');
+	assert_eq(BUFFER_LINE(&b, 1)->text[0], 'b');
+	assert_eq(BUFFER_LINE(&b, 1)->text[TEXT_LENGTH_MAX - 1], 'B');
 
-	assert_eq(b.buffer_lines[2].text[0], 'c');
-	assert_eq(b.buffer_lines[2].text[TEXT_LENGTH_MAX / 2 - 1], 'C');
+	assert_eq(BUFFER_LINE(&b, 2)->text[0], 'c');
+	assert_eq(BUFFER_LINE(&b, 2)->text[TEXT_LENGTH_MAX / 2 - 1], 'C');
 }
 
 static void
@@ -362,6 +380,90 @@ test_buffer_line_rows(void)
 	assert_eq(buffer_line_rows(buffer_head(&b), 1), 1);
 }
 
+static void
+test_buffer_line_wrap(void)
+{
+	/* Test rows of buffer lines sliced from cached wraps, as wrapped by word_wrap */
+
+	const char *texts[] = {
+		"aa bb cc",
+		"  leading and trailing spaces  ",
+		"a   long   run   of   spaces   between   words",
+		"averyveryverylongwordwithoutspaces and then some short words after it",
+		" x y z",
+		"x",
+	};
+
+	struct buffer b;
+
+	buffer(&b);
+
+	for (size_t i = 0; i < ELEMS(texts); i++) {
+
+		_buffer_newline(&b, texts[i]);
+
+		struct buffer_line *line = buffer_head(&b);
+
+		for (unsigned int w = 1; w <= (unsigned int) line->text_len + 1; w++) {
+
+			char *starts[TEXT_LENGTH_MAX];
+			char *ends[TEXT_LENGTH_MAX];
+			char *p = line->text;
+			char *end = line->text + line->text_len;
+			unsigned int row, rows = buffer_line_rows(line, w);
+
+			/* Rows in turn */
+			for (row = 0; *p; row++) {
+
+				char *row_end;
+
+				starts[row] = p;
+				ends[row] = word_wrap((int) w, &p, end);
+
+				assert_true(row < rows);
+				assert_ptr_eq(buffer_line_wrap(line, w, row, &row_end), starts[row]);
+				assert_ptr_eq(row_end, ends[row]);
+			}
+
+			assert_eq(row, rows);
+
+			/* Rows in reverse, as when scrolling */
+			while (row--) {
+
+				char *row_end;
+
+				assert_ptr_eq(buffer_line_wrap(line, w, row, &row_end), starts[row]);
+				assert_ptr_eq(row_end, ends[row]);
+			}
+		}
+	}
+
+	/* Rows of a line added to a slot reused aren't wrapped from its last line */
+	char *end;
+	struct buffer_line *line;
+
+	buffer_lines_set(&b, 1);
+
+	_buffer_newline(&b, "aaaaaaaaaa");
+	line = buffer_head(&b);
+
+	assert_ptr_eq(buffer_line_wrap(line, 1, 5, &end), line->text + 5);
+
+	do {
+		_buffer_newline(&b, "bb bb bb bb bb");
+	} while (buffer_head(&b) != line);
+
+	assert_ptr_eq(buffer_line_wrap(line, 1, 6, &end), line->text + 9);
+	assert_ptr_eq(end, line->text + 10);
+
+	/* Empty lines have an empty row */
+
+	_buffer_newline(&b, "");
+
+	assert_ptr_eq(buffer_line_wrap(buffer_head(&b), 1, 0, &end), buffer_head(&b)->text);
+	assert_ptr_eq(end, buffer_head(&b)->text);
+}
+
 static void
 test_buffer_newline_prefix(void)
 {
@@ -433,6 +535,678 @@ test_buffer_newline_prefix(void)
 	assert_eq(line->from[FROM_LENGTH_MAX - 1], 'b');
 }
 
+static unsigned
+_buffer_chunks(struct buffer *b)
+{
+	unsigned n = 0;
+
+	for (struct buffer_chunk *chunk = b->chunk_head; chunk; chunk = chunk->next)
+		n++;
+
+	return n;
+}
+
+static void
+test_buffer_arena(void)
+{
+	/* Test line text is stored in the arena, and reclaimed as lines are evicted */
+
+	char text[TEXT_LENGTH_MAX + 1];
+	unsigned i;
+	struct buffer b;
+
+	buffer(&b);
+
+	memset(text, 'x', sizeof(text) - 1);
+	text[sizeof(text) - 1] = 0;
+
+	for (i = 0; i < BUFFER_LINES; i++)
+		_buffer_newline(&b, text);
+
+	assert_true(_buffer_chunks(&b) >= (BUFFER_LINES * TEXT_LENGTH_MAX) / BUFFER_CHUNK_SIZE);
+
+	/* Long lines evicted by short lines release their chunks */
+	for (i = 0; i < BUFFER_LINES; i++)
+		_buffer_newline(&b, _fmt_int(i));
+
+	assert_true(_buffer_chunks(&b) <= 2);
+	assert_true(b.chunk_spare != NULL);
+
+	for (i = 0; i < BUFFER_LINES * 4; i++)
+		_buffer_newline(&b, _fmt_int(i));
+
+	assert_true(_buffer_chunks(&b) <= 2);
+
+	assert_strcmp(buffer_tail(&b)->text, _fmt_int(BUFFER_LINES * 3));
+	assert_strcmp(buffer_head(&b)->text, _fmt_int(BUFFER_LINES * 4 - 1));
+
+	for (i = b.tail; i != b.head; i++) {
+		assert_strcmp(buffer_line(&b, i)->from, "");
+		assert_strcmp(buffer_line(&b, i)->text, _fmt_int((int) (i - b.tail) + BUFFER_LINES * 3));
+	}
+
+	buffer_free(&b);
+}
+
+static void
+test_buffer_blocks(void)
+{
+	/* Test line headers are allocated in blocks as lines are added */
+
+	unsigned i;
+	struct buffer b;
+
+	buffer(&b);
+
+	assert_ptr_null(b.blocks);
+
+	_buffer_newline(&b, "a");
+
+	assert_eq(b.mask, BUFFER_BLOCK_LINES - 1);
+	assert_true(b.blocks[0] != NULL);
+
+	for (i = 1; i < BUFFER_BLOCK_LINES; i++)
+		_buffer_newline(&b, _fmt_int((int) i));
+
+	assert_eq(b.mask, BUFFER_BLOCK_LINES - 1);
+
+	/* Ring grows when full */
+	_buffer_newline(&b, "b");
+
+	assert_eq(b.mask, BUFFER_BLOCK_LINES * 2 - 1);
+	assert_true(b.blocks[1] != NULL);
+	assert_strcmp(buffer_tail(&b)->text, "a");
+	assert_strcmp(buffer_head(&b)->text, "b");
+
+	/* Freed buffers are empty, with no lines allocated */
+	buffer_free(&b);
+
+	assert_eq(buffer_size(&b), 0);
+	assert_ptr_null(buffer_head(&b));
+	assert_ptr_null(b.chunk_head);
+	assert_ptr_null(b.blocks);
+
+	_buffer_newline(&b, "c");
+
+	assert_strcmp(buffer_head(&b)->text, "c");
+
+	buffer_free(&b);
+}
+
+static void
+_check_lines(struct buffer *b, unsigned n, unsigned last)
+{
+	/* Check a buffer holds lines [last - n, last) in order */
+
+	assert_eq(buffer_size(b), n);
+
+	for (unsigned i = 0; i < n; i++)
+		assert_strcmp(buffer_line(b, b->tail + i)->text, _fmt_int((int) (last - n + i)));
+}
+
+static void
+test_buffer_lines_set(void)
+{
+	/* Test setting the lines kept by a buffer, growing and shrinking the
+	 * ring with lines in order after the head and tail have wrapped */
+
+	struct buffer_line *line;
+	unsigned i = 0;
+	struct buffer b;
+
+	buffer(&b);
+	buffer_lines_set(&b, 100);
+
+	for (; i < 250; i++)
+		_buffer_newline(&b, _fmt_int((int) i));
+
+	assert_eq(b.mask, 127);
+	_check_lines(&b, 100, i);
+
+	/* Grow, with the head block sharing the tail block */
+	buffer_lines_set(&b, 1000);
+
+	assert_eq(b.mask, 127);
+	_check_lines(&b, 100, i);
+
+	for (; i < 278; i++)
+		_buffer_newline(&b, _fmt_int((int) i));
+
+	assert_eq(b.mask, 127);
+	_check_lines(&b, 128, i);
+
+	line = buffer_tail(&b);
+
+	_buffer_newline(&b, _fmt_int((int) i++));
+
+	assert_eq(b.mask, 255);
+	_check_lines(&b, 129, i);
+
+	/* Lines not in the shared block are remapped, not copied */
+	assert_ptr_eq(buffer_tail(&b), line);
+
+	for (; i < 3000; i++)
+		_buffer_newline(&b, _fmt_int((int) i));
+
+	assert_eq(b.mask, 1023);
+	_check_lines(&b, 1000, i);
+
+	/* Shrink, evicting lines from the tail, with the head block
+	 * sharing the tail block once shrunk */
+	b.scrollback = b.tail;
+
+	buffer_lines_set(&b, 125);
+
+	assert_eq(b.mask, 127);
+	assert_eq(b.scrollback, b.tail);
+	_check_lines(&b, 125, i);
+
+	for (; i < 3100; i++)
+		_buffer_newline(&b, _fmt_int((int) i));
+
+	assert_eq(b.mask, 127);
+	_check_lines(&b, 125, i);
+
+	buffer_lines_set(&b, 1);
+
+	assert_eq(b.mask, BUFFER_BLOCK_LINES - 1);
+	_check_lines(&b, 1, i);
+
+	_buffer_newline(&b, _fmt_int((int) i++));
+
+	_check_lines(&b, 1, i);
+
+	/* Freed buffers keep their lines set */
+	buffer_free(&b);
+
+	assert_eq(b.lines_max, 1);
+
+	assert_fatal(buffer_lines_set(&b, 0));
+	assert_fatal(buffer_lines_set(&b, BUFFER_LINES_MAX + 1));
+}
+
+static void
+test_buffer_history(void)
+{
+	/* Test lines evicted to history are indexed below the tail */
+
+	unsigned i;
+	struct buffer b;
+
+	buffer(&b);
+	buffer_lines_set(&b, 100);
+	history_init(&b.history, HISTORY_SEGMENT_SIZE);
+
+	for (i = 0; i < 300; i++)
+		_buffer_newline(&b, _fmt_int((int) i));
+
+	assert_eq(buffer_size(&b), 100);
+	assert_eq(b.history.lines, 200);
+
+	assert_strcmp(buffer_tail(&b)->text, "0");
+	assert_strcmp(buffer_head(&b)->text, "299");
+	assert_strcmp(buffer_line(&b, b.tail)->text, "200");
+	assert_strcmp(buffer_line(&b, b.tail - 1)->text, "199");
+	assert_strcmp(buffer_line(&b, b.tail - 200)->text, "0");
+	assert_ptr_eq(buffer_line(&b, b.tail - 200), buffer_tail(&b));
+
+	assert_fatal(buffer_line(&b, b.tail - 201));
+	assert_fatal(buffer_line(&b, b.head));
+
+	/* Scrollback isn't locked to the tail with lines evicted to history */
+	b.scrollback = b.tail;
+
+	_buffer_newline(&b, "300");
+
+	assert_strcmp(buffer_line(&b, b.scrollback)->text, "200");
+	assert_ueq((100 * buffer_scrollback_status(&b)), 33);
+
+	b.scrollback = b.tail - b.history.lines;
+	assert_ueq((100 * buffer_scrollback_status(&b)), 100);
+
+	/* Freed buffers keep their history enabled */
+	buffer_free(&b);
+
+	assert_eq(b.history.lines, 0);
+	assert_ptr_null(buffer_tail(&b));
+	assert_eq(b.history.max, HISTORY_SEGMENT_SIZE);
+}
+
+static void
+test_buffer_history_space(void)
+{
+	/* Test the scrollback in a history lost on error follows the tail */
+
+	unsigned i, n;
+	struct buffer b;
+	struct rlimit limit, limit_old;
+	void (*handler)(int);
+
+	buffer(&b);
+	buffer_lines_set(&b, 100);
+	history_init(&b.history, HISTORY_SEGMENT_SIZE * 4);
+
+	for (i = 0; i < 110; i++)
+		_buffer_newline(&b, _fmt_int((int) i));
+
+	assert_eq(b.history.lines, 10);
+
+	b.scrollback = b.tail - 5;
+
+	if (getrlimit(RLIMIT_FSIZE, &limit_old) < 0)
+		fail_test("getrlimit");
+
+	limit = limit_old;
+	limit.rlim_cur = HISTORY_SEGMENT_SIZE / 2;
+
+	if ((handler = signal(SIGXFSZ, SIG_IGN)) == SIG_ERR)
+		fail_test("signal");
+
+	if (setrlimit(RLIMIT_FSIZE, &limit) < 0)
+		fail_test("setrlimit");
+
+	while (b.history.max && i < 100000)
+		_buffer_newline(&b, _fmt_int((int) i++));
+
+	setrlimit(RLIMIT_FSIZE, &limit_old);
+	signal(SIGXFSZ, handler);
+
+	assert_eq(b.history.max, 0);
+	assert_eq(b.history.lines, 0);
+	assert_eq(b.scrollback, b.tail);
+
+	_buffer_newline(&b, "line");
+
+	assert_eq(b.scrollback, b.tail);
+	assert_strcmp(buffer_head(&b)->text, "line");
+
+	/* Lines lost aren't found */
+	n = b.head;
+	assert_eq(buffer_search(&b, "105", &n), 0);
+
+	buffer_free(&b);
+}
+
+static void
+test_buffer_trim(void)
+{
+	/* Test lines of a buffer trimmed survive in its history */
+
+	unsigned i, n;
+	struct buffer b;
+
+	buffer(&b);
+
+	for (i = 0; i < 1000; i++)
+		_buffer_newline(&b, _fmt_int((int) i));
+
+	/* Buffers without history aren't trimmed */
+	assert_eq(buffer_trim(&b), -1);
+	assert_eq(buffer_size(&b), 1000);
+
+	history_init(&b.history, HISTORY_SEGMENT_SIZE);
+
+	b.scrollback = b.head - 1;
+
+	assert_eq(buffer_trim(&b), 0);
+	assert_eq(buffer_size(&b), 1);
+	assert_eq(b.history.lines, 999);
+	assert_eq(_buffer_chunks(&b), 1);
+	assert_ptr_null(b.chunk_spare);
+	assert_eq(b.mask + 1, BUFFER_BLOCK_LINES);
+	assert_eq(b.lines_max, BUFFER_LINES);
+
+	for (i = 0; i < 1000; i++)
+		assert_strcmp(buffer_line(&b, b.tail - b.history.lines + i)->text, _fmt_int((int) i));
+
+	assert_strcmp(buffer_tail(&b)->text, "0");
+	assert_strcmp(buffer_head(&b)->text, "999");
+
+	n = b.head;
+	assert_eq(buffer_search(&b, "500", &n), 1);
+	assert_eq(n, b.tail - b.history.lines + 500);
+
+	/* Lines are added after lines trimmed, scrollback following */
+	_buffer_newline(&b, "1000");
+
+	assert_eq(b.scrollback, b.head - 1);
+	assert_strcmp(buffer_line(&b, b.head - 2)->text, "999");
+	assert_strcmp(buffer_head(&b)->text, "1000");
+
+	buffer_free(&b);
+}
+
+static void
+test_buffer_trim_files(void)
+{
+	/* Test buffers unable to open a history while HISTORY_FILES are open
+	 * aren't trimmed */
+
+	char from[] = "nick";
+	char text[] = "text";
+	unsigned i;
+	struct buffer b;
+	struct buffer_line line = {0};
+	struct history h[HISTORY_FILES];
+
+	line.from = from;
+	line.text = text;
+	line.from_len = 4;
+	line.text_len = 4;
+
+	for (i = 0; i < HISTORY_FILES; i++) {
+		history_init(&h[i], HISTORY_SEGMENT_SIZE);
+		assert_eq(history_add(&h[i], &line), 0);
+	}
+
+	buffer(&b);
+	history_init(&b.history, HISTORY_SEGMENT_SIZE);
+
+	for (i = 0; i < 500; i++)
+		_buffer_newline(&b, _fmt_int((int) i));
+
+	assert_eq(buffer_trim(&b), -1);
+	assert_eq(buffer_size(&b), 500);
+	assert_eq(b.history.lines, 0);
+
+	history_free(&h[0]);
+
+	assert_eq(buffer_trim(&b), 0);
+	assert_eq(buffer_size(&b), 1);
+	assert_eq(b.history.lines, 499);
+	assert_strcmp(buffer_line(&b, b.tail - b.history.lines)->text, "0");
+
+	for (i = 1; i < HISTORY_FILES; i++)
+		history_free(&h[i]);
+
+	buffer_free(&b);
+}
+
+static void
+test_buffer_search(void)
+{
+	/* Test searching lines, newest first, in the buffer and its history */
+
+	char text[64];
+	unsigned i;
+	struct buffer b;
+
+	buffer(&b);
+	buffer_lines_set(&b, 100);
+	history_init(&b.history, HISTORY_SEGMENT_SIZE);
+
+	for (i = 0; i < 300; i++) {
+		snprintf(text, sizeof(text), "%s %u", (i % 50 ? "hay" : "Needle,"), i);
+		_buffer_newline(&b, text);
+	}
+
+	i = b.head;
+
+	assert_eq(buffer_search(&b, "needle", &i), 1);
+	assert_strcmp(buffer_line(&b, i)->text, "Needle, 250");
+	assert_eq(buffer_search(&b, "needle", &i), 1);
+	assert_strcmp(buffer_line(&b, i)->text, "Needle, 200");
+	assert_eq(buffer_search(&b, "needle", &i), 1);
+	assert_strcmp(buffer_line(&b, i)->text, "Needle, 150");
+	assert_eq(i, b.tail - 50);
+	assert_eq(buffer_search(&b, "needle", &i), 1);
+	assert_eq(buffer_search(&b, "needle", &i), 1);
+	assert_eq(buffer_search(&b, "needle", &i), 1);
+	assert_strcmp(buffer_line(&b, i)->text, "Needle, 0");
+	assert_eq(buffer_search(&b, "needle", &i), 0);
+	assert_eq(i, b.tail - 200);
+
+	i = b.head;
+
+	assert_eq(buffer_search(&b, "HAY 123", &i), 1);
+	assert_strcmp(buffer_line(&b, i)->text, "hay 123");
+	assert_eq(buffer_search(&b, "needle 123", &i), 0);
+	assert_eq(buffer_search(&b, "", &i), 0);
+
+	/* Only the newest lines are indexed, older lines are matched in turn */
+	buffer_free(&b);
+	history_init(&b.history, HISTORY_SEGMENT_SIZE);
+
+	for (i = 0; i < SEARCH_LINES + 300; i++) {
+		snprintf(text, sizeof(text), "%s %u", (i % 200 ? "hay" : "Needle,"), i);
+		_buffer_newline(&b, text);
+	}
+
+	assert_eq(b.search.first, b.head - SEARCH_LINES);
+
+	i = b.head;
+
+	do {
+		assert_eq(buffer_search(&b, "needle", &i), 1);
+	} while (i - b.search.first < SEARCH_LINES);
+
+	assert_strcmp(buffer_line(&b, i)->text, "Needle, 200");
+	assert_eq(buffer_search(&b, "needle", &i), 1);
+	assert_strcmp(buffer_line(&b, i)->text, "Needle, 0");
+	assert_eq(buffer_search(&b, "needle", &i), 0);
+
+	i = b.head;
+
+	assert_eq(buffer_search(&b, "hay 1", &i), 1);
+	assert_strcmp(buffer_line(&b, i)->text, "hay 1");
+
+	/* Lines older than the index are matched up to a bound, continued
+	 * from the last line matched */
+	buffer_free(&b);
+	history_init(&b.history, HISTORY_SEGMENT_SIZE * 4);
+
+	for (i = 0; i < SEARCH_LINES + BUFFER_SEARCH_SCAN + 100; i++) {
+		snprintf(text, sizeof(text), "%s %u", (i ? "hay" : "Needle,"), i);
+		_buffer_newline(&b, text);
+	}
+
+	assert_eq(b.history.dropped, 0);
+
+	i = b.head;
+
+	assert_eq(buffer_search(&b, "needle", &i), -1);
+	assert_eq(i, b.search.first - BUFFER_SEARCH_SCAN);
+	assert_eq(buffer_search(&b, "needle", &i), 1);
+	assert_strcmp(buffer_line(&b, i)->text, "Needle, 0");
+	assert_eq(buffer_search(&b, "needle", &i), 0);
+
+	/* Lines dropped without history aren't found */
+	buffer_free(&b);
+	history_init(&b.history, 0);
+
+	for (i = 0; i < 300; i++) {
+		snprintf(text, sizeof(text), "%s %u", (i % 50 ? "hay" : "Needle,"), i);
+		_buffer_newline(&b, text);
+	}
+
+	i = b.head;
+
+	assert_eq(buffer_search(&b, "needle", &i), 1);
+	assert_eq(buffer_search(&b, "needle", &i), 1);
+	assert_strcmp(buffer_line(&b, i)->text, "Needle, 200");
+	assert_eq(buffer_search(&b, "needle", &i), 0);
+
+	i = b.head;
+
+	assert_eq(buffer_search(&b, "hay 199", &i), 0);
+	assert_eq(buffer_search(&b, "hay 201", &i), 1);
+
+	/* Freed buffers are emptied of lines found */
+	buffer_free(&b);
+
+	i = b.head;
+
+	assert_eq(buffer_search(&b, "needle", &i), 0);
+}
+
+static unsigned int
+_buffer_rows_back(struct buffer *b, unsigned int cols, unsigned int i, unsigned int rows, unsigned int *count)
+{
+	/* Walk back from line i summing rows, as drawn */
+
+	unsigned int text_w;
+
+	for (*count = 0;; i--) {
+
+		buffer_line_split(buffer_line(b, i), NULL, &text_w, cols, b->pad);
+
+		if ((*count += buffer_line_rows(buffer_line(b, i), text_w)) >= rows)
+			return i;
+
+		if (i == b->tail - b->history.lines)
+			return i;
+	}
+}
+
+static unsigned int
+_buffer_rows_forw(struct buffer *b, unsigned int cols, unsigned int i, unsigned int rows, unsigned int *count)
+{
+	/* Walk forward from line i summing rows, as drawn */
+
+	unsigned int text_w;
+
+	for (*count = 0;; i++) {
+
+		buffer_line_split(buffer_line(b, i), NULL, &text_w, cols, b->pad);
+
+		if ((*count += buffer_line_rows(buffer_line(b, i), text_w)) >= rows)
+			return i;
+
+		if (i == b->head - 1)
+			return i;
+	}
+}
+
+static void
+test_buffer_rows(void)
+{
+	/* Test finding lines by rows, against walking lines */
+
+	char from[FROM_LENGTH_MAX + 1];
+	char text[TEXT_LENGTH_MAX + 1];
+	unsigned cols[] = { 20, 37, 80 };
+	unsigned rows[] = { 1, 5, 24, 100 };
+	unsigned count, count_w, i, j, n;
+	uint32_t x = 2463534242U;
+	struct buffer b;
+
+	buffer(&b);
+	buffer_lines_set(&b, 200);
+
+	for (n = 0; n < 3000; n++) {
+
+		size_t len = 0;
+
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+
+		/* Words of random lengths, and nicks lengthening the padding */
+		while (len < (x % 300))
+			len += (size_t) snprintf(text + len, sizeof(text) - len, "%.*s ", (int) (1 + (x >> (len % 24)) % 12), "wwwwwwwwwwww");
+
+		snprintf(from, sizeof(from), "%.*s", (int) (1 + n / 500), "nnnnnnnnnnnn");
+
+		buffer_newline(&b, BUFFER_LINE_CHAT, from, text, strlen(from), len, 0);
+
+		if (n == 1000)
+			history_init(&b.history, HISTORY_SEGMENT_SIZE);
+
+		if (n == 1500)
+			buffer_lines_set(&b, 50);
+
+		if (n == 2000)
+			buffer_lines_set(&b, 1000);
+
+		if (n % 7)
+			continue;
+
+		for (j = 0; j < 4; j++) {
+
+			unsigned c = cols[(n + j) % ELEMS(cols)];
+			unsigned r = rows[(n / 7 + j) % ELEMS(rows)];
+
+			i = b.tail - b.history.lines + (x >> j) % (b.head - b.tail + b.history.lines);
+
+			/* Lines partially indexed, found from the tree or walked */
+			if (j % 2 == 0)
+				buffer_rows_reflow(&b, c, (x >> 8) % 500);
+
+			assert_eq(buffer_rows_back(&b, c, i, r, &count), _buffer_rows_back(&b, c, i, r, &count_w));
+			assert_eq(count, count_w);
+			assert_eq(buffer_rows_forw(&b, c, i, r, &count), _buffer_rows_forw(&b, c, i, r, &count_w));
+			assert_eq(count, count_w);
+		}
+	}
+
+	/* Rows of lines indexed are kept as lines are evicted */
+	assert_true(b.rows.tree != NULL);
+
+	buffer_free(&b);
+}
+
+static void
+test_buffer_rows_reflow(void)
+{
+	/* Test lines are walked for rows until reflowed to new columns */
+
+	unsigned count, count_w, i, n;
+	struct buffer b;
+
+	buffer(&b);
+	buffer_lines_set(&b, 5000);
+
+	for (n = 0; n < 5000; n++)
+		_buffer_newline(&b, (n % 3) ? "aa bb cc dd ee ff gg hh ii jj kk ll mm nn oo pp" : "aa");
+
+	/* Never indexed */
+	assert_eq(buffer_rows_reflow(&b, 40, 100), 0);
+	assert_ptr_eq(b.rows.tree, NULL);
+
+	/* Indexed for 80 columns */
+	assert_eq(buffer_rows_back(&b, 80, b.head - 1, UINT_MAX, &count), b.tail);
+	assert_eq(b.rows.cols, 80);
+
+	/* Resized, rows in view are walked */
+	i = b.head - 1;
+	assert_eq(buffer_rows_back(&b, 40, i, 24, &count), _buffer_rows_back(&b, 40, i, 24, &count_w));
+	assert_eq(count, count_w);
+	i = b.tail + 100;
+	assert_eq(buffer_rows_forw(&b, 40, i, 24, &count), _buffer_rows_forw(&b, 40, i, 24, &count_w));
+	assert_eq(count, count_w);
+	assert_eq(b.rows.cols, 80);
+
+	/* Reflowed in turn, with lines added and evicted */
+	for (n = 1; buffer_rows_reflow(&b, 40, 1000); n++) {
+		_buffer_newline(&b, "aa bb cc dd ee ff gg hh ii jj kk ll mm nn oo pp");
+		assert_eq(b.rows.cols, 40);
+	}
+
+	assert_eq(n, 6);
+	assert_eq(b.rows.head, b.head);
+
+	for (i = b.tail; i - b.tail < b.head - b.tail; i += 97) {
+		assert_eq(buffer_rows_back(&b, 40, i, 100, &count), _buffer_rows_back(&b, 40, i, 100, &count_w));
+		assert_eq(count, count_w);
+		assert_eq(buffer_rows_forw(&b, 40, i, 100, &count), _buffer_rows_forw(&b, 40, i, 100, &count_w));
+		assert_eq(count, count_w);
+	}
+
+	/* Rows of a ring resized are reflowed */
+	buffer_lines_set(&b, 100);
+
+	assert_ptr_eq(b.rows.tree, NULL);
+	assert_eq(buffer_rows_reflow(&b, 40, 1000), 0);
+	assert_true(b.rows.tree != NULL);
+	assert_eq(b.rows.head, b.head);
+
+	buffer_free(&b);
+
+	/* Buffers freed aren't indexed */
+	assert_eq(buffer_rows_reflow(&b, 40, 1000), 0);
+	assert_ptr_eq(b.rows.tree, NULL);
+}
+
 int
 main(void)
 {
@@ -446,7 +1220,18 @@ main(void)
 		TESTCASE(test_buffer_index_overflow),
 		TESTCASE(test_buffer_line_overlength),
 		TESTCASE(test_buffer_line_rows),
+		TESTCASE(test_buffer_line_wrap),
 		TESTCASE(test_buffer_newline_prefix),
+		TESTCASE(test_buffer_arena),
+		TESTCASE(test_buffer_blocks),
+		TESTCASE(test_buffer_lines_set),
+		TESTCASE(test_buffer_history),
+		TESTCASE(test_buffer_history_space),
+		TESTCASE(test_buffer_trim),
+		TESTCASE(test_buffer_trim_files),
+		TESTCASE(test_buffer_search),
+		TESTCASE(test_buffer_rows),
+		TESTCASE(test_buffer_rows_reflow),
 	};
 
 	return run_tests(tests);
@@ -0,0 +1,330 @@
+#include <signal.h>
+#include <sys/resource.h>
+
+#include "test/test.h"
+#include "src/components/history.c"
+#include "src/utils/lz.c"
+#include "src/utils/utils.c"
+
+static char*
+_fmt_int(int i)
+{
+	static char buff[1024];
+
+	if ((snprintf(buff, sizeof(buff), "%d", i)) < 0)
+		fail_test("snprintf");
+
+	return buff;
+}
+
+static int
+_history_add(struct history *h, int i, size_t len, char pad)
+{
+	/* Add a line of text i, padded to len with pad, or with
+	 * incompressible text if 0 */
+
+	char from[] = "nick";
+	char text[TEXT_LENGTH_MAX + 1];
+	struct buffer_line line = {0};
+	uint32_t x = (uint32_t) i + 2463534242U;
+
+	for (size_t j = 0; j < sizeof(text); j++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		text[j] = (pad ? pad : (char) ('!' + x % 94));
+	}
+
+	memcpy(text, _fmt_int(i), strlen(_fmt_int(i)));
+	text[MAX(len, strlen(_fmt_int(i)))] = 0;
+
+	line.from = from;
+	line.text = text;
+	line.time = (time_t) i;
+	line.type = BUFFER_LINE_CHAT;
+	line.from_len = (unsigned short) strlen(from);
+	line.text_len = (unsigned short) strlen(text);
+
+	return history_add(h, &line);
+}
+
+static int
+_history_check(struct history *h, unsigned i, int n)
+{
+	/* Check the history line i is the line n added */
+
+	struct buffer_line *line = history_line(h, i);
+
+	return strncmp(line->text, _fmt_int(n), strlen(_fmt_int(n)))
+		|| strcmp(line->from, "nick")
+		|| line->time != (time_t) n
+		|| line->type != BUFFER_LINE_CHAT;
+}
+
+static void
+test_history(void)
+{
+	/* Test disabled histories */
+
+	struct history h;
+
+	history_init(&h, 0);
+
+	assert_eq(_history_add(&h, 0, 0, 0), -1);
+	assert_eq(h.lines, 0);
+
+	history_init(&h, HISTORY_SEGMENT_SIZE - 1);
+
+	assert_eq(_history_add(&h, 0, 0, 0), -1);
+	assert_eq(h.lines, 0);
+
+	history_free(&h);
+}
+
+static void
+test_history_line(void)
+{
+	/* Test adding and retrieving lines */
+
+	int i;
+	struct history h;
+
+	history_init(&h, HISTORY_SEGMENT_SIZE * 2);
+
+	for (i = 0; i < 1000; i++)
+		assert_eq(_history_add(&h, i, 0, 0), 0);
+
+	assert_eq(h.lines, 1000);
+	assert_eq(h.segs_n, 1);
+
+	for (i = 0; i < 1000; i++)
+		assert_eq(_history_check(&h, (unsigned) i, i), 0);
+
+	assert_eq(history_line(&h, 999)->text_len, 3);
+	assert_eq(history_line(&h, 999)->from_len, 4);
+
+	/* The oldest line is cached apart, its header returned while retrieving others */
+	assert_ptr_eq(history_line(&h, 0), history_line(&h, 0));
+
+	for (i = 1; i < 1000; i++)
+		assert_true(history_line(&h, (unsigned) i) != history_line(&h, 0));
+
+	assert_fatal(history_line(&h, 1000));
+
+	history_free(&h);
+}
+
+static void
+test_history_segments(void)
+{
+	/* Test lines are dropped with the oldest segment once full */
+
+	int dropped = 0, i, ret;
+	struct history h;
+
+	history_init(&h, HISTORY_SEGMENT_SIZE * 2);
+
+	for (i = 0; i < 10000; i++) {
+		if ((ret = _history_add(&h, i, TEXT_LENGTH_MAX, 0)) < 0)
+			fail_test("history_add");
+		dropped += ret;
+	}
+
+	assert_true(dropped > 0);
+	assert_eq(h.segs_n, 2);
+	assert_eq(h.dropped, (unsigned) dropped);
+	assert_eq(h.lines + h.dropped, 10000);
+
+	for (i = 0; i < (int) h.lines; i++)
+		assert_eq(_history_check(&h, (unsigned) i, i + dropped), 0);
+
+	/* Freed histories are empty, and can be added to */
+	history_free(&h);
+
+	assert_eq(h.lines, 0);
+	assert_eq(h.max, HISTORY_SEGMENT_SIZE * 2);
+
+	assert_eq(_history_add(&h, 0, 0, 0), 0);
+	assert_eq(_history_check(&h, 0, 0), 0);
+
+	history_free(&h);
+}
+
+static void
+test_history_blocks(void)
+{
+	/* Test lines are compressed in blocks, decompressed to a bounded cache,
+	 * with the most recently returned line valid while decompressing another */
+
+	int i;
+	struct buffer_line *line;
+	struct history h;
+
+	history_init(&h, HISTORY_SEGMENT_SIZE * 2);
+
+	for (i = 0; i < 5000; i++)
+		assert_eq(_history_add(&h, i, 100, ' '), 0);
+
+	assert_eq(h.segs_n, 1);
+	assert_eq(h.lines, 5000);
+	assert_true(h.open_lines > 0);
+	assert_true(h.open_lines < h.lines);
+	assert_true(h.raw / h.size > 4);
+
+	for (i = 0; i < 5000; i++)
+		assert_eq(_history_check(&h, (unsigned) i, i), 0);
+
+	for (i = 4999; i >= 0; i -= 37)
+		assert_eq(_history_check(&h, (unsigned) i, i), 0);
+
+	for (i = 0; i + 2500 < 5000; i += 250) {
+
+		line = history_line(&h, (unsigned) i);
+
+		assert_eq(_history_check(&h, (unsigned) i + 2500, i + 2500), 0);
+		assert_strncmp(line->text, _fmt_int(i), strlen(_fmt_int(i)));
+	}
+
+	/* Freeing cached blocks with the history */
+	history_free(&h);
+
+	assert_eq(h.raw, 0);
+	assert_eq(h.size, 0);
+	assert_true(h.blocks == NULL);
+
+	/* Corrupt blocks are fatal once decompressed */
+	for (i = 0; i < 5000; i++)
+		assert_eq(_history_add(&h, i, 100, ' '), 0);
+
+	memset(h.segs[0].map, 0xff, h.segs[0].size);
+
+	assert_fatal(history_line(&h, 1));
+
+	history_free(&h);
+}
+
+static void
+test_history_mapped(void)
+{
+	/* Test a bounded number of segments are mapped, with the most recently
+	 * returned line valid while mapping another segment */
+
+	int i;
+	struct buffer_line *line;
+	struct history h;
+
+	history_init(&h, HISTORY_SEGMENT_SIZE * 16);
+
+	for (i = 0; i < 20000; i++)
+		assert_eq(_history_add(&h, i, TEXT_LENGTH_MAX, 0), 0);
+
+	assert_true(h.segs_n > HISTORY_MAPPED);
+	assert_true(h.mapped <= HISTORY_MAPPED);
+
+	for (i = 0; i < 20000; i += 97) {
+		assert_eq(_history_check(&h, (unsigned) i, i), 0);
+		assert_true(h.mapped <= HISTORY_MAPPED);
+	}
+
+	for (i = 0; i + 5000 < 20000; i += 1000) {
+
+		line = history_line(&h, (unsigned) i);
+
+		assert_eq(_history_check(&h, (unsigned) i + 5000, i + 5000), 0);
+		assert_strncmp(line->text, _fmt_int(i), strlen(_fmt_int(i)));
+	}
+
+	history_free(&h);
+}
+
+static void
+test_history_files(void)
+{
+	/* Test at most HISTORY_FILES histories are open, dropping lines added
+	 * to others until one is freed */
+
+	int i;
+	struct history h[HISTORY_FILES + 1];
+
+	for (i = 0; i < HISTORY_FILES + 1; i++)
+		history_init(&h[i], HISTORY_SEGMENT_SIZE);
+
+	for (i = 0; i < HISTORY_FILES; i++)
+		assert_eq(_history_add(&h[i], i, 0, 0), 0);
+
+	assert_eq(_history_add(&h[HISTORY_FILES], 0, 0, 0), -1);
+	assert_eq(h[HISTORY_FILES].lines, 0);
+	assert_eq(h[HISTORY_FILES].max, HISTORY_SEGMENT_SIZE);
+
+	history_free(&h[0]);
+
+	assert_eq(_history_add(&h[HISTORY_FILES], 0, 0, 0), 0);
+	assert_eq(_history_check(&h[HISTORY_FILES], 0, 0), 0);
+
+	for (i = 1; i < HISTORY_FILES + 1; i++)
+		history_free(&h[i]);
+
+	assert_eq(history_files, 0);
+}
+
+static void
+test_history_space(void)
+{
+	/* Test a history out of space for another segment reuses the oldest */
+
+	int i, dropped = 0, ret;
+	struct history h;
+	struct rlimit limit, limit_old;
+	void (*handler)(int);
+
+	if (getrlimit(RLIMIT_FSIZE, &limit_old) < 0)
+		fail_test("getrlimit");
+
+	limit = limit_old;
+	limit.rlim_cur = HISTORY_SEGMENT_SIZE * 2;
+
+	if ((handler = signal(SIGXFSZ, SIG_IGN)) == SIG_ERR)
+		fail_test("signal");
+
+	if (setrlimit(RLIMIT_FSIZE, &limit) < 0)
+		fail_test("setrlimit");
+
+	history_init(&h, HISTORY_SEGMENT_SIZE * 4);
+
+	for (i = 0; i < 10000; i++) {
+
+		if ((ret = _history_add(&h, i, TEXT_LENGTH_MAX, 0)) < 0)
+			fail_test("history_add");
+
+		dropped += ret;
+	}
+
+	setrlimit(RLIMIT_FSIZE, &limit_old);
+	signal(SIGXFSZ, handler);
+
+	assert_true(dropped > 0);
+	assert_eq(h.max, HISTORY_SEGMENT_SIZE * 2);
+	assert_eq(h.segs_n, 2);
+	assert_eq(h.lines, 10000 - dropped);
+
+	for (i = 0; i < 10000 - dropped; i += 97)
+		assert_eq(_history_check(&h, (unsigned) i, i + dropped), 0);
+
+	history_free(&h);
+}
+
+int
+main(void)
+{
+	struct testcase tests[] = {
+		TESTCASE(test_history),
+		TESTCASE(test_history_line),
+		TESTCASE(test_history_segments),
+		TESTCASE(test_history_blocks),
+		TESTCASE(test_history_mapped),
+		TESTCASE(test_history_files),
+		TESTCASE(test_history_space),
+	};
+
+	return run_tests(tests);
+}
@@ -0,0 +1,198 @@
+#include <limits.h>
+
+#include "test/test.h"
+#include "src/components/search.c"
+#include "src/utils/utils.c"
+
+static char*
+_fmt_word(const char *fmt, unsigned int n)
+{
+	static char buff[64];
+
+	if ((snprintf(buff, sizeof(buff), fmt, n)) < 0)
+		fail_test("snprintf");
+
+	return buff;
+}
+
+static unsigned int
+_search_lists(struct search *s)
+{
+	/* Return the number of lists not empty */
+
+	unsigned int n = 0;
+
+	for (unsigned int i = 0; i < s->size; i++)
+		n += (s->table[i].len > 0);
+
+	return n;
+}
+
+static void
+test_search_match(void)
+{
+	/* Test lines are matched by whole words, case folded */
+
+	assert_eq(search_match("hello", "nick", "Hello, world"), 1);
+	assert_eq(search_match("WORLD hello", "nick", "Hello, world"), 1);
+	assert_eq(search_match("nick world", "nick", "Hello, world"), 1);
+	assert_eq(search_match("  hello!!  ", "nick", "hello"), 1);
+	assert_eq(search_match("hel", "nick", "hello"), 0);
+	assert_eq(search_match("hello", "nick", "hel"), 0);
+	assert_eq(search_match("hello there", "nick", "hello"), 0);
+	assert_eq(search_match("a1", "nick", "(a1)"), 1);
+
+	/* Non-ASCII bytes are word characters, matched exactly */
+	assert_eq(search_match("caf\xc3\xa9", "nick", "un caf\xc3\xa9 noir"), 1);
+	assert_eq(search_match("caf", "nick", "un caf\xc3\xa9 noir"), 0);
+
+	/* Queries without words match no line */
+	assert_eq(search_match("", "nick", "hello"), 0);
+	assert_eq(search_match("!!", "nick", "hello"), 0);
+	assert_eq(search_query(""), 0);
+	assert_eq(search_query(" !! "), 0);
+	assert_eq(search_query(" !!a "), 1);
+}
+
+static void
+test_search_find(void)
+{
+	/* Test finding lines by each word of a query, newest first */
+
+	struct search s;
+	unsigned int n;
+
+	search_init(&s);
+
+	search_add(&s, 0, "nick1", "the quick brown fox");
+	search_add(&s, 1, "nick2", "jumps over the lazy dog");
+	search_add(&s, 2, "nick1", "The Fox, the dog");
+	search_add(&s, 3, "nick2", "fox fox fox");
+
+	n = 4;
+	assert_eq(search_find(&s, "fox", &n), 1);
+	assert_eq(n, 3);
+	assert_eq(search_find(&s, "fox", &n), 1);
+	assert_eq(n, 2);
+	assert_eq(search_find(&s, "fox", &n), 1);
+	assert_eq(n, 0);
+	assert_eq(search_find(&s, "fox", &n), 0);
+	assert_eq(n, 0);
+
+	n = 4;
+	assert_eq(search_find(&s, "dog THE", &n), 1);
+	assert_eq(n, 2);
+	assert_eq(search_find(&s, "dog THE", &n), 1);
+	assert_eq(n, 1);
+	assert_eq(search_find(&s, "dog THE", &n), 0);
+
+	n = 4;
+	assert_eq(search_find(&s, "fox fox nick1", &n), 1);
+	assert_eq(n, 2);
+
+	/* Lines before n only */
+	n = 2;
+	assert_eq(search_find(&s, "fox", &n), 1);
+	assert_eq(n, 0);
+
+	/* Words not indexed, or no words */
+	n = 4;
+	assert_eq(search_find(&s, "fox cat", &n), 0);
+	assert_eq(search_find(&s, "", &n), 0);
+	assert_eq(search_find(&s, "...", &n), 0);
+	assert_eq(n, 4);
+
+	search_free(&s);
+
+	n = 4;
+	assert_eq(search_find(&s, "fox", &n), 0);
+	assert_eq(s.size, 0);
+}
+
+static void
+test_search_drop(void)
+{
+	/* Test lines dropped aren't found, and are pruned from the index */
+
+	struct search s;
+	unsigned int i, n;
+
+	search_init(&s);
+
+	for (i = 0; i < 100000; i++) {
+		search_add(&s, i, "nick", _fmt_word("common word%u", i));
+		if (i >= 1000)
+			search_drop(&s, i - 1000);
+	}
+
+	n = i;
+	assert_eq(search_find(&s, "common", &n), 1);
+	assert_eq(n, 99999);
+
+	n = 98999;
+	assert_eq(search_find(&s, "common", &n), 0);
+
+	n = i;
+	assert_eq(search_find(&s, "word98998", &n), 0);
+	assert_eq(search_find(&s, "word98999", &n), 1);
+	assert_eq(n, 98999);
+
+	/* Lists of words dropped are freed, within a sweep */
+	assert_true(_search_lists(&s) < 1000 + s.size);
+	assert_true(s.size <= 8192);
+
+	/* Lines dropped are freed from lists when added to */
+	assert_true(search_list(&s, search_hash("common", 6), 0)->cap <= 4096);
+
+	search_free(&s);
+}
+
+static void
+test_search_rehash(void)
+{
+	/* Test the index grows, with lines found across overflow of line numbers */
+
+	struct search s;
+	unsigned int i, n;
+
+	search_init(&s);
+	search_drop(&s, UINT_MAX / 2);
+	search_drop(&s, UINT_MAX - 5000);
+
+	for (i = 0; i < 10000; i++)
+		search_add(&s, UINT_MAX - 5000 + i, "nick", _fmt_word("word%u", i % 5000));
+
+	assert_true(s.size >= 5000);
+
+	for (i = 0; i < 5000; i++) {
+
+		const char *word = _fmt_word("word%u", i);
+
+		n = UINT_MAX - 5000 + 10000;
+		assert_eq(search_find(&s, word, &n), 1);
+		assert_eq(n, UINT_MAX - 5000 + 5000 + i);
+		assert_eq(search_find(&s, word, &n), 1);
+		assert_eq(n, UINT_MAX - 5000 + i);
+	}
+
+	search_drop(&s, UINT_MAX - 5000 + 5000);
+
+	n = UINT_MAX - 5000 + 10000;
+	assert_eq(search_find(&s, "word10", &n), 1);
+	assert_eq(search_find(&s, "word10", &n), 0);
+
+	search_free(&s);
+}
+
+int
+main(void)
+{
+	struct testcase tests[] = {
+		TESTCASE(test_search_match),
+		TESTCASE(test_search_find),
+		TESTCASE(test_search_drop),
+		TESTCASE(test_search_rehash),
+	};
+
+	return run_tests(tests);
+}
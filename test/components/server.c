@@ -5,6 +5,9 @@
 #include "src/components/mode.c"
 #include "src/components/input.c"
 #include "src/components/buffer.c"
+#include "src/components/history.c"
+#include "src/components/search.c"
+#include "src/utils/lz.c"
 #include "src/utils/utils.c"
 
 void
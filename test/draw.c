@@ -1,6 +1,9 @@
 #include "test/test.h"
 
 #include "src/components/buffer.c"
+#include "src/components/history.c"
+#include "src/components/search.c"
+#include "src/utils/lz.c"
 #include "src/components/channel.c"
 #include "src/components/input.c"
 #include "src/components/mode.c"
@@ -1,6 +1,9 @@
 #include "test/test.h"
 
 #include "src/components/buffer.c"
+#include "src/components/history.c"
+#include "src/components/search.c"
+#include "src/utils/lz.c"
 #include "src/components/channel.c"
 #include "src/components/input.c"
 #include "src/components/mode.c"
@@ -75,6 +78,20 @@ io_sendf(struct connection *c, const char *fmt, ...)
 	return 0;
 }
 
+int
+io_sendf_bulk(struct connection *c, const char *fmt, ...)
+{
+	va_list ap;
+
+	UNUSED(c);
+
+	va_start(ap, fmt);
+	assert_gt(vsnprintf(send_buf, sizeof(send_buf), fmt, ap), 0);
+	va_end(ap);
+
+	return 0;
+}
+
 int
 io_dx(struct connection *c)
 {
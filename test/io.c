@@ -1,17 +1,33 @@
 #include "test/test.h"
 
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+
 /* Preclude definition for testing */
 #define IO_MESG_LEN 10
+#define IO_TAGS_LEN 20
 
 #include "src/io.c"
+#include "src/utils/timer.c"
+
+static enum io_cb_t cb_type;
+static int cb_send_0;
 
 /* Stubbed state callbacks */
-void io_cb(enum io_cb_t t, const void *obj, ...) { UNUSED(t); UNUSED(obj); }
+void io_cb(enum io_cb_t t, const void *obj, ...) { UNUSED(obj); cb_type = t; cb_send_0 += (t == IO_CB_SEND_0); }
 void io_cb_read_inp(char *buf, size_t n) { UNUSED(buf); UNUSED(n); }
+int io_cb_idle(void) { return 0; }
 
 static int cb_count;
+static int cb_count_end;
 static int cb_size;
-static char soc_buf[IO_MESG_LEN + 1];
+static char soc_buf[IO_LINE_LEN + 1];
+static char *soc_ptr;
+static char soc_log[1 << 16];
+static size_t soc_log_len;
+
+void io_cb_read_soc_end(const void *obj) { UNUSED(obj); cb_count_end++; }
 
 void io_cb_read_soc(char *buf, size_t n, const void *obj)
 {
@@ -19,7 +35,14 @@ void io_cb_read_soc(char *buf, size_t n, const void *obj)
 	UNUSED(n);
 	cb_count++;
 	cb_size = (int)n;
+	soc_ptr = buf;
 	snprintf(soc_buf, sizeof(soc_buf), "%s", buf);
+
+	if (soc_log_len + n + 1 <= sizeof(soc_log)) {
+		memcpy(soc_log + soc_log_len, buf, n);
+		soc_log_len += n;
+		soc_log[soc_log_len++] = '\n';
+	}
 }
 
 static void
@@ -27,9 +50,12 @@ test_io_recv(void)
 {
 	struct connection c;
 	memset(&c, 0, sizeof(c));
+	c.soc = -1;
+	c.st_c = IO_ST_CXED;
 
 #define IO_RECV(S) \
-	io_recv(&c, (S), sizeof((S)) - 1);
+	memcpy(io_recv_buf(&c) + c.read.i, (S), sizeof((S)) - 1); \
+	io_recv(&c, sizeof((S)) - 1);
 
 	/* Test complete message received */
 	soc_buf[0] = 0;
@@ -40,6 +66,9 @@ test_io_recv(void)
 	assert_eq(cb_size, 3);
 	assert_strcmp(soc_buf, "bar");
 
+	/* Test complete messages are passed in place */
+	assert_ptr_eq(soc_ptr, c.read.buf + 5);
+
 	/* Test empty messages */
 	IO_RECV("\r\n\r\n");
 	IO_RECV("\r");
@@ -58,6 +87,8 @@ test_io_recv(void)
 	assert_eq(cb_count, 4);
 	assert_eq(cb_size, 3);
 	assert_strcmp(soc_buf, "xyz");
+	assert_ptr_eq(soc_ptr, c.read.buf);
+	assert_eq((signed) c.read.i, 0);
 
 	/* Test non-delimiter, non-CTCP control character are skiped */
 	const char str1[] = {'a', 0x00, 0x01, 0x02, '\r', 'b', '\n', 'c', 0x01, '\r', '\n', 0};
@@ -74,14 +105,884 @@ test_io_recv(void)
 	assert_eq(cb_size, 10);
 	assert_strcmp(soc_buf, "abcdefghij");
 
+	/* Test message tags extend the maximum length */
+	IO_RECV("@a=1;b=2;c=3 CMD abcdefghijklmnopqrstuvwxyz\r\n");
+	assert_eq(cb_count, 7);
+	assert_eq(cb_size, 30);
+	assert_strcmp(soc_buf, "@a=1;b=2;c=3 CMD abcdefghijklm");
+	assert_ptr_null(c.read.ext);
+
+	/* Test long partial messages are moved to an allocated buffer */
+	IO_RECV("@a=1;b=2;c=3 CMD");
+	assert_eq(cb_count, 7);
+	assert_ueq(c.read.i, 16);
+	assert_true(c.read.ext != NULL);
+	IO_RECV(" abc\r\nxyz");
+	assert_eq(cb_count, 8);
+	assert_strcmp(soc_buf, "@a=1;b=2;c=3 CMD abc");
+	assert_ptr_null(c.read.ext);
+	assert_ueq(c.read.i, 3);
+	assert_strncmp(c.read.buf, "xyz", 3);
+	IO_RECV("\r\n");
+	assert_eq(cb_count, 9);
+	assert_strcmp(soc_buf, "xyz");
+
+	io_soc_close(&c);
+
 #undef IO_RECV
 }
 
+static void
+test_io_recv_scan(void)
+{
+	/* Test each scan implementation frames and filters random input in
+	 * random chunks identically to a bytewise reference filter */
+
+	static char buf[1 << 14];
+	static char ref_log[sizeof(soc_log)];
+
+	static const struct {
+		size_t (*scan)(const char*, size_t);
+		const char *name;
+	} impls[] = {
+		{ io_scan_scalar, "scalar" },
+#ifdef IO_SCAN_X86
+		{ io_scan_sse2,   "sse2" },
+		{ io_scan_avx2,   "avx2" },
+#endif
+	};
+
+	char ref_buf[IO_LINE_LEN + 1];
+	char ref_cl = 0;
+	size_t ref_i = 0;
+	size_t ref_log_len = 0;
+	unsigned seed = 1;
+
+	for (size_t i = 0; i < sizeof(buf); i++) {
+
+		unsigned r = (seed = seed * 1103515245 + 12345) >> 16;
+
+		switch (r % 16) {
+			case 0:  buf[i] = '\r';  break;
+			case 1:  buf[i] = '\n';  break;
+			case 2:  buf[i] = 0x01;  break;
+			case 3:  buf[i] = (char) (r >> 8 & 0x1F); break;
+			case 4:  buf[i] = (char) (0x7F + (r >> 8 & 0x7F)); break;
+			case 5:  buf[i] = '\r'; if (i + 1 < sizeof(buf)) buf[++i] = '\n'; break;
+			case 6:  buf[i] = '@';   break;
+			default: buf[i] = (char) (0x20 + (r >> 8) % 0x5F);
+		}
+	}
+
+	/* Reference, the original bytewise filter */
+	for (size_t i = 0; i < sizeof(buf); i++) {
+
+		char cc = buf[i];
+		size_t ref_max = ((ref_i ? ref_buf[0] : cc) == '@') ? IO_LINE_LEN : IO_MESG_LEN;
+
+		if (ref_i && cc == '\n' && ((i && buf[i - 1] == '\r') || (!i && ref_cl == '\r'))) {
+			memcpy(ref_log + ref_log_len, ref_buf, ref_i);
+			ref_log_len += ref_i;
+			ref_log[ref_log_len++] = '\n';
+			ref_i = 0;
+		} else if (ref_i < ref_max && ((cc >= 0x20 && cc <= 0x7E) || cc == 0x01)) {
+			ref_buf[ref_i++] = cc;
+		}
+	}
+
+	for (size_t k = 0; k < sizeof(impls) / sizeof(impls[0]); k++) {
+
+		struct connection c;
+
+#ifdef IO_SCAN_X86
+		if (impls[k].scan == io_scan_avx2 && !__builtin_cpu_supports("avx2"))
+			continue;
+#endif
+
+		memset(&c, 0, sizeof(c));
+		c.soc = -1;
+		c.st_c = IO_ST_CXED;
+		io_scan = impls[k].scan;
+		soc_log_len = 0;
+
+		for (size_t i = 0, n; i < sizeof(buf); i += n) {
+			seed = seed * 1103515245 + 12345;
+			n = MIN(1 + (seed >> 16) % 300, sizeof(buf) - i);
+			memcpy(io_recv_buf(&c) + c.read.i, buf + i, n);
+			io_recv(&c, n);
+		}
+
+		if (soc_log_len != ref_log_len || memcmp(soc_log, ref_log, ref_log_len))
+			fail_testf("%s: framed lines differ from reference", impls[k].name);
+
+		if (c.read.i != ref_i || memcmp(io_recv_buf(&c), ref_buf, ref_i))
+			fail_testf("%s: partial line differs from reference", impls[k].name);
+
+		io_soc_close(&c);
+	}
+
+	io_scan = io_scan_init;
+}
+
+static void
+test_io_state(void)
+{
+	/* Test explicit network state transitions, without connecting */
+
+	struct connection *c = connection(NULL, "host", "port");
+
+	assert_eq(c->st_c, IO_ST_DXED);
+	assert_eq(c->soc, -1);
+	assert_eq(io_timeout(io_time()), -1);
+	assert_eq(io_dx(c), IO_ERR_DXED);
+
+	/* Connecting is scheduled immediately */
+	assert_eq(io_cx(c), IO_ERR_NONE);
+	assert_eq(c->st_c, IO_ST_CXNG);
+	assert_true(timer_pending(&(c->timer)));
+	assert_lt(io_timeout(io_time()), 2);
+	assert_eq(io_cx(c), IO_ERR_CXNG);
+
+	assert_eq(io_dx(c), IO_ERR_NONE);
+	assert_eq(c->st_c, IO_ST_DXED);
+	assert_eq(io_timeout(io_time()), -1);
+
+	c->st_c = IO_ST_CXED;
+	assert_eq(io_cx(c), IO_ERR_CXED);
+	c->st_c = IO_ST_PING;
+	assert_eq(io_cx(c), IO_ERR_CXED);
+	c->st_c = IO_ST_DXED;
+
+	assert_ptr_eq(connections, c);
+
+	io_free(c);
+
+	assert_ptr_null(connections);
+}
+
+static void
+test_io_net_recv(void)
+{
+	/* Test all lines of a read are handled before a single end callback */
+
+	int sv[2];
+	struct connection c;
+
+	memset(&c, 0, sizeof(c));
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		test_abort("socketpair");
+
+	fcntl(sv[0], F_SETFL, O_NONBLOCK);
+
+	c.soc = sv[0];
+	c.st_c = IO_ST_CXED;
+	cb_count = 0;
+	cb_count_end = 0;
+
+	assert_eq(write(sv[1], "a\r\nb\r\nc\r\nd", 10), 10);
+
+	io_net_recv(&c);
+
+	assert_eq(cb_count, 3);
+	assert_eq(cb_count_end, 1);
+	assert_strcmp(soc_buf, "c");
+
+	assert_eq(write(sv[1], "\r\n", 2), 2);
+
+	io_net_recv(&c);
+
+	assert_eq(cb_count, 4);
+	assert_eq(cb_count_end, 2);
+	assert_strcmp(soc_buf, "d");
+
+	io_soc_close(&c);
+	close(sv[1]);
+}
+
+static void
+test_io_net_recv_batch(void)
+{
+	/* Test reads per event are bounded, and remaining data is handled next */
+
+	char buf[(IO_RECV_BATCH + 1) * IO_RECV_SIZE];
+	int sv[2];
+	struct connection c;
+
+	memset(&c, 0, sizeof(c));
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		test_abort("socketpair");
+
+	fcntl(sv[0], F_SETFL, O_NONBLOCK);
+
+	c.soc = sv[0];
+	c.st_c = IO_ST_CXED;
+	cb_count = 0;
+	cb_count_end = 0;
+
+	/* 8 byte lines, evenly dividing the read size */
+	for (size_t i = 0; i < sizeof(buf); i += 8)
+		memcpy(buf + i, "abcdef\r\n", 8);
+
+	assert_eq(write(sv[1], buf, sizeof(buf)), (ssize_t) sizeof(buf));
+
+	io_net_recv(&c);
+
+	assert_eq(cb_count, IO_RECV_BATCH * IO_RECV_SIZE / 8);
+	assert_eq(cb_count_end, 1);
+
+	io_net_recv(&c);
+
+	assert_eq(cb_count, (IO_RECV_BATCH + 1) * IO_RECV_SIZE / 8);
+	assert_eq(cb_count_end, 2);
+	assert_eq(c.st_c, IO_ST_CXED);
+
+	/* Socket blocks, no further callbacks */
+	io_net_recv(&c);
+
+	assert_eq(cb_count, (IO_RECV_BATCH + 1) * IO_RECV_SIZE / 8);
+	assert_eq(cb_count_end, 2);
+	assert_eq(c.st_c, IO_ST_CXED);
+
+	io_soc_close(&c);
+	close(sv[1]);
+}
+
+static void
+test_io_capture(void)
+{
+	/* Test bytes received are captured as received, before filtering */
+
+	char path[64];
+	char buf[64];
+	int sv[2];
+	struct connection c;
+	struct io_capture_rec rec;
+	FILE *f;
+
+	memset(&c, 0, sizeof(c));
+
+	snprintf(path, sizeof(path), "/tmp/rirc.test.%ld.capture", (long) getpid());
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		test_abort("socketpair");
+
+	fcntl(sv[0], F_SETFL, O_NONBLOCK);
+
+	c.soc = sv[0];
+	c.st_c = IO_ST_CXED;
+	c.id = 3;
+	cb_count = 0;
+
+	if (io_capture(path))
+		test_abort("io_capture");
+
+	assert_eq(write(sv[1], "abc\r\n\x7f\r\n", 7), 7);
+	io_net_recv(&c);
+	assert_eq(write(sv[1], "def\r\n", 5), 5);
+	io_net_recv(&c);
+
+	assert_eq(cb_count, 2);
+
+	io_soc_close(&c);
+	close(sv[1]);
+
+	fclose(io_capture_fp);
+	io_capture_fp = NULL;
+
+	if ((f = fopen(path, "rb")) == NULL)
+		test_abort("fopen");
+
+	assert_eq(fread(buf, 1, strlen(IO_CAPTURE_MAGIC), f), strlen(IO_CAPTURE_MAGIC));
+	assert_strncmp(buf, IO_CAPTURE_MAGIC, strlen(IO_CAPTURE_MAGIC));
+
+	assert_eq(fread(&rec, sizeof(rec), 1, f), 1);
+	assert_ueq(rec.id, 3);
+	assert_ueq(rec.len, 7);
+	assert_eq(fread(buf, 1, rec.len, f), 7);
+	assert_strncmp(buf, "abc\r\n\x7f\r\n", 7);
+
+	assert_eq(fread(&rec, sizeof(rec), 1, f), 1);
+	assert_ueq(rec.id, 3);
+	assert_ueq(rec.len, 5);
+	assert_eq(fread(buf, 1, rec.len, f), 5);
+	assert_strncmp(buf, "def\r\n", 5);
+
+	assert_eq(fread(&rec, sizeof(rec), 1, f), 0);
+	assert_true(feof(f));
+
+	fclose(f);
+	unlink(path);
+}
+
+static void
+test_io_sendf(void)
+{
+	/* Test lines are queued and written in order when the socket blocks */
+
+	char buf[IO_SENDQ_MAX];
+	int err, sv[2];
+	size_t n = 0;
+	ssize_t ret;
+	struct connection c;
+
+	memset(&c, 0, sizeof(c));
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		test_abort("socketpair");
+
+	fcntl(sv[0], F_SETFL, O_NONBLOCK);
+	fcntl(sv[1], F_SETFL, O_NONBLOCK);
+
+	c.soc = sv[0];
+
+	assert_eq(io_sendf(&c, "test"), IO_ERR_DXED);
+
+	c.st_c = IO_ST_CXED;
+
+	assert_eq(io_sendf(&c, ""), IO_ERR_FMT);
+	assert_eq(io_sendf(&c, "abcdefghijk"), IO_ERR_TRUNC);
+
+	/* Unblocked socket is written immediately */
+	assert_eq(io_sendf(&c, "abc"), IO_ERR_NONE);
+	assert_eq(io_sendf(&c, "def"), IO_ERR_NONE);
+	assert_ptr_null(c.send.out.head);
+	assert_ueq(c.send.size, 0);
+	assert_eq(read(sv[1], buf, sizeof(buf)), 10);
+	assert_strncmp(buf, "abc\r\ndef\r\n", 10);
+
+	/* Fill the socket until lines are queued past the high watermark,
+	 * resetting flood control as if each line was sent over time */
+	cb_type = IO_CB_INVALID;
+
+	while (c.send.size <= IO_SENDQ_HIGH) {
+		c.send.flood = 0;
+		err = io_sendf(&c, "%08zu", n++);
+		assert_eq(err, IO_ERR_NONE);
+	}
+
+	assert_true(c.send.out.head != NULL);
+	assert_ueq(c.ev, (IO_EV_IN | IO_EV_OUT));
+	assert_eq(cb_type, IO_CB_SEND_1);
+
+	/* Queue is bounded */
+	while (c.send.size + 10 <= IO_SENDQ_MAX) {
+		c.send.flood = 0;
+		err = io_sendf(&c, "%08zu", n++);
+		assert_eq(err, IO_ERR_NONE);
+	}
+
+	err = io_sendf(&c, "%08zu", n);
+	assert_eq(err, IO_ERR_QUEUE);
+
+	/* Drain the socket, flushing the queue, and check no lines were lost */
+	size_t i = 0, j = 0;
+
+	while (i < n) {
+
+		if ((ret = read(sv[1], buf + j, sizeof(buf) - j)) > 0)
+			j += (size_t) ret;
+
+		for (; j >= 10; i++) {
+			char line[11];
+			snprintf(line, sizeof(line), "%08zu\r\n", i);
+			if (strncmp(buf, line, 10)) {
+				fail_testf("expected '%.8s', got '%.8s'", line, buf);
+				return;
+			}
+			memmove(buf, buf + 10, j -= 10);
+		}
+
+		io_net_send(&c);
+	}
+
+	assert_ptr_null(c.send.out.head);
+	assert_ueq(c.send.size, 0);
+	assert_ueq(c.ev, IO_EV_IN);
+	assert_eq(cb_type, IO_CB_SEND_0);
+
+	io_soc_close(&c);
+	close(sv[1]);
+}
+
+static void
+test_io_flood(void)
+{
+	/* Test flood control holds lines past the burst, priority lane first */
+
+	char buf[128];
+	int err, sv[2];
+	struct connection c;
+
+	memset(&c, 0, sizeof(c));
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		test_abort("socketpair");
+
+	fcntl(sv[0], F_SETFL, O_NONBLOCK);
+	fcntl(sv[1], F_SETFL, O_NONBLOCK);
+
+	c.soc = sv[0];
+	c.st_c = IO_ST_CXED;
+	cb_type = IO_CB_INVALID;
+
+	/* Burst is written immediately, remaining lines are held */
+	for (size_t i = 0; i < IO_FLOOD_BURST + 2; i++) {
+		err = io_sendf_bulk(&c, "bulk%zu", i);
+		assert_eq(err, IO_ERR_NONE);
+	}
+
+	assert_eq(read(sv[1], buf, sizeof(buf)), IO_FLOOD_BURST * 7);
+	assert_strncmp(buf, "bulk0\r\n", 7);
+	assert_ptr_null(c.send.out.head);
+	assert_ueq(c.send.bulk.n, 2);
+	assert_ueq(c.ev, IO_EV_IN);
+	assert_true(timer_pending(&(c.send.timer)));
+	assert_true(c.send.timer.expire <= io_time() + IO_FLOOD_RATE);
+	assert_eq(cb_type, IO_CB_SEND_1);
+
+	/* User input and keepalives are held ahead of bulk lines */
+	assert_eq(io_sendf(&c, "user"), IO_ERR_NONE);
+	assert_eq(io_sendf_bulk(&c, "PONG :x"), IO_ERR_NONE);
+	assert_ueq(c.send.prio.n, 2);
+	assert_ueq(c.send.bulk.n, 2);
+	assert_eq(read(sv[1], buf, sizeof(buf)), -1);
+
+	/* One line released per refill */
+	c.send.flood -= IO_FLOOD_RATE;
+	io_send_tick(&c);
+
+	assert_eq(read(sv[1], buf, sizeof(buf)), 6);
+	assert_strncmp(buf, "user\r\n", 6);
+	assert_ueq(c.send.prio.n, 1);
+	assert_eq(cb_type, IO_CB_SEND_N);
+
+	/* Remaining lines released in order once the bucket refills */
+	c.send.flood = 0;
+	io_send_tick(&c);
+
+	assert_eq(read(sv[1], buf, sizeof(buf)), 23);
+	assert_strncmp(buf, "PONG :x\r\nbulk5\r\nbulk6\r\n", 23);
+	assert_ueq(c.send.prio.n, 0);
+	assert_ueq(c.send.bulk.n, 0);
+	assert_false(timer_pending(&(c.send.timer)));
+	assert_ueq(c.send.size, 0);
+	assert_eq(cb_type, IO_CB_SEND_0);
+
+	io_soc_close(&c);
+	close(sv[1]);
+}
+
+static void
+test_io_quit(void)
+{
+	/* Test QUIT is written when closing, past flood control */
+
+	char buf[128];
+	int err, sv[2];
+	struct connection c;
+
+	memset(&c, 0, sizeof(c));
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+		test_abort("socketpair");
+
+	fcntl(sv[0], F_SETFL, O_NONBLOCK);
+	fcntl(sv[1], F_SETFL, O_NONBLOCK);
+
+	c.soc = sv[0];
+	c.st_c = IO_ST_CXED;
+
+	/* Empty the bucket, holding lines */
+	for (size_t i = 0; i < IO_FLOOD_BURST + 2; i++) {
+		err = io_sendf_bulk(&c, "bulk%zu", i);
+		assert_eq(err, IO_ERR_NONE);
+	}
+
+	assert_eq(io_sendf(&c, "user"), IO_ERR_NONE);
+	assert_eq(read(sv[1], buf, sizeof(buf)), IO_FLOOD_BURST * 7);
+	assert_eq(c.send.high, 1);
+
+	cb_send_0 = 0;
+
+	/* QUIT isn't held, lines held are discarded when closed */
+	assert_eq(io_sendf(&c, "QUIT :bye"), IO_ERR_NONE);
+	assert_eq(io_dx(&c), IO_ERR_NONE);
+
+	/* Backlog cleared with the lines discarded */
+	assert_eq(cb_send_0, 1);
+	assert_eq(c.send.high, 0);
+
+	assert_eq(read(sv[1], buf, sizeof(buf)), 11);
+	assert_strncmp(buf, "QUIT :bye\r\n", 11);
+	assert_eq(read(sv[1], buf, sizeof(buf)), 0);
+	assert_eq(c.st_c, IO_ST_DXED);
+	assert_ueq(c.send.size, 0);
+
+	close(sv[1]);
+}
+
+static int dns_count;
+static struct sockaddr_in dns_addr;
+
+static int
+dns_getaddrinfo(const char *host, const char *port, const struct addrinfo *hints, struct addrinfo **res)
+{
+	/* Stub resolver, resolving "localhost" to a test listener */
+
+	char p[sizeof("65535")];
+	struct addrinfo h = *hints;
+
+	UNUSED(port);
+
+	dns_count++;
+
+	if (strcmp(host, "localhost"))
+		return EAI_NONAME;
+
+	h.ai_flags |= AI_NUMERICHOST | AI_NUMERICSERV;
+
+	snprintf(p, sizeof(p), "%u", (unsigned) ntohs(dns_addr.sin_port));
+
+	return getaddrinfo("127.0.0.1", p, &h, res);
+}
+
+static void
+dns_wait(void)
+{
+	struct pollfd pfd = { .fd = io_dns_fds[0], .events = POLLIN };
+
+	if (poll(&pfd, 1, 5000) != 1)
+		test_abort("poll");
+}
+
+static void
+test_io_dns(void)
+{
+	/* Test resolving is asynchronous, cancellable and cached */
+
+	int soc;
+	socklen_t len = sizeof(dns_addr);
+	struct connection *c = connection(NULL, "localhost", "6667");
+
+	if ((soc = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+		test_abort("socket");
+
+	dns_addr.sin_family = AF_INET;
+	dns_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(soc, (struct sockaddr *) &dns_addr, sizeof(dns_addr)) < 0
+	 || listen(soc, 4) < 0
+	 || getsockname(soc, (struct sockaddr *) &dns_addr, &len) < 0)
+		test_abort("listen");
+
+	io_dns_getaddrinfo = dns_getaddrinfo;
+	dns_count = 0;
+
+	/* Resolving is pending until the result is read */
+	io_state_cxng(c);
+
+	assert_eq(c->st_c, IO_ST_CXNG);
+	assert_eq(c->soc, -1);
+	assert_true(c->dns != NULL);
+
+	dns_wait();
+	io_dns_recv();
+
+	assert_eq(dns_count, 1);
+	assert_ptr_null(c->dns);
+	assert_ueq(c->cx_n, 1);
+	assert_true(io_dns_cache != NULL);
+
+	/* Reconnecting uses cached addresses */
+	assert_eq(io_dx(c), IO_ERR_NONE);
+	assert_eq(c->soc, -1);
+
+	io_state_cxng(c);
+
+	assert_eq(dns_count, 1);
+	assert_ptr_null(c->dns);
+	assert_ueq(c->cx_n, 1);
+
+	/* Expired addresses are resolved again, and cancelled on disconnect */
+	assert_eq(io_dx(c), IO_ERR_NONE);
+
+	io_dns_cache->expire = 0;
+	io_state_cxng(c);
+
+	assert_ptr_null(io_dns_cache);
+	assert_true(c->dns != NULL);
+	assert_eq(io_dx(c), IO_ERR_NONE);
+	assert_ptr_null(c->dns);
+
+	dns_wait();
+	io_dns_recv();
+
+	assert_eq(dns_count, 2);
+	assert_eq(c->st_c, IO_ST_DXED);
+	assert_eq(c->soc, -1);
+	assert_ptr_null(io_dns_cache);
+
+	/* Resolver errors enter the reconnect cycle */
+	io_free(c);
+
+	c = connection(NULL, "invalid", "6667");
+
+	io_state_cxng(c);
+	dns_wait();
+	io_dns_recv();
+
+	assert_eq(dns_count, 3);
+	assert_eq(c->st_c, IO_ST_RXNG);
+	assert_ptr_null(io_dns_cache);
+
+	io_free(c);
+	close(soc);
+
+	io_dns_getaddrinfo = getaddrinfo;
+}
+
+static void
+test_io_cx(void)
+{
+	/* Test connection attempts race, taking the first to connect */
+
+	int lsoc, rsoc;
+	socklen_t len = sizeof(struct sockaddr_in);
+	struct addrinfo ai[3];
+	struct sockaddr_in addr[2];
+	struct connection *c = connection(NULL, "host", "port");
+
+	memset(ai, 0, sizeof(ai));
+	memset(addr, 0, sizeof(addr));
+
+	for (int i = 0; i < 2; i++) {
+		addr[i].sin_family = AF_INET;
+		addr[i].sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	}
+
+	/* Listening, and refusing connections */
+	if ((lsoc = socket(AF_INET, SOCK_STREAM, 0)) < 0
+	 || (rsoc = socket(AF_INET, SOCK_STREAM, 0)) < 0
+	 || bind(lsoc, (struct sockaddr *) &addr[0], len) < 0
+	 || bind(rsoc, (struct sockaddr *) &addr[1], len) < 0
+	 || listen(lsoc, 4) < 0
+	 || getsockname(lsoc, (struct sockaddr *) &addr[0], &len) < 0
+	 || getsockname(rsoc, (struct sockaddr *) &addr[1], &len) < 0)
+		test_abort("listen");
+
+	for (int i = 0; i < 3; i++) {
+		ai[i].ai_family = AF_INET;
+		ai[i].ai_socktype = SOCK_STREAM;
+		ai[i].ai_addrlen = sizeof(struct sockaddr_in);
+		ai[i].ai_next = (i < 2) ? &ai[i + 1] : NULL;
+	}
+
+	ai[0].ai_addr = (struct sockaddr *) &addr[1];
+	ai[1].ai_addr = (struct sockaddr *) &addr[1];
+	ai[2].ai_addr = (struct sockaddr *) &addr[0];
+
+	c->st_c = IO_ST_CXNG;
+	c->ai_res = c->ai_cur = io_ai_copy(ai);
+
+	/* Failed attempts start the next immediately, others after a delay */
+	for (int i = 0; c->st_c == IO_ST_CXNG; i++) {
+
+		struct pollfd pfds[IO_CX_MAX];
+
+		if (i == 100)
+			test_abort("connecting");
+
+		if (c->cx_n == 0 || (timer_pending(&(c->timer)) && c->timer.expire <= io_time())) {
+			io_net_connect(c, 0);
+			continue;
+		}
+
+		for (unsigned j = 0; j < c->cx_n; j++) {
+			pfds[j].fd = c->cx[j].soc;
+			pfds[j].events = POLLOUT;
+		}
+
+		if (poll(pfds, c->cx_n, 50) > 0)
+			io_net_cx_event(c);
+	}
+
+	assert_eq(c->st_c, IO_ST_CXED);
+	assert_eq(cb_type, IO_CB_CXED);
+	assert_strcmp(c->ip, "127.0.0.1");
+	assert_true(c->soc >= 0);
+	assert_ueq(c->cx_n, 0);
+	assert_ptr_null(c->ai_res);
+
+	io_free(c);
+	close(lsoc);
+	close(rsoc);
+}
+
+static void
+test_io_ai_interleave(void)
+{
+	/* Test addresses alternate by family, in order within a family */
+
+	int families[] = { AF_INET6, AF_INET6, AF_INET6, AF_INET, AF_INET };
+	int expected[] = { AF_INET6, AF_INET, AF_INET6, AF_INET, AF_INET6 };
+	struct addrinfo ai[5], *res, *p;
+	struct sockaddr_storage addr[5];
+	size_t i;
+
+	memset(ai, 0, sizeof(ai));
+	memset(addr, 0, sizeof(addr));
+
+	for (i = 0; i < 5; i++) {
+		ai[i].ai_family = families[i];
+		ai[i].ai_addr = (struct sockaddr *) &addr[i];
+		ai[i].ai_addrlen = sizeof(addr[i]);
+		ai[i].ai_protocol = (int) i;
+		ai[i].ai_next = (i < 4) ? &ai[i + 1] : NULL;
+	}
+
+	res = io_ai_interleave(io_ai_copy(ai));
+
+	for (i = 0, p = res; p; i++, p = p->ai_next)
+		assert_eq(p->ai_family, expected[i]);
+
+	assert_ueq(i, 5);
+	assert_eq(res->ai_protocol, 0);
+	assert_eq(res->ai_next->ai_protocol, 3);
+	assert_eq(res->ai_next->ai_next->ai_protocol, 1);
+
+	io_ai_free(res);
+
+	assert_ptr_null(io_ai_interleave(NULL));
+}
+
+static void
+test_io_rxng(void)
+{
+	/* Test reconnect delays are jittered within the backoff delay */
+
+	struct connection *c = connection(NULL, "host", "port");
+	uint64_t min = UINT64_MAX, max = 0;
+
+	for (int i = 0; i < 100; i++) {
+
+		uint64_t now = io_time();
+		uint64_t delay;
+
+		c->rx_backoff = 0;
+
+		io_state_rxng(c);
+
+		assert_eq(c->st_c, IO_ST_RXNG);
+		assert_ueq(c->rx_backoff, IO_RECONNECT_BACKOFF_BASE);
+		assert_true(timer_pending(&(c->timer)));
+
+		delay = c->timer.expire - now;
+
+		assert_true(delay <= IO_RECONNECT_BACKOFF_BASE * 1000 + 1);
+		assert_true(delay + 1 >= IO_RECONNECT_BACKOFF_BASE * 1000 * (100 - IO_RECONNECT_JITTER) / 100);
+
+		min = MIN(min, delay);
+		max = MAX(max, delay);
+	}
+
+	if (IO_RECONNECT_JITTER)
+		assert_true(min < max);
+
+	io_free(c);
+}
+
+static void
+test_io_cx_sched(void)
+{
+	/* Test connections are queued past IO_RECONNECT_MAX, explicit first */
+
+	struct addrinfo ai;
+	struct sockaddr_in addr;
+	struct connection *c[IO_RECONNECT_MAX + 2];
+
+	if (IO_RECONNECT_MAX == 0)
+		return;
+
+	memset(&ai, 0, sizeof(ai));
+	memset(&addr, 0, sizeof(addr));
+
+	ai.ai_addr = (struct sockaddr *) &addr;
+	ai.ai_addrlen = sizeof(addr);
+
+	io_dns_getaddrinfo = dns_getaddrinfo;
+	dns_count = 0;
+
+	for (size_t i = 0; i < ELEMS(c); i++)
+		c[i] = connection(NULL, "invalid", "port");
+
+	/* Connections in progress */
+	for (size_t i = 0; i < IO_RECONNECT_MAX; i++) {
+		c[i]->st_c = IO_ST_CXNG;
+		c[i]->ai_res = io_ai_copy(&ai);
+	}
+
+	/* Reconnect queued */
+	c[IO_RECONNECT_MAX]->st_c = IO_ST_RXNG;
+	io_event_timeout(c[IO_RECONNECT_MAX]);
+
+	assert_eq(c[IO_RECONNECT_MAX]->st_c, IO_ST_RXNG);
+	assert_true(c[IO_RECONNECT_MAX]->cx_wait);
+	assert_false(timer_pending(&(c[IO_RECONNECT_MAX]->timer)));
+
+	/* Explicit connect queued */
+	assert_eq(io_cx(c[IO_RECONNECT_MAX + 1]), IO_ERR_NONE);
+	io_event_timeout(c[IO_RECONNECT_MAX + 1]);
+
+	assert_eq(c[IO_RECONNECT_MAX + 1]->st_c, IO_ST_CXNG);
+	assert_true(c[IO_RECONNECT_MAX + 1]->cx_wait);
+	assert_false(timer_pending(&(c[IO_RECONNECT_MAX + 1]->timer)));
+	assert_eq(io_cx(c[IO_RECONNECT_MAX + 1]), IO_ERR_CXNG);
+
+	/* Explicit connect is scheduled first when a connection completes */
+	assert_eq(io_dx(c[0]), IO_ERR_NONE);
+
+	assert_false(timer_pending(&(c[IO_RECONNECT_MAX]->timer)));
+	assert_true(timer_pending(&(c[IO_RECONNECT_MAX + 1]->timer)));
+
+	io_event_timeout(c[IO_RECONNECT_MAX + 1]);
+
+	assert_false(c[IO_RECONNECT_MAX + 1]->cx_wait);
+	assert_true(c[IO_RECONNECT_MAX + 1]->dns != NULL);
+
+	/* Then the reconnect, once resolving fails */
+	dns_wait();
+	io_dns_recv();
+
+	assert_eq(dns_count, 1);
+	assert_eq(c[IO_RECONNECT_MAX + 1]->st_c, IO_ST_RXNG);
+	assert_true(timer_pending(&(c[IO_RECONNECT_MAX]->timer)));
+
+	for (size_t i = 0; i < ELEMS(c); i++)
+		io_free(c[i]);
+
+	io_dns_getaddrinfo = getaddrinfo;
+}
+
 int
 main(void)
 {
 	struct testcase tests[] = {
 		TESTCASE(test_io_recv),
+		TESTCASE(test_io_recv_scan),
+		TESTCASE(test_io_state),
+		TESTCASE(test_io_net_recv),
+		TESTCASE(test_io_net_recv_batch),
+		TESTCASE(test_io_capture),
+		TESTCASE(test_io_sendf),
+		TESTCASE(test_io_flood),
+		TESTCASE(test_io_quit),
+		TESTCASE(test_io_dns),
+		TESTCASE(test_io_cx),
+		TESTCASE(test_io_ai_interleave),
+		TESTCASE(test_io_rxng),
+		TESTCASE(test_io_cx_sched),
 	};
 
 	return run_tests(tests);
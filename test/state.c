@@ -1,6 +1,9 @@
 #include "test/test.h"
 
 #include "src/components/buffer.c"
+#include "src/components/history.c"
+#include "src/components/search.c"
+#include "src/utils/lz.c"
 #include "src/components/channel.c"
 #include "src/components/input.c"
 #include "src/components/mode.c"
@@ -61,6 +64,17 @@ test_state(void)
 	INP_C(CTRL('l'));
 	assert_ptr_null(buffer_head(&current_channel()->buffer));
 
+	/* Test messages longer than a buffer line are split, not truncated */
+	char mesg[TEXT_LENGTH_MAX + 100 + 1];
+
+	memset(mesg, 'a', sizeof(mesg) - 1);
+	mesg[TEXT_LENGTH_MAX] = 'b';
+	mesg[sizeof(mesg) - 1] = 0;
+
+	newlinef(current_channel(), 0, "--", "%s", mesg);
+	assert_ueq(strlen(CURRENT_LINE), 100);
+	assert_strncmp(CURRENT_LINE, "baaa", 4);
+
 	/* Test adding servers */
 	struct server *s1 = server("h1", "p1", NULL, "u1", "r1");
 	struct server *s2 = server("h2", "p2", NULL, "u2", "r2");
@@ -73,11 +87,85 @@ test_state(void)
 	state_term();
 }
 
+static void
+test_state_search(void)
+{
+	state_init();
+
+	struct channel *c = current_channel();
+
+	newlinef(c, 0, "--", "needle 1");
+	newlinef(c, 0, "--", "hay");
+	newlinef(c, 0, "--", "Needle 2");
+	newlinef(c, 0, "--", "hay");
+
+	/* Test searching moves the scrollback, newest first */
+	INP_S(":search");
+	INP_C(0x0A);
+	assert_strcmp(CURRENT_LINE, ":search [words]");
+
+	INP_S(":search NEEDLE");
+	INP_C(0x0A);
+	assert_strcmp(buffer_line(&c->buffer, c->buffer.scrollback)->text, "Needle 2");
+
+	INP_S(":search");
+	INP_C(0x0A);
+	assert_strcmp(buffer_line(&c->buffer, c->buffer.scrollback)->text, "needle 1");
+
+	INP_S(":search");
+	INP_C(0x0A);
+	assert_strcmp(CURRENT_LINE, "search: no match");
+	assert_strcmp(buffer_line(&c->buffer, c->buffer.scrollback)->text, "needle 1");
+
+	/* Test queries without words are rejected, and client feedback isn't searched */
+	INP_S(":search !!");
+	INP_C(0x0A);
+	assert_strcmp(CURRENT_LINE, ":search [words]");
+
+	INP_S(":search match");
+	INP_C(0x0A);
+	assert_strcmp(CURRENT_LINE, "search: no match");
+
+	INP_S(":search words");
+	INP_C(0x0A);
+	assert_strcmp(CURRENT_LINE, "search: no match");
+	assert_strcmp(buffer_line(&c->buffer, c->buffer.scrollback)->text, "needle 1");
+
+	/* Test searching all channels, moving to the channel found */
+	struct server *s1 = server("h1", "p1", NULL, "u1", "r1");
+	struct server *s2 = server("h2", "p2", NULL, "u2", "r2");
+
+	assert_ptr_eq(server_list_add(state_server_list(), s1), NULL);
+	assert_ptr_eq(server_list_add(state_server_list(), s2), NULL);
+
+	newlinef(s2->channel, 0, "--", "a needle in h2");
+
+	channel_set_current(s1->channel);
+
+	INP_S(":search needle");
+	INP_C(0x0A);
+	assert_ptr_eq(current_channel(), s1->channel);
+	assert_strcmp(CURRENT_LINE, "search: no match");
+
+	INP_S(":searchall needle");
+	INP_C(0x0A);
+	assert_ptr_eq(current_channel(), s2->channel);
+	assert_strcmp(buffer_line(&s2->channel->buffer, s2->channel->buffer.scrollback)->text, "a needle in h2");
+
+	INP_S(":searchall");
+	INP_C(0x0A);
+	assert_ptr_eq(current_channel(), s2->channel);
+	assert_strcmp(CURRENT_LINE, "search: no match");
+
+	state_term();
+}
+
 int
 main(void)
 {
 	struct testcase tests[] = {
 		TESTCASE(test_state),
+		TESTCASE(test_state_search),
 	};
 
 	return run_tests(tests);
@@ -0,0 +1,128 @@
+#include "test/test.h"
+#include "src/utils/lz.c"
+
+static char src[1 << 16];
+static char cmp[LZ_BOUND(sizeof(src))];
+static char out[sizeof(src)];
+
+static size_t
+_roundtrip(size_t len)
+{
+	/* Compress and decompress len bytes of src, returning the compressed length */
+
+	size_t clen;
+
+	memset(out, 0, sizeof(out));
+
+	if ((clen = lz_compress(src, len, cmp, sizeof(cmp))) == 0)
+		fail_test("lz_compress");
+
+	if (lz_decompress(cmp, clen, out, sizeof(out)) != len)
+		fail_test("lz_decompress");
+
+	if (memcmp(src, out, len))
+		fail_test("roundtrip");
+
+	return clen;
+}
+
+static void
+test_lz_text(void)
+{
+	/* Test repetitive text compresses, with long literals and matches */
+
+	size_t clen, len = 0;
+
+	while (len + 64 < sizeof(src))
+		len += (size_t) sprintf(src + len, "nick%u PRIVMSG #chan :message %zu from a channel\n", (unsigned) (len % 7), len);
+
+	clen = _roundtrip(len);
+
+	assert_true(clen < len / 3);
+
+	/* Long run, overlapping matches */
+	memset(src, 'a', sizeof(src));
+
+	clen = _roundtrip(sizeof(src));
+
+	assert_true(clen < 512);
+
+	/* Short inputs, literals only */
+	memcpy(src, "abcdefghijklmnopqrstuvwxyz", 26);
+
+	for (len = 1; len <= 26; len++)
+		assert_eq(_roundtrip(len), len + 1 + (len >= 15));
+}
+
+static void
+test_lz_random(void)
+{
+	/* Test incompressible data, and data repeating beyond the maximum offset */
+
+	uint32_t x = 2463534242U;
+
+	for (size_t i = 0; i < sizeof(src); i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		src[i] = (char) x;
+	}
+
+	assert_true(_roundtrip(sizeof(src)) <= LZ_BOUND(sizeof(src)));
+
+	memcpy(src + sizeof(src) / 2, src, sizeof(src) / 2);
+
+	_roundtrip(sizeof(src));
+
+	for (size_t i = 0; i < sizeof(src); i++)
+		src[i] = (char) (i % 251 < 64 ? 'x' : src[i]);
+
+	_roundtrip(sizeof(src));
+}
+
+static void
+test_lz_bounds(void)
+{
+	/* Test compressing to too small a buffer, and decompressing malformed input */
+
+	size_t clen, len;
+
+	for (len = 0; len < 4096; len++)
+		src[len] = (char) ('a' + (len * len) % 26);
+
+	clen = lz_compress(src, len, cmp, sizeof(cmp));
+
+	assert_true(clen > 0);
+	assert_eq(lz_compress(src, len, cmp, clen - 1), 0);
+	assert_eq(lz_compress(src, len, cmp, clen), clen);
+
+	/* Output too small */
+	assert_eq(lz_decompress(cmp, clen, out, len - 1), 0);
+	assert_eq(lz_decompress(cmp, clen, out, len), len);
+
+	/* Truncated */
+	for (size_t i = 1; i < clen; i++)
+		assert_true(lz_decompress(cmp, i, out, sizeof(out)) < len);
+
+	/* Offset before the start of output */
+	assert_eq(lz_decompress("\x10" "a" "\x02\x00", 4, out, sizeof(out)), 0);
+
+	/* Offset of 0 */
+	assert_eq(lz_decompress("\x10" "a" "\x00\x00", 4, out, sizeof(out)), 0);
+
+	/* Literal length past input */
+	assert_eq(lz_decompress("\xf0\xff", 2, out, sizeof(out)), 0);
+	assert_eq(lz_decompress("\x50" "abc", 4, out, sizeof(out)), 0);
+}
+
+int
+main(void)
+{
+	struct testcase tests[] = {
+		TESTCASE(test_lz_text),
+		TESTCASE(test_lz_random),
+		TESTCASE(test_lz_bounds),
+	};
+
+	return run_tests(tests);
+}
@@ -0,0 +1,233 @@
+#include "test/test.h"
+#include "src/utils/timer.c"
+
+#define TEST_TIMERS 256
+
+static struct timer_wheel w;
+static struct timer timers[TEST_TIMERS];
+static uint64_t fired[TEST_TIMERS];
+static unsigned fired_n;
+
+static void
+timer_f(void *arg)
+{
+	struct timer *t = arg;
+
+	if (t->expire != w.now)
+		fail_testf("timer %u fired at %" PRIu64 ", expected %" PRIu64,
+			(unsigned) (t - timers), w.now, t->expire);
+
+	fired[fired_n++] = (uint64_t) (t - timers);
+}
+
+static void
+test_timers_init(uint64_t now)
+{
+	timer_init(&w, now);
+
+	memset(timers, 0, sizeof(timers));
+	fired_n = 0;
+
+	for (size_t i = 0; i < TEST_TIMERS; i++) {
+		timers[i].f = timer_f;
+		timers[i].arg = &timers[i];
+	}
+}
+
+static void
+test_timer_add(void)
+{
+	/* Test timers fire at their deadline, in order */
+
+	test_timers_init(1000);
+
+	assert_eq(timer_next(&w, 1000), -1);
+
+	timer_add(&w, &timers[0], 1010);
+	timer_add(&w, &timers[1], 1005);
+	timer_add(&w, &timers[2], 1500);
+	timer_add(&w, &timers[3], 1000); /* expired, fires on the next tick */
+
+	assert_true(timer_pending(&timers[0]));
+	assert_eq(timer_next(&w, 1000), 1);
+
+	timer_run(&w, 1004);
+
+	assert_ueq(fired_n, 1);
+	assert_ueq(fired[0], 3);
+	assert_eq(timer_next(&w, 1004), 1);
+
+	timer_run(&w, 1010);
+
+	assert_ueq(fired_n, 3);
+	assert_ueq(fired[1], 1);
+	assert_ueq(fired[2], 0);
+	assert_false(timer_pending(&timers[0]));
+
+	timer_run(&w, 1499);
+
+	assert_ueq(fired_n, 3);
+
+	timer_run(&w, 5000);
+
+	assert_ueq(fired_n, 4);
+	assert_ueq(fired[3], 2);
+	assert_ueq(w.now, 5000);
+	assert_eq(timer_next(&w, 5000), -1);
+}
+
+static void
+test_timer_del(void)
+{
+	/* Test deleted and rescheduled timers */
+
+	test_timers_init(0);
+
+	timer_add(&w, &timers[0], 100);
+	timer_add(&w, &timers[1], 100000);
+	timer_add(&w, &timers[2], 200);
+
+	timer_del(&w, &timers[0]);
+	timer_del(&w, &timers[0]);
+
+	assert_false(timer_pending(&timers[0]));
+
+	/* Rescheduled earlier, from a higher level */
+	timer_add(&w, &timers[1], 150);
+
+	timer_run(&w, 1000000);
+
+	assert_ueq(fired_n, 2);
+	assert_ueq(fired[0], 1);
+	assert_ueq(fired[1], 2);
+
+	for (size_t i = 0; i < TIMER_LVL_N; i++)
+		assert_ueq(w.n[i], 0);
+}
+
+static void
+test_timer_levels(void)
+{
+	/* Test deadlines across all levels, and beyond the highest */
+
+	uint64_t now = 123456789;
+	uint64_t deadlines[] = {
+		1,
+		TIMER_LVL_SIZE - 1,
+		TIMER_LVL_SIZE,
+		TIMER_LVL_SIZE * TIMER_LVL_SIZE - 1,
+		TIMER_LVL_SIZE * TIMER_LVL_SIZE,
+		86400000,
+		TIMER_SPAN(TIMER_LVL_N) - 1,
+		TIMER_SPAN(TIMER_LVL_N),
+		TIMER_SPAN(TIMER_LVL_N) * 3 + 7,
+	};
+
+	test_timers_init(now);
+
+	for (size_t i = 0; i < ELEMS(deadlines); i++)
+		timer_add(&w, &timers[i], now + deadlines[i]);
+
+	for (size_t i = 0; i < ELEMS(deadlines); i++) {
+
+		int64_t next;
+
+		/* Run to each wakeup, as the event loop would */
+		while (fired_n == i) {
+			if ((next = timer_next(&w, w.now)) <= 0)
+				test_abort("timer_next");
+			timer_run(&w, w.now + (uint64_t) next);
+		}
+
+		assert_ueq(fired_n, i + 1);
+		assert_ueq(fired[i], i);
+		assert_ueq(w.now, now + deadlines[i]);
+	}
+}
+
+static void
+test_timer_random(void)
+{
+	/* Test random deadlines, run in random increments, fire in order */
+
+	uint64_t now = 1;
+	uint64_t last = 0;
+
+	test_timers_init(now);
+
+	srand(1);
+
+	for (size_t i = 0; i < TEST_TIMERS; i++) {
+		uint64_t delta = (uint64_t) rand() % ((i % 4 == 0) ? 100000000 : 10000);
+		timer_add(&w, &timers[i], now + delta);
+	}
+
+	while (fired_n < TEST_TIMERS) {
+
+		unsigned n = fired_n;
+
+		now += (uint64_t) rand() % 50000;
+
+		timer_run(&w, now);
+
+		for (; n < fired_n; n++) {
+			assert_true(timers[fired[n]].expire >= last);
+			assert_true(timers[fired[n]].expire <= now);
+			last = timers[fired[n]].expire;
+		}
+
+		for (size_t i = 0; i < TEST_TIMERS; i++) {
+			if (timer_pending(&timers[i]) && timers[i].expire <= now)
+				test_abort("timer not fired");
+		}
+	}
+}
+
+static unsigned resched_n;
+
+static void
+timer_resched(void *arg)
+{
+	struct timer *t = arg;
+
+	/* Rescheduled from its own callback, and cancelling another */
+	if (++resched_n < 10)
+		timer_add(&w, t, w.now + 1000);
+
+	timer_del(&w, &timers[1]);
+}
+
+static void
+test_timer_callback(void)
+{
+	/* Test timers added and deleted from callbacks */
+
+	test_timers_init(0);
+
+	timers[0].f = timer_resched;
+	resched_n = 0;
+
+	timer_add(&w, &timers[0], 10);
+	timer_add(&w, &timers[1], 11);
+	timer_add(&w, &timers[2], 10000);
+
+	timer_run(&w, 20000);
+
+	assert_ueq(resched_n, 10);
+	assert_ueq(fired_n, 1);
+	assert_ueq(fired[0], 2);
+}
+
+int
+main(void)
+{
+	struct testcase tests[] = {
+		TESTCASE(test_timer_add),
+		TESTCASE(test_timer_del),
+		TESTCASE(test_timer_levels),
+		TESTCASE(test_timer_random),
+		TESTCASE(test_timer_callback),
+	};
+
+	return run_tests(tests);
+}
@@ -172,6 +172,57 @@ test_irc_message_parse(void)
 	char mesg9[] = ": CMD arg1 arg2 arg3";
 	CHECK_IRC_MESSAGE_PARSE(mesg9, 0);
 
+	/* Test message tags */
+	char mesg10[] = "@time=2019-01-01T00:00:00.000Z;msgid=abc :nick!user@host CMD arg1 :trailing";
+
+	CHECK_IRC_MESSAGE_PARSE(mesg10, 1);
+	assert_strcmp(m.tags,    "time=2019-01-01T00:00:00.000Z;msgid=abc");
+	assert_strcmp(m.command, "CMD");
+	assert_strcmp(m.from,    "nick");
+	assert_strcmp(m.host,    "user@host");
+	assert_strcmp(m.params,  "arg1 :trailing");
+	assert_ueq(m.len_tags,    39);
+	assert_ueq(m.len_command, 3);
+
+	/* Test message tags without prefix */
+	char mesg11[] = "@a=1  CMD";
+
+	CHECK_IRC_MESSAGE_PARSE(mesg11, 1);
+	assert_strcmp(m.tags,    "a=1");
+	assert_strcmp(m.command, "CMD");
+	assert_strcmp(m.from,    NULL);
+	assert_strcmp(m.params,  NULL);
+
+	/* Error: message tags only */
+	char mesg12[] = "@a=1;b=2 ";
+	CHECK_IRC_MESSAGE_PARSE(mesg12, 0);
+
+	/* Test numeric code */
+	char mesg13[] = ":server 001 nick :welcome";
+
+	CHECK_IRC_MESSAGE_PARSE(mesg13, 1);
+	assert_strcmp(m.command, "001");
+	assert_strcmp(m.params,  "nick :welcome");
+	assert_ueq(m.code, 1);
+
+	char mesg14[] = ":server 433 * nick :in use";
+
+	CHECK_IRC_MESSAGE_PARSE(mesg14, 1);
+	assert_ueq(m.code, 433);
+
+	char mesg15[] = "@a=1 :nick!user@host PRIVMSG #chan :123";
+
+	CHECK_IRC_MESSAGE_PARSE(mesg15, 1);
+	assert_ueq(m.code, 0);
+
+	/* Error: malformed numeric code */
+	char mesg16[] = ":server 1234 nick";
+	char mesg17[] = ":server 12 nick";
+	char mesg18[] = ":server 1a3 nick";
+	CHECK_IRC_MESSAGE_PARSE(mesg16, 0);
+	CHECK_IRC_MESSAGE_PARSE(mesg17, 0);
+	CHECK_IRC_MESSAGE_PARSE(mesg18, 0);
+
 #undef CHECK_IRC_MESSAGE_PARSE
 }
 